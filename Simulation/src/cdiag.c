@@ -0,0 +1,388 @@
+/*
+    The following source-code provides in-situ diagnostics of the cluster
+    beyond its energy: virial ratio, angular momentum, drift of the center
+    of mass, Lagrangian radii and core radius. They are calculated on the
+    snapshot of the energy diagnostics, distributed over all processes and
+    threads. Lagrangian radii are selected by refining histograms of the
+    radii instead of sorting them.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "cdiag.h"
+#include "engine.h"
+#include <float.h>
+#include <math.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "output.h"
+#include "reduce.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "workspace.h"
+
+#define PI 3.14159265358979323846
+#define BINS 256 /* bins of the histograms refining the Lagrangian radii */
+#define FRACTIONS 5 /* amount of Lagrangian radii */
+#define MOMENTS 10 /* mass, mass times position and velocity, angular momentum */
+#define CORE_MOMENTS 5 /* mass, mass times velocity and squared velocity within the core */
+
+/* mass fractions of the Lagrangian radii */
+static const double fractions[FRACTIONS] = {0.1, 0.25, 0.5, 0.75, 0.9};
+
+static double *radius; /* distance of every local particle to the center of mass */
+static double *partials; /* partial sums of every block, quantity by quantity */
+
+#ifdef USE_MPI
+static MPI_Comm cdiag_comm; /* used by the diagnostics thread only */
+#endif
+
+/*
+ * Function:  cluster_bytes
+ * ====================
+ *  N: amount of particles
+ *
+ *  returns: size of all arrays initClusterDiagnostics takes from the workspace
+ * --------------------
+ */
+size_t cluster_bytes(int N)
+{
+  return workspace_bytes(N, sizeof(double)) + workspace_bytes((size_t) MOMENTS * reduce_blocks(N), sizeof(double)); /* provided by workspace.h */
+}
+
+/*
+ * Function:  initClusterDiagnostics
+ * ====================
+ *  Takes the arrays needed from the workspace. Has to be called by the
+ *  main thread of all processes.
+ *
+ *  N: amount of particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void initClusterDiagnostics(int N)
+{
+  radius = workspace_alloc(N, sizeof(double)); /* provided by workspace.h */
+  partials = workspace_alloc((size_t) MOMENTS * reduce_blocks(N), sizeof(double)); /* provided by reduce.h */
+
+#ifdef USE_MPI
+  MPI_Comm_dup(MPI_COMM_WORLD, &cdiag_comm);
+#endif
+}
+
+/*
+ * Function:  freeClusterDiagnostics
+ * ====================
+ *  Frees all memory allocated by initClusterDiagnostics.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeClusterDiagnostics()
+{
+#ifdef USE_MPI
+  MPI_Comm_free(&cdiag_comm);
+#endif
+
+  workspace_free(radius);
+  workspace_free(partials);
+}
+
+/*
+ * Function:  sum_blocks
+ * ====================
+ *  Combines the partial sums of all processes and sums every quantity
+ *  in a fixed order, the result is available on all processes.
+ *
+ *  blocks: amount of blocks
+ *  quantities: amount of quantities
+ *  sums: sum of every quantity
+ *
+ *  returns: void
+ * --------------------
+ */
+static void sum_blocks(int blocks, int quantities, double *sums)
+{
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, partials, blocks * quantities, MPI_DOUBLE, MPI_SUM, cdiag_comm);
+#endif
+
+  for(int q = 0; q < quantities; ++q)
+  {
+    sums[q] = reduce_tree(partials + q * blocks, blocks);
+  }
+}
+
+/*
+ * Function:  lagrangian_radii
+ * ====================
+ *  Selects the radii containing the given fractions of the particles.
+ *  The range holding each wanted rank is split into BINS bins, the counts
+ *  of all processes are combined and the range is narrowed to the bin
+ *  holding the rank, until it holds a single radius or cannot be split.
+ *
+ *  first: first local particle
+ *  last: end of local particles
+ *  N: amount of particles
+ *  radii: Lagrangian radius of every fraction
+ *
+ *  returns: void
+ * --------------------
+ */
+static void lagrangian_radii(int first, int last, int N, double *radii)
+{
+  double lo[FRACTIONS], hi[FRACTIONS]; /* range holding the wanted radius */
+  long wanted[FRACTIONS]; /* rank of the wanted radius within the range */
+  int active[FRACTIONS];
+  double r_max = 0.0;
+
+  #pragma omp parallel for reduction(max:r_max)
+  for(int mi = first; mi < last; ++mi)
+  {
+    r_max = fmax(r_max, radius[mi]);
+  }
+
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &r_max, 1, MPI_DOUBLE, MPI_MAX, cdiag_comm);
+#endif
+
+  for(int f = 0; f < FRACTIONS; ++f)
+  {
+    lo[f] = 0.0;
+    hi[f] = nextafter(r_max, INFINITY); /* the range excludes its upper bound */
+    wanted[f] = (long) ceil(fractions[f] * N) - 1;
+    active[f] = 1;
+  }
+
+  int remaining = FRACTIONS;
+
+  while(remaining > 0)
+  {
+    long counts[FRACTIONS * BINS] = {0};
+
+    #pragma omp parallel for reduction(+:counts[:FRACTIONS * BINS])
+    for(int mi = first; mi < last; ++mi)
+    {
+      for(int f = 0; f < FRACTIONS; ++f)
+      {
+        if(active[f] && radius[mi] >= lo[f] && radius[mi] < hi[f])
+        {
+          int bin = (int) ((radius[mi] - lo[f]) / (hi[f] - lo[f]) * BINS);
+          ++counts[f * BINS + (bin < BINS ? bin : BINS - 1)];
+        }
+      }
+    }
+
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, counts, FRACTIONS * BINS, MPI_LONG, MPI_SUM, cdiag_comm);
+#endif
+
+    for(int f = 0; f < FRACTIONS; ++f)
+    {
+      if(!active[f])
+      {
+        continue;
+      }
+
+      double width = (hi[f] - lo[f]) / BINS;
+      int bin = 0;
+
+      /* bin holding the wanted rank */
+      while(wanted[f] >= counts[f * BINS + bin])
+      {
+        wanted[f] -= counts[f * BINS + bin++];
+      }
+
+      double next_lo = lo[f] + bin * width;
+      double next_hi = (bin < BINS - 1) ? lo[f] + (bin + 1) * width : hi[f];
+
+      /* a single radius is left or the range cannot be split any further */
+      if(counts[f * BINS + bin] == 1 || next_hi - next_lo <= DBL_EPSILON * next_hi)
+      {
+        active[f] = 0;
+        --remaining;
+      }
+
+      lo[f] = next_lo;
+      hi[f] = next_hi;
+    }
+  }
+
+  /* smallest radius within the final range */
+  for(int f = 0; f < FRACTIONS; ++f)
+  {
+    double r = INFINITY;
+
+    #pragma omp parallel for reduction(min:r)
+    for(int mi = first; mi < last; ++mi)
+    {
+      if(radius[mi] >= lo[f] && radius[mi] < hi[f])
+      {
+        r = fmin(r, radius[mi]);
+      }
+    }
+
+    radii[f] = r;
+  }
+
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, radii, FRACTIONS, MPI_DOUBLE, MPI_MIN, cdiag_comm);
+#endif
+}
+
+/*
+ * Function:  cluster_diagnostics
+ * ====================
+ *  Calculates the diagnostics of the cluster and prints them on the root
+ *  process. Every process handles its blocks of particles. The core radius
+ *  is the King radius sqrt(9 sigma^2 / (4 pi G rho_0)) in standard units,
+ *  with density and one-dimensional velocity dispersion taken within the
+ *  innermost Lagrangian radius. Particles are assumed to have equal masses.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  vel: velocities of all particles, dimension by dimension
+ *  e_kinetic: kinetic energy, only needed on the root process
+ *  e_potential: potential energy, only needed on the root process
+ *
+ *  returns: void
+ * --------------------
+ */
+void cluster_diagnostics(int iteration, double time, int N, int DIM, const double *mass, const double *pos,
+                         const double *vel, double e_kinetic, double e_potential)
+{
+  int blocks = reduce_blocks(N); /* provided by reduce.h */
+  int first_block = (int) ((long) blocks * world_rank / world_size);
+  int last_block = (int) ((long) blocks * (world_rank + 1) / world_size);
+  int first = first_block * REDUCE_BLOCK;
+  int last = (last_block * REDUCE_BLOCK < N) ? last_block * REDUCE_BLOCK : N;
+  double sums[MOMENTS];
+
+  (void) DIM; /* the angular momentum needs three dimensions, as does the whole simulation */
+
+  const double *x = pos, *y = pos + N, *z = pos + 2 * N;
+  const double *vx = vel, *vy = vel + N, *vz = vel + 2 * N;
+
+  /* mass, center of mass, its velocity and the angular momentum around the origin */
+  #pragma omp parallel for
+  for(int b = 0; b < blocks; ++b)
+  {
+    double s[MOMENTS] = {0};
+
+    if(b >= first_block && b < last_block)
+    {
+      int end = (b + 1) * REDUCE_BLOCK < N ? (b + 1) * REDUCE_BLOCK : N;
+
+      for(int mi = b * REDUCE_BLOCK; mi < end; ++mi)
+      {
+        double m = mass[mi];
+
+        s[0] += m;
+        s[1] += m * x[mi]; s[2] += m * y[mi]; s[3] += m * z[mi];
+        s[4] += m * vx[mi]; s[5] += m * vy[mi]; s[6] += m * vz[mi];
+        s[7] += m * (y[mi] * vz[mi] - z[mi] * vy[mi]);
+        s[8] += m * (z[mi] * vx[mi] - x[mi] * vz[mi]);
+        s[9] += m * (x[mi] * vy[mi] - y[mi] * vx[mi]);
+      }
+    }
+
+    for(int q = 0; q < MOMENTS; ++q)
+    {
+      partials[q * blocks + b] = s[q];
+    }
+  }
+
+  sum_blocks(blocks, MOMENTS, sums);
+
+  double M = sums[0];
+  double R[3] = {sums[1] / M, sums[2] / M, sums[3] / M}; /* center of mass */
+  double V[3] = {sums[4] / M, sums[5] / M, sums[6] / M}; /* its velocity */
+
+  /* angular momentum around the center of mass */
+  double L[3] =
+  {
+    sums[7] - M * (R[1] * V[2] - R[2] * V[1]),
+    sums[8] - M * (R[2] * V[0] - R[0] * V[2]),
+    sums[9] - M * (R[0] * V[1] - R[1] * V[0])
+  };
+
+  #pragma omp parallel for
+  for(int mi = first; mi < last; ++mi)
+  {
+    radius[mi] = sqrt((x[mi] - R[0]) * (x[mi] - R[0]) + (y[mi] - R[1]) * (y[mi] - R[1])
+                      + (z[mi] - R[2]) * (z[mi] - R[2]));
+  }
+
+  double radii[FRACTIONS];
+  lagrangian_radii(first, last, N, radii);
+
+  /* mass and velocity dispersion within the innermost Lagrangian radius */
+  #pragma omp parallel for
+  for(int b = 0; b < blocks; ++b)
+  {
+    double s[CORE_MOMENTS] = {0};
+
+    if(b >= first_block && b < last_block)
+    {
+      int end = (b + 1) * REDUCE_BLOCK < N ? (b + 1) * REDUCE_BLOCK : N;
+
+      for(int mi = b * REDUCE_BLOCK; mi < end; ++mi)
+      {
+        if(radius[mi] <= radii[0])
+        {
+          double m = mass[mi];
+
+          s[0] += m;
+          s[1] += m * vx[mi]; s[2] += m * vy[mi]; s[3] += m * vz[mi];
+          s[4] += m * (vx[mi] * vx[mi] + vy[mi] * vy[mi] + vz[mi] * vz[mi]);
+        }
+      }
+    }
+
+    for(int q = 0; q < CORE_MOMENTS; ++q)
+    {
+      partials[q * blocks + b] = s[q];
+    }
+  }
+
+  sum_blocks(blocks, CORE_MOMENTS, sums);
+
+  if(world_rank == 0)
+  {
+    double core_mass = sums[0];
+    double mean2 = (sums[1] * sums[1] + sums[2] * sums[2] + sums[3] * sums[3]) / (core_mass * core_mass);
+    double sigma2 = (sums[4] / core_mass - mean2) / 3; /* one-dimensional velocity dispersion */
+    double rho = core_mass / (4.0 / 3.0 * PI * radii[0] * radii[0] * radii[0]);
+
+    double values[] =
+    {
+      2 * e_kinetic / fabs(e_potential), /* virial ratio, one in equilibrium */
+      L[0], L[1], L[2], sqrt(L[0] * L[0] + L[1] * L[1] + L[2] * L[2]),
+      sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]), sqrt(V[0] * V[0] + V[1] * V[1] + V[2] * V[2]),
+      radii[0], radii[1], radii[2], radii[3], radii[4],
+      sqrt(9 * sigma2 / (4 * PI * rho))
+    };
+
+    printClusterDiagnostics(iteration, time, values, sizeof(values) / sizeof(values[0])); /* provided by output.h */
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef CDIAG_H_
+#define CDIAG_H_
+
+#include <stddef.h>
+
+size_t cluster_bytes(int N);
+
+void initClusterDiagnostics(int N);
+
+void cluster_diagnostics(int iteration, double time, int N, int DIM, const double *mass, const double *pos,
+                         const double *vel, double e_kinetic, double e_potential);
+
+void freeClusterDiagnostics(void);
+
+#endif // CDIAG_H_
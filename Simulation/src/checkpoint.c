@@ -0,0 +1,479 @@
+/*
+    The following source code provides checkpoints of the whole state of a
+    run, so a run which has been stopped can be continued from its last
+    checkpoint with the same results as without stopping. Every module
+    registers the values and arrays it keeps between steps when it is
+    initialized, a checkpoint holds all of them in the order of their
+    registration. Modules with state outside of memory, like open files
+    or a background thread, register hooks which are called before a
+    checkpoint is written and after it has been restored.
+
+    Checkpoints are written every few steps and when the process receives
+    SIGTERM or SIGUSR1, after which the run stops. All processes hold the
+    same state, only the first process writes the checkpoint, into a
+    temporary file which replaces the last checkpoint once it is complete.
+    A run is continued with the same options, arguments, processes and
+    threads, then its results match a run which was never stopped bit by
+    bit. Output written after the checkpoint is discarded and a note is
+    appended to the log file, compressed snapshots start with a keyframe,
+    so their bytes differ while every frame restores to the same values.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "output.h"
+#include <signal.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ITEMS 64 /* most values and arrays registered at once */
+#define HOOKS 16 /* most hooks registered at once */
+#define SIGNAL_EVERY 16 /* steps between which the processes agree on signals, besides checkpoints */
+
+/* registered value, arrays are found through a pointer which may be swapped during the run */
+struct item
+{
+  const char *name;
+  void *value; /* NULL for arrays */
+  void **array; /* NULL for values */
+  size_t bytes;
+};
+
+static struct item items[ITEMS];
+static int item_count = 0;
+
+static void (*save_hooks[HOOKS])(void);
+static void (*restore_hooks[HOOKS])(void);
+static int hook_count = 0;
+
+static int checkpoint_every = 0; /* steps between checkpoints, zero only writes them on signals */
+static unsigned long checkpoint_seed;
+static char checkpoint_configuration[512];
+static char restart_name[256]; /* checkpoint the run is continued from */
+static int resuming = 0;
+static struct checkpoint_header resumed; /* header of that checkpoint */
+
+static volatile sig_atomic_t signalled = 0; /* set by the signal handler */
+static int stopping = 0; /* a process received a signal, the run stops after the checkpoint */
+static int checkpoints = 0; /* checkpoints written */
+static int last_iteration = 0; /* iteration of the last checkpoint */
+
+#ifdef USE_MPI
+static MPI_Comm checkpoint_comm; /* own communicator, so the agreement never meets collectives of the engines */
+#endif
+
+/*
+ * Function:  request_checkpoint
+ * ====================
+ *  Signal handler, asks the time loop for a checkpoint.
+ *
+ *  signal: received signal
+ *
+ *  returns: void
+ * --------------------
+ */
+static void request_checkpoint(int signal)
+{
+  (void) signal;
+
+  signalled = 1;
+}
+
+/*
+ * Function:  initCheckpoints
+ * ====================
+ *  Installs the signal handlers and reads the header of the checkpoint
+ *  the run is continued from, which has to belong to a run with the
+ *  same configuration. Has to be called by all processes before any
+ *  module registers its state.
+ *
+ *  restart: checkpoint the run is continued from, NULL for a new run
+ *  every: steps between checkpoints, zero only writes them on signals
+ *  seed: seed of the initial conditions, replaced by the one of the checkpoint
+ *  configuration: options affecting the results, the end of the run may change
+ *
+ *  returns: void
+ * --------------------
+ */
+void initCheckpoints(const char *restart, int every, unsigned long seed, const char *configuration)
+{
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+
+  action.sa_handler = request_checkpoint;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGUSR1, &action, NULL);
+
+  checkpoint_every = every;
+  checkpoint_seed = seed;
+  snprintf(checkpoint_configuration, sizeof(checkpoint_configuration), "%s", configuration);
+
+  item_count = hook_count = 0;
+  resuming = 0;
+
+#ifdef USE_MPI
+  MPI_Comm_dup(MPI_COMM_WORLD, &checkpoint_comm);
+#endif
+
+  if(restart == NULL)
+  {
+    return;
+  }
+
+  snprintf(restart_name, sizeof(restart_name), "%s", restart);
+
+  FILE *in = fopen(restart_name, "rb");
+
+  if(in == NULL || fread(&resumed, sizeof(resumed), 1, in) != 1)
+  {
+    fprintf(stderr, "Unable to read checkpoint %s!\n", restart_name);
+    exit(0);
+  }
+
+  fclose(in);
+
+  if(memcmp(resumed.magic, CHECKPOINT_MAGIC, sizeof(resumed.magic)) != 0 || resumed.version != CHECKPOINT_VERSION ||
+     resumed.endian != CHECKPOINT_ENDIAN || resumed.header_bytes != sizeof(resumed))
+  {
+    fprintf(stderr, "%s is no checkpoint of this version or machine!\n", restart_name);
+    exit(0);
+  }
+
+  resumed.folder[sizeof(resumed.folder) - 1] = '\0';
+  resumed.configuration[sizeof(resumed.configuration) - 1] = '\0';
+
+  if(strcmp(resumed.configuration, checkpoint_configuration) != 0)
+  {
+    fprintf(stderr, "Options do not match the checkpoint, expected %s!\n", resumed.configuration);
+    exit(0);
+  }
+
+  checkpoint_seed = resumed.seed;
+  resuming = 1;
+}
+
+/*
+ * Function:  checkpoint_resumed
+ * ====================
+ *  returns: header of the checkpoint the run is continued from, NULL for a new run
+ * --------------------
+ */
+const struct checkpoint_header *checkpoint_resumed()
+{
+  return resuming ? &resumed : NULL;
+}
+
+/*
+ * Function:  register_item
+ * ====================
+ *  Appends a value or an array to the registry.
+ *
+ *  name: name of the item, at most 15 characters
+ *  value: memory of the value, NULL for arrays
+ *  array: pointer to the array, NULL for values
+ *  bytes: size of the item
+ *
+ *  returns: void
+ * --------------------
+ */
+static void register_item(const char *name, void *value, void **array, size_t bytes)
+{
+  if(item_count == ITEMS || strlen(name) >= sizeof(((struct checkpoint_item *) NULL)->name))
+  {
+    fprintf(stderr, "Unable to register %s for checkpoints!\n", name);
+    exit(0);
+  }
+
+  items[item_count].name = name;
+  items[item_count].value = value;
+  items[item_count].array = array;
+  items[item_count].bytes = bytes;
+
+  ++item_count;
+}
+
+/*
+ * Function:  checkpoint_value
+ * ====================
+ *  Registers memory which stays at the same place during the run,
+ *  like a variable or an array which is never swapped.
+ *
+ *  name: name of the value, at most 15 characters
+ *  value: memory of the value
+ *  bytes: size of the value
+ *
+ *  returns: void
+ * --------------------
+ */
+void checkpoint_value(const char *name, void *value, size_t bytes)
+{
+  register_item(name, value, NULL, bytes);
+}
+
+/*
+ * Function:  checkpoint_array
+ * ====================
+ *  Registers an array which may be exchanged with other buffers by
+ *  swapping pointers, the array is found through the pointer.
+ *
+ *  name: name of the array, at most 15 characters
+ *  array: pointer to the array
+ *  bytes: size of the array
+ *
+ *  returns: void
+ * --------------------
+ */
+void checkpoint_array(const char *name, void **array, size_t bytes)
+{
+  register_item(name, NULL, array, bytes);
+}
+
+/*
+ * Function:  checkpoint_hooks
+ * ====================
+ *  Registers functions which bring state outside of memory in line
+ *  with the registered values, called by every process.
+ *
+ *  save: called before a checkpoint is written, NULL if not needed
+ *  restore: called after all values have been restored, NULL if not needed
+ *
+ *  returns: void
+ * --------------------
+ */
+void checkpoint_hooks(void (*save)(void), void (*restore)(void))
+{
+  if(hook_count == HOOKS)
+  {
+    fprintf(stderr, "Unable to register checkpoint hooks!\n");
+    exit(0);
+  }
+
+  save_hooks[hook_count] = save;
+  restore_hooks[hook_count] = restore;
+
+  ++hook_count;
+}
+
+/*
+ * Function:  restore_checkpoint
+ * ====================
+ *  Reads all registered values from the checkpoint the run is continued
+ *  from and calls the restore hooks. Every item has to match name and
+ *  size of its registration. Called by every process once all modules
+ *  have registered their state.
+ *
+ *  returns: void
+ * --------------------
+ */
+void restore_checkpoint()
+{
+  FILE *in = fopen(restart_name, "rb");
+
+  if(in == NULL || fseek(in, resumed.header_bytes, SEEK_SET) != 0 || (int) resumed.items != item_count)
+  {
+    fprintf(stderr, "Checkpoint %s does not match the run!\n", restart_name);
+    exit(0);
+  }
+
+  for(int i = 0; i < item_count; ++i)
+  {
+    struct checkpoint_item item;
+    void *data = (items[i].value != NULL) ? items[i].value : *items[i].array;
+
+    if(fread(&item, sizeof(item), 1, in) != 1 || strncmp(item.name, items[i].name, sizeof(item.name)) != 0 ||
+       item.bytes != items[i].bytes || fread(data, 1, items[i].bytes, in) != items[i].bytes)
+    {
+      fprintf(stderr, "Checkpoint %s does not match the run at %s!\n", restart_name, items[i].name);
+      exit(0);
+    }
+  }
+
+  fclose(in);
+
+  for(int h = 0; h < hook_count; ++h)
+  {
+    if(restore_hooks[h] != NULL)
+    {
+      restore_hooks[h]();
+    }
+  }
+}
+
+/*
+ * Function:  checkpoint_due
+ * ====================
+ *  Decides whether a checkpoint is written at the current iteration,
+ *  every checkpoint_every steps or after a signal. Has to be called
+ *  by all processes, which agree on stopping if any of them received
+ *  a signal. The agreement synchronizes all processes, so it only takes
+ *  place every SIGNAL_EVERY steps and at periodic checkpoints, a signal
+ *  is answered a few steps later.
+ *
+ *  iteration: current iteration
+ *
+ *  returns: nonzero if a checkpoint is due
+ * --------------------
+ */
+int checkpoint_due(int iteration)
+{
+  int stop = signalled;
+  int periodic = (checkpoint_every > 0 && iteration % checkpoint_every == 0);
+
+#ifdef USE_MPI
+  if(!periodic && iteration % SIGNAL_EVERY != 0)
+  {
+    return 0;
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE, &stop, 1, MPI_INT, MPI_MAX, checkpoint_comm);
+#endif
+
+  stopping = stop;
+
+  return stop || periodic;
+}
+
+/*
+ * Function:  write_checkpoint
+ * ====================
+ *  Calls the save hooks and writes all registered values. The checkpoint
+ *  is written to a temporary file, which replaces the last checkpoint
+ *  only once it is complete, so a run killed while writing still has a
+ *  valid checkpoint. Called by every process.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *
+ *  returns: void
+ * --------------------
+ */
+void write_checkpoint(int iteration, double time)
+{
+  for(int h = 0; h < hook_count; ++h)
+  {
+    if(save_hooks[h] != NULL)
+    {
+      save_hooks[h]();
+    }
+  }
+
+  ++checkpoints;
+  last_iteration = iteration;
+
+  if(world_rank != 0)
+  {
+    return;
+  }
+
+  struct checkpoint_header header;
+  memset(&header, 0, sizeof(header));
+
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.endian = CHECKPOINT_ENDIAN;
+  header.header_bytes = sizeof(header);
+  header.items = item_count;
+  header.iteration = iteration;
+  header.time = time;
+  header.seed = checkpoint_seed;
+  snprintf(header.folder, sizeof(header.folder), "%s", foldername); /* provided by output.h */
+  snprintf(header.configuration, sizeof(header.configuration), "%s", checkpoint_configuration);
+
+  char temporary[80], name[80];
+
+  snprintf(temporary, sizeof(temporary), "./%s/checkpoint.tmp", foldername);
+  snprintf(name, sizeof(name), "./%s/checkpoint.nbc", foldername);
+
+  FILE *out = fopen(temporary, "wb");
+  int complete = (out != NULL) && fwrite(&header, sizeof(header), 1, out) == 1;
+
+  for(int i = 0; i < item_count && complete; ++i)
+  {
+    struct checkpoint_item item;
+    memset(&item, 0, sizeof(item));
+
+    strncpy(item.name, items[i].name, sizeof(item.name) - 1);
+    item.bytes = items[i].bytes;
+
+    complete = fwrite(&item, sizeof(item), 1, out) == 1 &&
+               fwrite((items[i].value != NULL) ? items[i].value : *items[i].array, 1, items[i].bytes, out) == items[i].bytes;
+  }
+
+  /* the data has to be on disk before the last checkpoint is replaced */
+  complete = complete && fflush(out) == 0 && fsync(fileno(out)) == 0;
+
+  if(out != NULL)
+  {
+    complete = (fclose(out) == 0) && complete;
+  }
+
+  /* a failed checkpoint keeps the last one, the run carries on */
+  if(!complete || rename(temporary, name) != 0)
+  {
+    fprintf(stderr, "Unable to write the checkpoint at iteration %d!\n", iteration);
+  }
+}
+
+/*
+ * Function:  checkpoint_stop
+ * ====================
+ *  returns: nonzero if the run stops after the current checkpoint because of a signal
+ * --------------------
+ */
+int checkpoint_stop()
+{
+  return stopping;
+}
+
+/*
+ * Function:  freeCheckpoints
+ * ====================
+ *  Prints how many checkpoints have been written and how a stopped run
+ *  is continued, clears the registry.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeCheckpoints()
+{
+  if(world_rank == 0 && checkpoints > 0)
+  {
+    printf("Checkpoints written: %d, last at iteration %d\n", checkpoints, last_iteration);
+  }
+
+  if(world_rank == 0 && stopping)
+  {
+    printf("Stopped by a signal, continue with --restart=./%s/checkpoint.nbc\n", foldername);
+  }
+
+  item_count = hook_count = 0;
+
+#ifdef USE_MPI
+  MPI_Comm_free(&checkpoint_comm);
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#define CHECKPOINT_MAGIC "NBODYCKP" /* first bytes of every checkpoint */
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ENDIAN 0x01020304u /* reads as 0x04030201 if the byte order is swapped */
+
+/* header at the start of every checkpoint, followed by the registered items in the
+   order of their registration. Values are stored in the byte order of the machine,
+   checkpoints are only restored on machines of the same kind */
+struct checkpoint_header
+{
+  char magic[8]; /* CHECKPOINT_MAGIC without terminating zero */
+  uint32_t version; /* CHECKPOINT_VERSION */
+  uint32_t endian; /* CHECKPOINT_ENDIAN */
+  uint32_t header_bytes; /* size of this header, the first item starts here */
+  uint32_t items; /* amount of items */
+  int64_t iteration; /* iteration of the checkpoint */
+  double time; /* time of the checkpoint */
+  uint64_t seed; /* seed of the initial conditions */
+  char folder[40]; /* folder of the run, output is continued there */
+  char configuration[512]; /* options the run has to be restarted with */
+};
+
+/* every item starts with its name and size, followed by its bytes */
+struct checkpoint_item
+{
+  char name[16]; /* name given at registration, zero padded */
+  uint64_t bytes; /* size of the item */
+};
+
+void initCheckpoints(const char *restart, int every, unsigned long seed, const char *configuration);
+
+const struct checkpoint_header *checkpoint_resumed(void);
+
+void checkpoint_value(const char *name, void *value, size_t bytes);
+
+void checkpoint_array(const char *name, void **array, size_t bytes);
+
+void checkpoint_hooks(void (*save)(void), void (*restore)(void));
+
+void restore_checkpoint(void);
+
+int checkpoint_due(int iteration);
+
+void write_checkpoint(int iteration, double time);
+
+int checkpoint_stop(void);
+
+void freeCheckpoints(void);
+
+#endif // CHECKPOINT_H_
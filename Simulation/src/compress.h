@@ -0,0 +1,32 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#define XOR_ORDER 3 /* most previous snapshots a value is predicted from */
+
+size_t xor_bound(size_t count, int width);
+
+size_t xor_encode(const void *values, const void *const *history, size_t count, int stride, int width, int order, 
+                  unsigned char *out);
+
+size_t xor_decode(const unsigned char *in, const void *const *history, size_t count, int stride, int width, int order, 
+                  void *values);
+
+size_t shuffle_bound(size_t count, int width);
+
+size_t shuffle_encode(const void *values, const void *const *history, size_t count, int stride, int width, int order, 
+                      unsigned char *out);
+
+size_t shuffle_decode(const unsigned char *in, const void *const *history, size_t count, int stride, int width, int order, 
+                      void *values);
+
+double quant_step(double bound);
+
+size_t quant_bound(size_t count, int width);
+
+size_t quant_encode(void *values, const void *const *history, size_t count, int stride, int width, int order, double bound, 
+                    unsigned char *out);
+
+size_t quant_decode(const unsigned char *in, const void *const *history, size_t count, int stride, int width, int order, 
+                    double step, void *values);
+
+#endif // COMPRESS_H_
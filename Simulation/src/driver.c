@@ -20,11 +20,28 @@
 */
 
 #include <complex.h>
+#include "engine.h"
 #include "hermite.h"
+#include "mersenne.h"
 #include "plummer.h"
 #include "output.h"
+#include "pm.h"
+#include "ks.h"
+#include "ediag.h"
+#include <getopt.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#include "mpiengine.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include "reorder.h"
+#include "workspace.h"
+#include <stdint.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "snapshot.h"
+#include "stream.h"
 #include <time.h>
 
 #define DIM   3 /* dimensions of space */
@@ -33,12 +50,43 @@
 #define G   1.0 /* gravitational constant */
 
 /* declaring function prototypes */
-void callocArrays(int N);
+void callocArrays(int N, int buffers, size_t extra, int pages, int threaded);
 void freeArrays(void);
+void printUsage(void);
 
-/* pointer to arrays holding mass, position, velocity, acceleration and jerk for all particles */
-double *mass; 
-double complex *pos, *vel, *acc, *jerk;
+/* options which may precede the positional arguments */
+static struct option long_options[] =
+{
+  {"integrator", required_argument, NULL, 'i'},
+  {"pec", required_argument, NULL, 'n'},
+  {"regularize", required_argument, NULL, 'k'},
+  {"force", required_argument, NULL, 'f'},
+  {"pm-grid", required_argument, NULL, 'g'},
+  {"huge-pages", required_argument, NULL, 'H'},
+  {"reorder", required_argument, NULL, 'r'},
+  {"curve", required_argument, NULL, 'c'},
+  {"diag-every", required_argument, NULL, 'd'},
+  {"diag-dt", required_argument, NULL, 'D'},
+  {"samples", required_argument, NULL, 's'},
+  {"exact-every", required_argument, NULL, 'x'},
+  {"output", required_argument, NULL, 'o'},
+  {"precision", required_argument, NULL, 'p'},
+  {"write-every", required_argument, NULL, 'w'},
+  {"write-dt", required_argument, NULL, 'W'},
+  {"fields", required_argument, NULL, 'F'},
+  {"compress", required_argument, NULL, 'z'},
+  {"keyframe-every", required_argument, NULL, 'K'},
+  {"max-error", required_argument, NULL, 'Q'},
+  {"csv-digits", required_argument, NULL, 'P'},
+  {"checkpoint-every", required_argument, NULL, 'C'},
+  {"restart", required_argument, NULL, 'R'},
+  {"stream", required_argument, NULL, 'S'},
+  {"stream-every", required_argument, NULL, 'E'},
+  {NULL, 0, NULL, 0}
+};
+
+/* arrays holding mass, position, velocity, acceleration and jerk for all particles */
+struct state particles;
 
 /*
  * Function:  main 
@@ -52,35 +100,369 @@ double complex *pos, *vel, *acc, *jerk;
  *  returns: zero
  * --------------------
  */
-int main(int argc, const char *argv[])
+int main(int argc, char *argv[])
 {
   clock_t start = clock();
   
+#ifdef USE_MPI
+  /* initialize MPI environment, the diagnostics thread communicates alongside the main thread */
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+#endif
+  
   int N = 0; /* amount of particles */
   unsigned long seed = 0; /* seed for Mersenne-Twister. */  
 
   double dt = 0.0; /* timestep */
   double end_time = 0.0; /* time where simulation ends */
   
+  const struct integrator *scheme = findIntegrator("hermite4"); /* provided by engine.h */
+  const struct force_engine *engine = findEngine(NULL); /* default engine, provided by engine.h */
+  int pec = 1; /* evaluation and correction passes per step */
+  double ks_radius = 0.0; /* separation below which pairs are regularized, negative selects default */
+  int pm_grid = 0; /* cells per dimension of the mesh, zero selects default */
+  int pages = WORKSPACE_PAGES_DEFAULT; /* pages backing the particle arrays, provided by workspace.h */
+  int reorder_steps = 0; /* steps between sorting the particles along a curve, zero disables reordering */
+  int curve = REORDER_HILBERT; /* space-filling curve, provided by reorder.h */
+  int diag_every = 1; /* steps between energy diagnostics */
+  double diag_dt = 0.0; /* time between energy diagnostics, zero selects diag_every */
+  int potential_samples = 0; /* sampled particles per estimate of the potential energy, zero sums exactly */
+  int potential_exact = 10; /* diagnostics between exact potential energies while sampling */
+  int format = SNAPSHOT_BINARY; /* format of the snapshots, provided by snapshot.h */
+  int precision = 8; /* bytes per value of binary snapshots */
+  int fields = snapshot_fields("pos,vel"); /* fields of every snapshot, provided by snapshot.h */
+  int encoding = SNAPSHOT_RAW; /* compression of binary snapshots */
+  int keyframes = 64; /* frames between keyframes of compressed snapshots */
+  double max_error = 0.0; /* largest error of quantized snapshots */
+  int write_every = 1; /* steps between snapshots */
+  double write_dt = 0.0; /* time between snapshots, zero selects write_every */
+  int csv_digits = 0; /* significant digits in *.csv files, zero for the shortest digits */
+  int checkpoint_every = 0; /* steps between checkpoints, zero only writes them on SIGTERM or SIGUSR1 */
+  const char *restart = NULL; /* checkpoint the run is continued from */
+  const char *stream = NULL; /* socket or named pipe frames are streamed to */
+  int stream_every = 1; /* steps between streamed frames */
+  int option;
+  
+  /* computes command line options */
+  while((option = getopt_long(argc, argv, "i:n:k:f:g:H:r:c:d:D:s:x:o:p:w:W:F:z:K:Q:P:C:R:S:E:", long_options, NULL)) != -1)
+  {
+    switch(option)
+    {
+      case 'i' : /* integrator, by name or order */
+        scheme = findIntegrator(optarg);
+        
+        if(scheme == NULL)
+        {
+          fprintf(stderr, "Unknown integrator %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'n' : /* amount of evaluation and correction passes, P(EC)^n */
+        pec = atoi(optarg);
+        
+        if(pec <= 0)
+        {
+          fprintf(stderr, "At least one evaluation and correction pass is required!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'k' : /* regularization of close pairs, either a radius or auto */
+        ks_radius = (strcmp(optarg, "auto") == 0) ? -1.0 : atof(optarg);
+        
+        if(ks_radius == 0)
+        {
+          fprintf(stderr, "Invalid regularization radius %s!\n", optarg);
+          exit(0);
+        }
+        break;
+        
+      case 'f' : /* force engine */
+        engine = findEngine(optarg);
+        
+        if(engine == NULL)
+        {
+          fprintf(stderr, "Unknown force engine %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'g' : /* cells per dimension of the mesh */
+        pm_grid = atoi(optarg);
+        
+        /* the FFT needs a power of two, the stencil needs a margin of eight cells */
+        if(pm_grid < 16 || (pm_grid & (pm_grid - 1)) != 0)
+        {
+          fprintf(stderr, "PM grid size has to be a power of two of at least 16!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'H' : /* huge pages for the particle arrays */
+        if(strcmp(optarg, "off") == 0)
+        {
+          pages = WORKSPACE_PAGES_DEFAULT;
+        }
+        else if(strcmp(optarg, "transparent") == 0)
+        {
+          pages = WORKSPACE_PAGES_TRANSPARENT;
+        }
+        else if(strcmp(optarg, "explicit") == 0)
+        {
+          pages = WORKSPACE_PAGES_EXPLICIT;
+        }
+        else
+        {
+          fprintf(stderr, "Unknown huge page mode %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'r' : /* steps between reordering the particles */
+        reorder_steps = atoi(optarg);
+        
+        if(reorder_steps <= 0)
+        {
+          fprintf(stderr, "Reordering needs a positive amount of steps!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'c' : /* space-filling curve used for reordering */
+        if(strcmp(optarg, "morton") == 0)
+        {
+          curve = REORDER_MORTON;
+        }
+        else if(strcmp(optarg, "hilbert") == 0)
+        {
+          curve = REORDER_HILBERT;
+        }
+        else
+        {
+          fprintf(stderr, "Unknown curve %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'd' : /* steps between energy diagnostics */
+        diag_every = atoi(optarg);
+        
+        if(diag_every <= 0)
+        {
+          fprintf(stderr, "Diagnostics need a positive amount of steps!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'D' : /* time between energy diagnostics */
+        diag_dt = atof(optarg);
+        
+        if(diag_dt <= 0)
+        {
+          fprintf(stderr, "Diagnostics need a positive interval!\n");
+          exit(0);
+        }
+        break;
+        
+      case 's' : /* sampled particles per estimate of the potential energy */
+        potential_samples = atoi(optarg);
+        
+        if(potential_samples < 0)
+        {
+          fprintf(stderr, "Negative amount of samples is not allowed!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'x' : /* diagnostics between exact potential energies */
+        potential_exact = atoi(optarg);
+        
+        if(potential_exact <= 0)
+        {
+          fprintf(stderr, "Exact potential energy needs a positive amount of diagnostics!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'o' : /* format of the snapshots */
+        if(strcmp(optarg, "binary") == 0)
+        {
+          format = SNAPSHOT_BINARY;
+        }
+        else if(strcmp(optarg, "csv") == 0)
+        {
+          format = SNAPSHOT_CSV;
+        }
+        else
+        {
+          fprintf(stderr, "Unknown output format %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'p' : /* precision of binary snapshots */
+        if(strcmp(optarg, "double") == 0)
+        {
+          precision = 8;
+        }
+        else if(strcmp(optarg, "single") == 0)
+        {
+          precision = 4;
+        }
+        else
+        {
+          fprintf(stderr, "Unknown precision %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'w' : /* steps between snapshots */
+        write_every = atoi(optarg);
+        
+        if(write_every <= 0)
+        {
+          fprintf(stderr, "Snapshots need a positive amount of steps!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'W' : /* time between snapshots */
+        write_dt = atof(optarg);
+        
+        if(write_dt <= 0)
+        {
+          fprintf(stderr, "Snapshots need a positive interval!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'F' : /* fields of the snapshots */
+        fields = snapshot_fields(optarg);
+        
+        if(fields == 0)
+        {
+          fprintf(stderr, "Unknown fields %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'z' : /* compression of binary snapshots */
+        if(strcmp(optarg, "none") == 0)
+        {
+          encoding = SNAPSHOT_RAW;
+        }
+        else if(strcmp(optarg, "xor") == 0)
+        {
+          encoding = SNAPSHOT_XOR;
+        }
+        else if(strcmp(optarg, "quant") == 0)
+        {
+          encoding = SNAPSHOT_QUANT;
+        }
+        else
+        {
+          fprintf(stderr, "Unknown compression %s!\n", optarg);
+          printUsage();
+          exit(0);
+        }
+        break;
+        
+      case 'K' : /* frames between keyframes */
+        keyframes = atoi(optarg);
+        
+        if(keyframes <= 0)
+        {
+          fprintf(stderr, "Keyframes need a positive amount of frames!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'Q' : /* largest error of quantized snapshots */
+        max_error = atof(optarg);
+        
+        if(!(max_error > 0))
+        {
+          fprintf(stderr, "The largest error needs to be positive!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'P' : /* significant digits in *.csv files */
+        csv_digits = atoi(optarg);
+        
+        if(csv_digits < 0 || csv_digits > 17)
+        {
+          fprintf(stderr, "Digits have to be between 0 and 17!\n");
+          exit(0);
+        }
+        
+        setDigits(csv_digits); /* provided by output.h */
+        break;
+        
+      case 'C' : /* steps between checkpoints */
+        checkpoint_every = atoi(optarg);
+        
+        if(checkpoint_every <= 0)
+        {
+          fprintf(stderr, "Checkpoints need a positive amount of steps!\n");
+          exit(0);
+        }
+        break;
+        
+      case 'R' : /* checkpoint the run is continued from */
+        restart = optarg;
+        break;
+        
+      case 'S' : /* socket or named pipe of the viewers */
+        stream = optarg;
+        break;
+        
+      case 'E' : /* steps between streamed frames */
+        stream_every = atoi(optarg);
+        
+        if(stream_every <= 0)
+        {
+          fprintf(stderr, "Streamed frames need a positive amount of steps!\n");
+          exit(0);
+        }
+        break;
+        
+      default : /* unknown option, getopt already reported it */
+        printUsage();
+        exit(0);
+    }
+  }
+  
   /* computes command line arguments */
-  switch(argc)
+  switch(argc - optind)
   {
-    case 4 : /* when no seed is specified by user */
+    case 3 : /* when no seed is specified by user */
       seed = (unsigned long) time(NULL);
-      N = atoi(argv[1]);
-      dt = atof(argv[2]);
-      end_time = atof(argv[3]);
+      N = atoi(argv[optind]);
+      dt = atof(argv[optind + 1]);
+      end_time = atof(argv[optind + 2]);
       break;
       
-    case 5 : /* when seed is specified by user */
-      seed = atol(argv[1]);
-      N = atoi(argv[2]);
-      dt = atof(argv[3]);
-      end_time = atof(argv[4]);
+    case 4 : /* when seed is specified by user */
+      seed = atol(argv[optind]);
+      N = atoi(argv[optind + 1]);
+      dt = atof(argv[optind + 2]);
+      end_time = atof(argv[optind + 3]);
       break;
 
     default : /* in case more or less arguments are passed than allowed */
       printf("Invalid input for start.c!\n");
+      printUsage();
       exit(0);
   }
   
@@ -91,17 +473,149 @@ int main(int argc, const char *argv[])
     exit(0);
   }
   
-  createNames(); /* provided by output.h */
+  /* every engine provides the derivatives up to a certain order */
+  if(engine->derivatives < scheme->derivatives)
+  {
+    fprintf(stderr, "Force engine %s does not provide the derivatives needed by %s!\n", engine->name, scheme->name);
+    exit(0);
+  }
+  
+  /* quantized snapshots are only as close as requested */
+  if(encoding == SNAPSHOT_QUANT && max_error == 0)
+  {
+    fprintf(stderr, "Quantized snapshots need --max-error!\n");
+    exit(0);
+  }
+  
+  /* the mesh does not resolve close pairs */
+  if(engine->mesh && ks_radius != 0)
+  {
+    fprintf(stderr, "Regularization is not supported by force engine %s!\n", engine->name);
+    exit(0);
+  }
+  
+  /* smallest power of two with about one particle per cell, at least 32 and at most 128 */
+  if(engine->mesh && pm_grid == 0)
+  {
+    for(pm_grid = 32; pm_grid < 128 && (double) pm_grid * pm_grid * pm_grid < N; pm_grid *= 2);
+  }
+  
+  /* close encounter distance 2Gm/v^2 in standard units */
+  if(ks_radius < 0)
+  {
+    ks_radius = 4.0 / N;
+  }
   
-  callocArrays(N);
+  if(!engine->mesh)
+  {
+    pm_grid = 0;
+  }
+  
+  /* options a run has to be continued with, the end of the run may change */
+  char configuration[512];
+  snprintf(configuration, sizeof(configuration), "N=%d dt=%a integrator=%s pec=%d force=%s grid=%d regularize=%a "
+           "reorder=%d/%d diag=%d/%a samples=%d/%d output=%d/%d/%d/%d/%d/%a write=%d/%a csv=%d stream=%s/%d", 
+           N, dt, scheme->name, pec, engine->name, pm_grid, ks_radius, reorder_steps, curve, diag_every, diag_dt, 
+           potential_samples, potential_exact, format, precision, fields, encoding, keyframes, max_error, write_every, 
+           write_dt, csv_digits, (stream != NULL) ? stream : "off", stream_every);
   
-  printLog(seed, N, M, R, G, dt, end_time); /* provided by output.h */
+  initCheckpoints(restart, checkpoint_every, seed, configuration); /* provided by checkpoint.h */
   
-  startPlummer(seed, N, DIM, mass, pos, vel, M, R); /* provided by plummer.h */
+  const struct checkpoint_header *resumed = checkpoint_resumed();
   
-  printInitialConditions(N, DIM, mass, pos, vel); /* provided by output.h */
+  if(resumed != NULL)
+  {
+    seed = resumed->seed;
+  }
   
-  startHermite(N, DIM, dt, end_time, mass, pos, vel, acc, jerk); /* provided by hermite.h */
+  /* arrays all modules take from the workspace besides the particles and the buffers of the integrator */
+  size_t extra = diagnostics_bytes(N, DIM, potential_samples) /* provided by ediag.h */
+                 + snapshot_bytes(N, DIM, format, precision, fields, encoding) /* provided by snapshot.h */
+                 + stream_bytes(stream, N, DIM); /* provided by stream.h */
+  
+  extra += (reorder_steps > 0) ? reorder_bytes(N, DIM) : 0; /* provided by reorder.h */
+  extra += (ks_radius > 0) ? ks_bytes(N) : 0; /* provided by ks.h */
+  extra += (resumed == NULL) ? plummer_bytes(N, DIM) : 0; /* provided by plummer.h */
+  extra += engine->mesh ? pm_bytes(N, pm_grid) : 0; /* provided by pm.h */
+  
+#ifdef USE_MPI
+  extra += (engine->init == initMPIEngine) ? mpi_engine_bytes() : 0; /* provided by mpiengine.h */
+#endif
+  
+  callocArrays(N, scheme->buffers, extra, pages, engine->mesh);
+  
+  /* all processes generate the same initial conditions, a continued run restores the particles instead */
+  if(resumed == NULL)
+  {
+    startPlummer(seed, N, DIM, particles.mass, particles.pos, particles.vel, M, R); /* provided by plummer.h */
+  }
+  
+  int *genrand_index;
+  checkpoint_value("genrand", genrand_state(&genrand_index), GENRAND_WORDS * sizeof(unsigned long)); /* provided by mersenne.h */
+  checkpoint_value("genrand_index", genrand_index, sizeof(int));
+  
+  if(world_rank == 0)
+  {
+    if(resumed != NULL)
+    {
+      restoreNames(resumed->folder); /* provided by output.h */
+    }
+    else
+    {
+      createNames();
+    }
+  }
+  
+#ifdef USE_MPI
+  /* all processes write their slice of the snapshots into the same folder */
+  MPI_Bcast(foldername, sizeof(foldername), MPI_CHAR, 0, MPI_COMM_WORLD);
+#endif
+  
+  initSnapshots(N, DIM, format, precision, fields, encoding, max_error, keyframes, write_every, write_dt, seed, dt); /* provided by snapshot.h */
+  
+  initStream(stream, stream_every, N, DIM); /* provided by stream.h */
+  
+  if(world_rank == 0 && resumed != NULL)
+  {
+    printRestart(resumed->iteration, resumed->time, end_time); /* provided by output.h */
+  }
+  else if(world_rank == 0)
+  {
+    printLog(seed, N, M, R, G, dt, end_time, scheme->name, pec, engine->name, pm_grid, ks_radius, workspace_pages(),
+             reorder_steps, curveName(curve), diag_every, diag_dt, potential_samples, potential_exact,
+             snapshot_format()); /* provided by output.h */
+    printInitialConditions(N, DIM, particles.mass, particles.pos, particles.vel); /* provided by output.h */
+  }
+  
+  if(engine->init != NULL)
+  {
+    engine->init(N, DIM, pm_grid);
+  }
+  
+  long allocations = startHermite(&particles, dt, end_time, scheme, engine, pec, ks_radius, 
+                                 reorder_steps, curve, diag_every, diag_dt, potential_samples, potential_exact); /* provided by hermite.h */
+  
+  if(engine->free != NULL)
+  {
+    engine->free();
+  }
+  
+  freeStream(); /* provided by stream.h */
+  
+  freeSnapshots(); /* provided by snapshot.h */
+  
+  freeCheckpoints(); /* provided by checkpoint.h */
+  
+  size_t overflow_bytes;
+  long overflow = workspace_overflow(&overflow_bytes); /* provided by workspace.h */
+  
+#ifdef USE_MPI
+  /* heap arrays of all processes */
+  unsigned long heap[2] = {overflow, overflow_bytes}, total[2];
+  MPI_Reduce(heap, total, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+  overflow = total[0];
+  overflow_bytes = total[1];
+#endif
   
   freeArrays();
   
@@ -109,35 +623,93 @@ int main(int argc, const char *argv[])
   clock_t end = clock();
   double cpu_time = ((double) (end - start)) / CLOCKS_PER_SEC;
   
-  printf("CPU time used: %f", cpu_time);
+  if(world_rank == 0)
+  {
+    printf("Workspace requests in time loop: %ld\n", allocations);
+    printf("Workspace overflow: %ld arrays, %zu bytes from the heap\n", overflow, overflow_bytes);
+    printf("CPU time used: %f", cpu_time);
+  }
+  
+#ifdef USE_MPI
+  MPI_Finalize(); /* finalize MPI environment */
+#endif
   
   return 0;
 }
 
+/*
+ * Function:  printUsage 
+ * ====================
+ *  Prints the expected command line arguments and options.
+ *
+ *  returns: void
+ * --------------------
+ */
+void printUsage()
+{
+  fprintf(stderr, "Usage: ./nbody [options] [<seed>] <amount> <timestep> <endtime>\n"
+                  "Options:\n"
+                  "  -i, --integrator=<name>  ");
+  printIntegrators(); /* provided by engine.h */
+  fprintf(stderr, " (default hermite4)\n"
+                  "  -f, --force=<name>       ");
+  printEngines(); /* provided by engine.h */
+  fprintf(stderr, " (default %s), mesh engines only provide accelerations\n"
+                  "  -n, --pec=<n>            evaluation and correction passes per step, P(EC)^n (default 1)\n"
+                  "  -k, --regularize=<r>     regularize pairs closer than r, auto uses 4/N (default off)\n"
+                  "  -g, --pm-grid=<n>        cells per dimension of the mesh, a power of two (default 32 to 128)\n"
+                  "  -H, --huge-pages=<mode>  off, transparent or explicit huge pages for all arrays (default off)\n"
+                  "  -r, --reorder=<k>        sort particles along a space-filling curve every k steps (default off)\n"
+                  "  -c, --curve=<name>       morton or hilbert (default hilbert)\n"
+                  "  -d, --diag-every=<k>     energy diagnostics every k steps (default 1)\n"
+                  "  -D, --diag-dt=<t>        energy diagnostics every t time units, overrides --diag-every\n"
+                  "  -s, --samples=<m>        estimate the potential energy from m sampled particles (default off)\n"
+                  "  -x, --exact-every=<k>    exact potential energy every k diagnostics while sampling (default 10)\n"
+                  "  -o, --output=<format>    binary or csv snapshots (default binary)\n"
+                  "  -p, --precision=<name>   double or single values in binary snapshots (default double)\n"
+                  "  -w, --write-every=<k>    snapshots every k steps (default 1)\n"
+                  "  -W, --write-dt=<t>       snapshots every t time units, overrides --write-every\n"
+                  "  -F, --fields=<list>      fields of binary snapshots out of pos, vel, acc and jerk (default pos,vel)\n"
+                  "  -z, --compress=<name>    none, xor (lossless) or quant (within --max-error) (default none)\n"
+                  "  -K, --keyframe-every=<k> keyframe every k frames of compressed snapshots (default 64)\n"
+                  "  -Q, --max-error=<e>      largest error of a value of quantized snapshots\n"
+                  "  -P, --csv-digits=<n>     significant digits of particles in csv files, 0 for shortest round-trip (default 0)\n"
+                  "  -C, --checkpoint-every=<k> checkpoint every k steps, always on SIGTERM and SIGUSR1 (default off)\n"
+                  "  -R, --restart=<file>     continue the run of a checkpoint, with the same options and arguments\n"
+                  "  -S, --stream=<path>      stream positions to viewers on a socket, or a named pipe if path is one (default off)\n"
+                  "  -E, --stream-every=<k>   streamed frame every k steps, frames are dropped for slow viewers (default 1)\n", 
+          findEngine(NULL)->name);
+}
+
 /*
  * Function:  callocArrays 
  * ====================
- *  Allocates necessary memory for all arrays declared
- *  above and also initializes each index to zero.
+ *  Allocates the workspace for all arrays of the simulation
+ *  and takes the arrays declared above from it, all of them
+ *  are initialized to zero.
  *
  *  N: amount of particles
+ *  buffers: additional arrays of N * DIM values needed by the integrator
+ *  extra: additional bytes needed by all other modules
+ *  pages: pages backing the workspace
+ *  threaded: nonzero if the force loops are statically partitioned among the threads
  *
  *  returns: void
  * --------------------
  */
-void callocArrays(int N)
+void callocArrays(int N, int buffers, size_t extra, int pages, int threaded)
 {
-  mass = calloc(N, sizeof(double));
-  pos = calloc((N * DIM), sizeof(double complex));
-  vel = calloc((N * DIM), sizeof(double complex));
-  acc = calloc((N * DIM), sizeof(double complex));
-  jerk = calloc((N * DIM), sizeof(double complex));
+  initWorkspace(workspace_bytes(N, sizeof(double))
+                + (4 + buffers) * workspace_bytes((N * DIM), sizeof(double complex)) + extra, pages, threaded); /* provided by workspace.h */
   
-  if(mass == NULL || pos == NULL || vel == NULL || acc == NULL || jerk == NULL)
-  {
-    fprintf(stderr, "Out of memory!\n");
-    exit(0);
-  }
+  particles.n = N;
+  particles.dim = DIM;
+  
+  particles.mass = workspace_alloc(N, sizeof(double));
+  particles.pos = workspace_alloc((N * DIM), sizeof(double complex));
+  particles.vel = workspace_alloc((N * DIM), sizeof(double complex));
+  particles.acc = workspace_alloc((N * DIM), sizeof(double complex));
+  particles.jerk = workspace_alloc((N * DIM), sizeof(double complex));
 }
 
 /*
@@ -150,9 +722,5 @@ void callocArrays(int N)
  */
 void freeArrays()
 {
-  free(mass);
-  free(pos);
-  free(vel);
-  free(acc);
-  free(jerk);
+  freeWorkspace();
 }
@@ -0,0 +1,513 @@
+/*
+    The following source-code provides a fast conversion of doubles into
+    the shortest decimal text which reads back as the same double, after
+    the Grisu3 algorithm of Florian Loitsch. The value and the boundaries
+    of its rounding interval are scaled by a cached power of ten into a
+    range where the digits are generated with 64 bit integer arithmetic,
+    the last digit is moved towards the value while it stays within the
+    interval. When the error of the scaling leaves the result uncertain,
+    the shortest correctly rounded digits reading back exactly are searched
+    with the C library instead. Fewer significant digits are always rounded
+    from the exact value by the C library.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dtoa.h"
+
+#define FIXED_MIN -5 /* lowest decimal exponent written without exponent */
+#define FIXED_MAX 15 /* lowest decimal exponent written with exponent */
+
+/* floating point number f * 2^e with a 64 bit significand */
+struct diy_fp
+{
+  uint64_t f;
+  int e;
+};
+
+/* 10^k for k = -348, -340, ..., 340, rounded to 64 bit significands */
+static const struct diy_fp cached_powers[87] =
+{
+  {0xfa8fd5a0081c0288ULL, -1220}, /* 1e-348 */
+  {0xbaaee17fa23ebf76ULL, -1193}, /* 1e-340 */
+  {0x8b16fb203055ac76ULL, -1166}, /* 1e-332 */
+  {0xcf42894a5dce35eaULL, -1140}, /* 1e-324 */
+  {0x9a6bb0aa55653b2dULL, -1113}, /* 1e-316 */
+  {0xe61acf033d1a45dfULL, -1087}, /* 1e-308 */
+  {0xab70fe17c79ac6caULL, -1060}, /* 1e-300 */
+  {0xff77b1fcbebcdc4fULL, -1034}, /* 1e-292 */
+  {0xbe5691ef416bd60cULL, -1007}, /* 1e-284 */
+  {0x8dd01fad907ffc3cULL, -980}, /* 1e-276 */
+  {0xd3515c2831559a83ULL, -954}, /* 1e-268 */
+  {0x9d71ac8fada6c9b5ULL, -927}, /* 1e-260 */
+  {0xea9c227723ee8bcbULL, -901}, /* 1e-252 */
+  {0xaecc49914078536dULL, -874}, /* 1e-244 */
+  {0x823c12795db6ce57ULL, -847}, /* 1e-236 */
+  {0xc21094364dfb5637ULL, -821}, /* 1e-228 */
+  {0x9096ea6f3848984fULL, -794}, /* 1e-220 */
+  {0xd77485cb25823ac7ULL, -768}, /* 1e-212 */
+  {0xa086cfcd97bf97f4ULL, -741}, /* 1e-204 */
+  {0xef340a98172aace5ULL, -715}, /* 1e-196 */
+  {0xb23867fb2a35b28eULL, -688}, /* 1e-188 */
+  {0x84c8d4dfd2c63f3bULL, -661}, /* 1e-180 */
+  {0xc5dd44271ad3cdbaULL, -635}, /* 1e-172 */
+  {0x936b9fcebb25c996ULL, -608}, /* 1e-164 */
+  {0xdbac6c247d62a584ULL, -582}, /* 1e-156 */
+  {0xa3ab66580d5fdaf6ULL, -555}, /* 1e-148 */
+  {0xf3e2f893dec3f126ULL, -529}, /* 1e-140 */
+  {0xb5b5ada8aaff80b8ULL, -502}, /* 1e-132 */
+  {0x87625f056c7c4a8bULL, -475}, /* 1e-124 */
+  {0xc9bcff6034c13053ULL, -449}, /* 1e-116 */
+  {0x964e858c91ba2655ULL, -422}, /* 1e-108 */
+  {0xdff9772470297ebdULL, -396}, /* 1e-100 */
+  {0xa6dfbd9fb8e5b88fULL, -369}, /* 1e-92 */
+  {0xf8a95fcf88747d94ULL, -343}, /* 1e-84 */
+  {0xb94470938fa89bcfULL, -316}, /* 1e-76 */
+  {0x8a08f0f8bf0f156bULL, -289}, /* 1e-68 */
+  {0xcdb02555653131b6ULL, -263}, /* 1e-60 */
+  {0x993fe2c6d07b7facULL, -236}, /* 1e-52 */
+  {0xe45c10c42a2b3b06ULL, -210}, /* 1e-44 */
+  {0xaa242499697392d3ULL, -183}, /* 1e-36 */
+  {0xfd87b5f28300ca0eULL, -157}, /* 1e-28 */
+  {0xbce5086492111aebULL, -130}, /* 1e-20 */
+  {0x8cbccc096f5088ccULL, -103}, /* 1e-12 */
+  {0xd1b71758e219652cULL, -77}, /* 1e-4 */
+  {0x9c40000000000000ULL, -50}, /* 1e4 */
+  {0xe8d4a51000000000ULL, -24}, /* 1e12 */
+  {0xad78ebc5ac620000ULL, 3}, /* 1e20 */
+  {0x813f3978f8940984ULL, 30}, /* 1e28 */
+  {0xc097ce7bc90715b3ULL, 56}, /* 1e36 */
+  {0x8f7e32ce7bea5c70ULL, 83}, /* 1e44 */
+  {0xd5d238a4abe98068ULL, 109}, /* 1e52 */
+  {0x9f4f2726179a2245ULL, 136}, /* 1e60 */
+  {0xed63a231d4c4fb27ULL, 162}, /* 1e68 */
+  {0xb0de65388cc8ada8ULL, 189}, /* 1e76 */
+  {0x83c7088e1aab65dbULL, 216}, /* 1e84 */
+  {0xc45d1df942711d9aULL, 242}, /* 1e92 */
+  {0x924d692ca61be758ULL, 269}, /* 1e100 */
+  {0xda01ee641a708deaULL, 295}, /* 1e108 */
+  {0xa26da3999aef774aULL, 322}, /* 1e116 */
+  {0xf209787bb47d6b85ULL, 348}, /* 1e124 */
+  {0xb454e4a179dd1877ULL, 375}, /* 1e132 */
+  {0x865b86925b9bc5c2ULL, 402}, /* 1e140 */
+  {0xc83553c5c8965d3dULL, 428}, /* 1e148 */
+  {0x952ab45cfa97a0b3ULL, 455}, /* 1e156 */
+  {0xde469fbd99a05fe3ULL, 481}, /* 1e164 */
+  {0xa59bc234db398c25ULL, 508}, /* 1e172 */
+  {0xf6c69a72a3989f5cULL, 534}, /* 1e180 */
+  {0xb7dcbf5354e9beceULL, 561}, /* 1e188 */
+  {0x88fcf317f22241e2ULL, 588}, /* 1e196 */
+  {0xcc20ce9bd35c78a5ULL, 614}, /* 1e204 */
+  {0x98165af37b2153dfULL, 641}, /* 1e212 */
+  {0xe2a0b5dc971f303aULL, 667}, /* 1e220 */
+  {0xa8d9d1535ce3b396ULL, 694}, /* 1e228 */
+  {0xfb9b7cd9a4a7443cULL, 720}, /* 1e236 */
+  {0xbb764c4ca7a44410ULL, 747}, /* 1e244 */
+  {0x8bab8eefb6409c1aULL, 774}, /* 1e252 */
+  {0xd01fef10a657842cULL, 800}, /* 1e260 */
+  {0x9b10a4e5e9913129ULL, 827}, /* 1e268 */
+  {0xe7109bfba19c0c9dULL, 853}, /* 1e276 */
+  {0xac2820d9623bf429ULL, 880}, /* 1e284 */
+  {0x80444b5e7aa7cf85ULL, 907}, /* 1e292 */
+  {0xbf21e44003acdd2dULL, 933}, /* 1e300 */
+  {0x8e679c2f5e44ff8fULL, 960}, /* 1e308 */
+  {0xd433179d9c8cb841ULL, 986}, /* 1e316 */
+  {0x9e19db92b4e31ba9ULL, 1013}, /* 1e324 */
+  {0xeb96bf6ebadf77d9ULL, 1039}, /* 1e332 */
+  {0xaf87023b9bf0ee6bULL, 1066}, /* 1e340 */
+};
+
+static const uint64_t powers_of_ten[20] =
+{
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+  10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 
+  1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 
+  10000000000000000000ULL
+};
+
+/*
+ * Function:  multiply
+ * ====================
+ *  x: first factor
+ *  y: second factor
+ *
+ *  returns: product, rounded to 64 bits
+ * --------------------
+ */
+static struct diy_fp multiply(struct diy_fp x, struct diy_fp y)
+{
+  unsigned __int128 product = (unsigned __int128) x.f * y.f;
+  struct diy_fp result = {(uint64_t) (product >> 64), x.e + y.e + 64};
+
+  result.f += (uint64_t) product >> 63; /* round half up */
+
+  return result;
+}
+
+/*
+ * Function:  normalize
+ * ====================
+ *  x: number with nonzero significand
+ *
+ *  returns: same number, the highest bit of the significand set
+ * --------------------
+ */
+static struct diy_fp normalize(struct diy_fp x)
+{
+  int shift = __builtin_clzll(x.f);
+
+  x.f <<= shift;
+  x.e -= shift;
+
+  return x;
+}
+
+/*
+ * Function:  round_weed
+ * ====================
+ *  Lowers the last digit while the result gets closer to the value and
+ *  checks whether the digits are certainly the shortest and closest ones.
+ *  The scaled boundaries are only known within one unit, so the result
+ *  has to hold for the narrowest and the widest possible interval.
+ *
+ *  digits: digits generated so far
+ *  length: amount of digits
+ *  distance: distance of the value to the widened upper boundary
+ *  interval: width of the widened rounding interval
+ *  rest: distance of the digits to the widened upper boundary
+ *  ten_kappa: weight of the last digit
+ *  unit: uncertainty of the scaled boundaries
+ *
+ *  returns: 1 when the digits are certain, 0 otherwise
+ * --------------------
+ */
+static int round_weed(char *digits, int length, uint64_t distance, uint64_t interval, uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+  uint64_t small_distance = distance - unit;
+  uint64_t big_distance = distance + unit;
+
+  while(rest < small_distance && interval - rest >= ten_kappa &&
+        (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance))
+  {
+    digits[length - 1]--;
+    rest += ten_kappa;
+  }
+
+  /* a further step might still be closer to the value */
+  if(rest < big_distance && interval - rest >= ten_kappa &&
+     (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance))
+  {
+    return 0;
+  }
+
+  /* the digits have to lie within the narrowest interval */
+  return 2 * unit <= rest && rest <= interval - 4 * unit;
+}
+
+/*
+ * Function:  generate_digits
+ * ====================
+ *  Generates the digits of the widened upper boundary until the remainder
+ *  fits into the widened rounding interval.
+ *
+ *  w: scaled value
+ *  lower: scaled lower boundary
+ *  upper: scaled upper boundary
+ *  digits: generated digits
+ *  exponent: decimal exponent of the scaling, adjusted to the last digit
+ *
+ *  returns: amount of digits, 0 when they are not certainly the shortest
+ * --------------------
+ */
+static int generate_digits(struct diy_fp w, struct diy_fp lower, struct diy_fp upper, char *digits, int *exponent)
+{
+  uint64_t unit = 1;
+  struct diy_fp too_low = {lower.f - unit, lower.e};
+  struct diy_fp too_high = {upper.f + unit, upper.e};
+  struct diy_fp one = {1ULL << -w.e, w.e};
+  uint64_t interval = too_high.f - too_low.f;
+  uint32_t integral = (uint32_t) (too_high.f >> -one.e);
+  uint64_t fraction = too_high.f & (one.f - 1);
+  int kappa = 1, length = 0;
+
+  while(kappa < 10 && integral >= powers_of_ten[kappa])
+  {
+    ++kappa;
+  }
+
+  /* digits of the integral part */
+  while(kappa > 0)
+  {
+    uint32_t digit = integral / (uint32_t) powers_of_ten[kappa - 1];
+    integral %= (uint32_t) powers_of_ten[kappa - 1];
+
+    digits[length++] = (char) ('0' + digit);
+    --kappa;
+
+    uint64_t rest = ((uint64_t) integral << -one.e) + fraction;
+
+    if(rest < interval)
+    {
+      *exponent += kappa;
+      return round_weed(digits, length, too_high.f - w.f, interval, rest, powers_of_ten[kappa] << -one.e, unit) ? length : 0;
+    }
+  }
+
+  /* digits of the fraction */
+  while(1)
+  {
+    fraction *= 10;
+    unit *= 10;
+    interval *= 10;
+
+    digits[length++] = (char) ('0' + (fraction >> -one.e));
+
+    fraction &= one.f - 1;
+    --kappa;
+
+    if(fraction < interval)
+    {
+      *exponent += kappa;
+      return round_weed(digits, length, (too_high.f - w.f) * unit, interval, fraction, one.f, unit) ? length : 0;
+    }
+  }
+}
+
+/*
+ * Function:  shortest_digits
+ * ====================
+ *  Finds the shortest digits reading back as a positive finite value,
+ *  unless the error of the scaling leaves them uncertain.
+ *
+ *  value: positive finite value
+ *  digits: at least 18 characters for the digits
+ *  exponent: decimal exponent of the last digit
+ *
+ *  returns: amount of digits, 0 when they are uncertain
+ * --------------------
+ */
+static int shortest_digits(double value, char *digits, int *exponent)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint64_t significand = bits & ((1ULL << 52) - 1);
+  int biased = (int) (bits >> 52) & 0x7ff;
+  struct diy_fp v = (biased != 0) ? (struct diy_fp) {significand | (1ULL << 52), biased - 1075} 
+                                  : (struct diy_fp) {significand, -1074};
+
+  /* boundaries halfway to the neighbouring doubles, the lower one is closer at powers of two */
+  struct diy_fp upper = normalize((struct diy_fp) {(v.f << 1) + 1, v.e - 1});
+  struct diy_fp lower = (v.f == (1ULL << 52) && biased > 1) ? (struct diy_fp) {(v.f << 2) - 1, v.e - 2} 
+                                                             : (struct diy_fp) {(v.f << 1) - 1, v.e - 1};
+  lower.f <<= lower.e - upper.e;
+  lower.e = upper.e;
+
+  /* cached power scaling the upper boundary to an exponent between -60 and -32 */
+  double estimate = (-61 - upper.e) * 0.30102999566398114 + 347;
+  int k = (int) estimate;
+  k += (estimate - k > 0.0);
+
+  int index = (k >> 3) + 1;
+  *exponent = -(-348 + index * 8);
+
+  struct diy_fp power = cached_powers[index];
+
+  return generate_digits(multiply(normalize(v), power), multiply(lower, power), multiply(upper, power), digits, exponent);
+}
+
+/*
+ * Function:  exact_digits
+ * ====================
+ *  Rounds a positive finite value from its exact binary value to a number
+ *  of significant digits, ties to even. When the digits have to read back
+ *  exactly, the next digits upwards are tried as well, since the rounding
+ *  interval reaches further up than down at powers of two.
+ *
+ *  value: positive finite value
+ *  precision: significant digits, from 1 to 17
+ *  digits: at least 18 characters for the digits
+ *  exponent: decimal exponent of the last digit
+ *  exact: whether the digits have to read back as the same double
+ *
+ *  returns: amount of digits, 0 when exact is set and they don't read back
+ * --------------------
+ */
+static int exact_digits(double value, int precision, char *digits, int *exponent, int exact)
+{
+  char text[48];
+  int carry = 1;
+
+  snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+
+  digits[0] = text[0];
+  memcpy(digits + 1, text + 2, precision - 1);
+  *exponent = (int) strtol(strchr(text, 'e') + 1, NULL, 10) - (precision - 1);
+
+  if(!exact || strtod(text, NULL) == value)
+  {
+    return precision;
+  }
+
+  for(int d = precision - 1; d >= 0 && carry; --d)
+  {
+    carry = (digits[d] == '9');
+    digits[d] = carry ? '0' : digits[d] + 1;
+  }
+
+  if(carry)
+  {
+    digits[0] = '1';
+    ++*exponent;
+  }
+
+  snprintf(text, sizeof(text), "%.*se%d", precision, digits, *exponent);
+
+  return (strtod(text, NULL) == value) ? precision : 0;
+}
+
+/*
+ * Function:  format_double
+ * ====================
+ *  Writes a double as decimal text, with the shortest digits reading back
+ *  as the same double or rounded to fewer significant digits. Values with 
+ *  a decimal exponent from FIXED_MIN to FIXED_MAX - 1 are written without
+ *  exponent, the others like 1.5e-07.
+ *
+ *  value: value to be written
+ *  digits: most significant digits, zero or 17 and more for the shortest digits
+ *  out: at least DTOA_MAX characters, not terminated
+ *
+ *  returns: amount of characters written
+ * --------------------
+ */
+int format_double(double value, int digits, char *out)
+{
+  char *start = out;
+  char buffer[20];
+  int exponent, length;
+
+  if(value != value)
+  {
+    memcpy(out, "nan", 3);
+    return 3;
+  }
+
+  if(signbit(value))
+  {
+    *out++ = '-';
+    value = -value;
+  }
+
+  if(value == 0.0)
+  {
+    *out++ = '0';
+    return (int) (out - start);
+  }
+
+  if(value > 1.7976931348623157e308)
+  {
+    memcpy(out, "inf", 3);
+    return (int) (out - start) + 3;
+  }
+
+  length = (digits > 0 && digits < 17) ? exact_digits(value, digits, buffer, &exponent, 0)
+                                       : shortest_digits(value, buffer, &exponent);
+
+  /* uncertain for about one random double in two hundred, search the shortest digits which read back */
+  for(int precision = 1; length == 0; ++precision)
+  {
+    length = exact_digits(value, precision, buffer, &exponent, 1);
+  }
+
+  /* trailing zeros only move the exponent */
+  while(length > 1 && buffer[length - 1] == '0')
+  {
+    --length;
+    ++exponent;
+  }
+
+  int leading = length + exponent - 1; /* decimal exponent of the first digit */
+
+  if(leading >= FIXED_MIN && leading < FIXED_MAX)
+  {
+    if(leading < 0)
+    {
+      /* 0.000ddd */
+      *out++ = '0';
+      *out++ = '.';
+
+      for(int z = 0; z < -leading - 1; ++z)
+      {
+        *out++ = '0';
+      }
+
+      memcpy(out, buffer, length);
+      out += length;
+    }
+    else if(exponent >= 0)
+    {
+      /* ddd000 */
+      memcpy(out, buffer, length);
+      out += length;
+
+      for(int z = 0; z < exponent; ++z)
+      {
+        *out++ = '0';
+      }
+    }
+    else
+    {
+      /* ddd.ddd */
+      memcpy(out, buffer, leading + 1);
+      out += leading + 1;
+      *out++ = '.';
+      memcpy(out, buffer + leading + 1, length - leading - 1);
+      out += length - leading - 1;
+    }
+
+    return (int) (out - start);
+  }
+
+  /* d.ddde-07 */
+  *out++ = buffer[0];
+
+  if(length > 1)
+  {
+    *out++ = '.';
+    memcpy(out, buffer + 1, length - 1);
+    out += length - 1;
+  }
+
+  *out++ = 'e';
+  *out++ = (leading < 0) ? '-' : '+';
+  leading = (leading < 0) ? -leading : leading;
+
+  if(leading >= 100)
+  {
+    *out++ = (char) ('0' + leading / 100);
+  }
+
+  *out++ = (char) ('0' + leading / 10 % 10);
+  *out++ = (char) ('0' + leading % 10);
+
+  return (int) (out - start);
+}
@@ -0,0 +1,8 @@
+#ifndef DTOA_H_
+#define DTOA_H_
+
+#define DTOA_MAX 32 /* most characters written by format_double */
+
+int format_double(double value, int digits, char *out);
+
+#endif // DTOA_H_
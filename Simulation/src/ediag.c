@@ -1,7 +1,17 @@
 /*    
     The following source code provides methods for energy diagnostics by
     providing functions to calculate kinetic, potential and total energy
-    of the cluster.
+    of the cluster. Diagnostics are calculated by a background thread on a
+    snapshot of the particles, so the integration carries on meanwhile.
+    The pairs of the potential energy are split into tiles, which are
+    distributed over all processes and threads. Partial sums of fixed
+    blocks are combined with MPI_Reduce on a communicator of their own
+    and summed in a fixed order, so the results do not depend on the 
+    amount of processes and threads. For large clusters the potential 
+    energy can be estimated from a stratified sample of particles with
+    a confidence interval, the exact sum then only follows every few
+    diagnostics. Each sampled particle is summed over all others, so the
+    estimate costs m*N instead of N^2/2 pair evaluations.
     
     Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
     
@@ -20,22 +30,228 @@
 */
 
 #include <complex.h>
+#include "cdiag.h"
 #include "ediag.h"
+#include "engine.h"
 #include <math.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 #include "output.h"
+#include <pthread.h>
+#include "reduce.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include "checkpoint.h"
+#include "workspace.h"
+
+#define TILE 64 /* particles per tile of the potential energy */
+#define STRATUM 8 /* sampled particles per stratum of the estimated potential energy */
+#define CONFIDENCE 1.96 /* half width of the 95% confidence interval in standard deviations */
 
 /* kinetic, potential and total energy of the cluster */
 double e_kinetic, e_potential, e_total;
 
+/* snapshot handed to the background thread, coordinates are stored 
+   dimension by dimension so the pair loops are contiguous */
+static int snapshot_N, snapshot_DIM, snapshot_iteration;
+static double snapshot_time;
+static double *snapshot_mass, *snapshot_pos, *snapshot_vel;
+static double *partials; /* partial sums of the kinetic energy by block, then potential energy by row of tiles or stratum */
+static double *sampled; /* potential energy of every sampled particle */
+
+static int samples = 0; /* sampled particles per estimate, zero always calculates the exact sum */
+static int exact_every = 1; /* diagnostics between exact sums while sampling */
+static int evaluations = 0; /* diagnostics evaluated so far */
+static long diag_files[2]; /* size of the energy and cluster diagnostics files at the last checkpoint */
+
+static pthread_t worker;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static int pending = 0; /* snapshot waiting to be evaluated */
+static int finished = 0; /* no more snapshots will follow */
+static int threaded = 1; /* zero if MPI does not allow a communicating background thread */
+
+#ifdef USE_MPI
+static MPI_Comm diag_comm; /* keeps the reductions apart from the force engines */
+#endif
+
 /*
- * Function:  kinetic_energy 
+ * Function:  diagnostics_worker 
  * ====================
- *  Entry point for energy diagnostics, calls all other functions,
- *  calulates total energy and calls printEnergyDiagnostic.
+ *  Background thread, evaluates every snapshot handed over by
+ *  submit_diagnostics until freeDiagnostics is called.
+ *
+ *  arg: unused
+ *
+ *  returns: NULL
+ * --------------------
+ */
+static void *diagnostics_worker(void *arg)
+{
+  (void) arg;
+  
+  pthread_mutex_lock(&lock);
+  
+  while(1)
+  {
+    while(!pending && !finished)
+    {
+      pthread_cond_wait(&changed, &lock);
+    }
+    
+    /* a pending snapshot is evaluated before finishing */
+    if(!pending)
+    {
+      break;
+    }
+    
+    pthread_mutex_unlock(&lock);
+    
+    energy_diagnostics(snapshot_iteration, snapshot_time, snapshot_N, snapshot_DIM, 
+                       snapshot_mass, snapshot_pos, snapshot_vel);
+    
+    pthread_mutex_lock(&lock);
+    pending = 0;
+    pthread_cond_broadcast(&changed);
+  }
+  
+  pthread_mutex_unlock(&lock);
+  
+  return NULL;
+}
+
+/*
+ * Function:  save_diagnostics 
+ * ====================
+ *  Checkpoint hook, waits for the pending snapshot and records the
+ *  size of the diagnostics files.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void save_diagnostics()
+{
+  pthread_mutex_lock(&lock);
+  
+  while(pending)
+  {
+    pthread_cond_wait(&changed, &lock);
+  }
+  
+  pthread_mutex_unlock(&lock);
+  
+  if(world_rank == 0)
+  {
+    syncDiagnostics(&diag_files[0], &diag_files[1]); /* provided by output.h */
+  }
+}
+
+/*
+ * Function:  resume_diagnostics 
+ * ====================
+ *  Checkpoint hook, continues the diagnostics files at the size
+ *  they had at the checkpoint.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void resume_diagnostics()
+{
+  if(world_rank == 0)
+  {
+    resumeDiagnostics(diag_files[0], diag_files[1]); /* provided by output.h */
+  }
+}
+
+/*
+ * Function:  diagnostics_bytes
+ * ====================
+ *  N: amout of particles
+ *  DIM: dimensions of space
+ *  potential_samples: sampled particles per estimate of the potential energy, zero disables sampling
+ *
+ *  returns: size of all arrays initDiagnostics takes from the workspace, 
+ *           including those of the cluster diagnostics
+ * --------------------
+ */
+size_t diagnostics_bytes(int N, int DIM, int potential_samples)
+{
+  int used = (potential_samples < N) ? potential_samples : 0;
+  int strata = (used + STRATUM - 1) / STRATUM;
+  
+  return workspace_bytes(N, sizeof(double)) + 2 * workspace_bytes((N * DIM), sizeof(double)) /* provided by workspace.h */
+         + workspace_bytes(reduce_blocks(N) + (N + TILE - 1) / TILE + 2 * strata, sizeof(double))
+         + ((used > 0) ? workspace_bytes(used, sizeof(double)) : 0) + cluster_bytes(N); /* provided by cdiag.h */
+}
+
+/*
+ * Function:  initDiagnostics 
+ * ====================
+ *  Takes the snapshot from the workspace and starts the background
+ *  thread on every process. Diagnostics are evaluated synchronously 
+ *  if MPI does not support calls from multiple threads. Sampling is
+ *  disabled if it would not take fewer particles than the exact sum.
+ *  The state kept between diagnostics is registered for checkpoints.
  *
  *  N: amout of particles
  *  DIM: dimensions of space
+ *  potential_samples: sampled particles per estimate of the potential energy, zero disables sampling
+ *  potential_exact: diagnostics between exact potential energies while sampling
+ *
+ *  returns: void
+ * --------------------
+ */
+void initDiagnostics(int N, int DIM, int potential_samples, int potential_exact)
+{
+  samples = (potential_samples < N) ? potential_samples : 0;
+  exact_every = potential_exact;
+  evaluations = 0;
+  
+  int strata = (samples + STRATUM - 1) / STRATUM;
+  
+  snapshot_mass = workspace_alloc(N, sizeof(double)); /* provided by workspace.h */
+  snapshot_pos = workspace_alloc((N * DIM), sizeof(double));
+  snapshot_vel = workspace_alloc((N * DIM), sizeof(double));
+  partials = workspace_alloc(reduce_blocks(N) + (N + TILE - 1) / TILE + 2 * strata, sizeof(double)); /* provided by reduce.h */
+  sampled = (samples > 0) ? workspace_alloc(samples, sizeof(double)) : NULL;
+  
+  initClusterDiagnostics(N); /* provided by cdiag.h */
+  
+  pending = finished = 0;
+  threaded = 1;
+  
+#ifdef USE_MPI
+  int provided;
+  MPI_Query_thread(&provided);
+  threaded = (provided == MPI_THREAD_MULTIPLE);
+  
+  MPI_Comm_dup(MPI_COMM_WORLD, &diag_comm);
+#endif
+  
+  if(threaded && pthread_create(&worker, NULL, diagnostics_worker, NULL) != 0)
+  {
+    fprintf(stderr, "Unable to start diagnostics thread!\n");
+    exit(0);
+  }
+  
+  checkpoint_value("evaluations", &evaluations, sizeof(evaluations)); /* provided by checkpoint.h */
+  checkpoint_value("diag_files", diag_files, sizeof(diag_files));
+  checkpoint_hooks(save_diagnostics, resume_diagnostics);
+}
+
+/*
+ * Function:  submit_diagnostics 
+ * ====================
+ *  Copies the particles into the snapshot and hands it to the background
+ *  thread, waits only while the previous snapshot is still evaluated.
+ *  Has to be called by all processes.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  N: amout of particles
+ *  DIM: dimensions of space
  *  mass: masses of all particles
  *  pos: positions of all particles
  *  vel: velocities of all particles
@@ -43,68 +259,436 @@ double e_kinetic, e_potential, e_total;
  *  returns: void
  * --------------------
  */
-void energy_diagnostics(int N, int DIM, double *mass, double complex *pos, double complex *vel)
+void submit_diagnostics(int iteration, double time, int N, int DIM, double *mass, double complex *pos, double complex *vel)
 {
-  kinetic_energy(N, DIM, mass, vel);
+  pthread_mutex_lock(&lock);
   
-  potential_energy(N, DIM, mass, pos);
+  while(pending)
+  {
+    pthread_cond_wait(&changed, &lock);
+  }
+  
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
+  {
+    snapshot_mass[mi] = mass[mi];
+    
+    for(int k = 0; k < DIM; ++k)
+    {
+      snapshot_pos[k * N + mi] = creal(pos[mi * DIM + k]);
+      snapshot_vel[k * N + mi] = creal(vel[mi * DIM + k]);
+    }
+  }
   
-  e_total = e_kinetic + e_potential;
+  snapshot_N = N;
+  snapshot_DIM = DIM;
+  snapshot_iteration = iteration;
+  snapshot_time = time;
   
-  printEnergyDiagnostics(e_kinetic, e_potential, e_total); /* provided by output.h */
+  if(threaded)
+  {
+    pending = 1;
+    pthread_cond_broadcast(&changed);
+  }
+  
+  pthread_mutex_unlock(&lock);
+  
+  if(!threaded)
+  {
+    energy_diagnostics(iteration, time, N, DIM, snapshot_mass, snapshot_pos, snapshot_vel);
+  }
+}
+
+/*
+ * Function:  freeDiagnostics 
+ * ====================
+ *  Waits for the last snapshot, stops the background thread and 
+ *  closes the energy and cluster diagnostics files.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeDiagnostics()
+{
+  if(threaded)
+  {
+    pthread_mutex_lock(&lock);
+    finished = 1;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    
+    pthread_join(worker, NULL);
+  }
+  
+#ifdef USE_MPI
+  MPI_Comm_free(&diag_comm);
+#endif
+  
+  workspace_free(snapshot_mass);
+  workspace_free(snapshot_pos);
+  workspace_free(snapshot_vel);
+  workspace_free(partials);
+  
+  if(sampled != NULL)
+  {
+    workspace_free(sampled);
+    sampled = NULL;
+  }
+  
+  freeClusterDiagnostics(); /* provided by cdiag.h */
+  
+  if(world_rank == 0)
+  {
+    closeEnergyDiagnostics(); /* provided by output.h */
+    closeClusterDiagnostics();
+  }
+}
+
+/*
+ * Function:  energy_diagnostics 
+ * ====================
+ *  Entry point for energy diagnostics, calls all other functions,
+ *  calulates total energy and calls printEnergyDiagnostic. Every
+ *  process calculates its partial sums, the root process combines
+ *  them and prints the result. While sampling, the potential energy
+ *  is estimated except for every exact_every-th diagnostics, starting
+ *  with the first. Cluster diagnostics follow on the same snapshot.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  N: amout of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  vel: velocities of all particles, dimension by dimension
+ *
+ *  returns: void
+ * --------------------
+ */
+void energy_diagnostics(int iteration, double time, int N, int DIM, const double *mass, const double *pos, const double *vel)
+{
+  int blocks = reduce_blocks(N); /* provided by reduce.h */
+  int tiles = (N + TILE - 1) / TILE;
+  int strata = (samples + STRATUM - 1) / STRATUM;
+  int exact = (samples == 0 || evaluations++ % exact_every == 0);
+  
+  kinetic_energy(N, DIM, mass, vel, partials);
+  
+  if(exact)
+  {
+    potential_energy(N, DIM, mass, pos, partials + blocks);
+  }
+  else
+  {
+    sampled_potential_energy(N, DIM, mass, pos, iteration, partials + blocks, partials + blocks + strata);
+  }
+  
+#ifdef USE_MPI
+  int count = blocks + (exact ? tiles : 2 * strata); /* partial sums to combine */
+  MPI_Reduce((world_rank == 0) ? MPI_IN_PLACE : partials, partials, count, MPI_DOUBLE, MPI_SUM, 0, diag_comm);
+#endif
+  
+  if(world_rank == 0)
+  {
+    double error = 0.0; /* half width of the confidence interval of the potential energy */
+    
+    e_kinetic = reduce_tree(partials, blocks); /* provided by reduce.h */
+    
+    if(exact)
+    {
+      e_potential = reduce_tree(partials + blocks, tiles);
+    }
+    else
+    {
+      e_potential = reduce_tree(partials + blocks, strata);
+      error = CONFIDENCE * sqrt(reduce_tree(partials + blocks + strata, strata));
+    }
+    
+    e_total = e_kinetic + e_potential;
+    
+    printEnergyDiagnostics(iteration, time, e_kinetic, e_potential, e_total, 
+                           exact ? "exact" : "sampled", error); /* provided by output.h */
+  }
+  
+  cluster_diagnostics(iteration, time, N, DIM, mass, pos, vel, e_kinetic, e_potential); /* provided by cdiag.h */
 }
 
 /*
  * Function:  kinetic_energy 
  * ====================
- *  Calculates kinetic energy of the cluster.
+ *  Calculates the kinetic energy of every block of particles, blocks
+ *  are split evenly between the processes. Blocks of other processes
+ *  are set to zero.
  *
  *  N: amout of particles
  *  DIM: dimensions of space
  *  mass: masses of all particles
- *  vel: velocities of all particles
+ *  vel: velocities of all particles, dimension by dimension
+ *  energy: kinetic energy of every block
  *
  *  returns: void
  * --------------------
  */
-void kinetic_energy(int N, int DIM, double *mass, double complex *vel)
+void kinetic_energy(int N, int DIM, const double *mass, const double *vel, double *energy)
 {
-  for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
+  int blocks = reduce_blocks(N);
+  int first = (int) ((long) blocks * world_rank / world_size);
+  int last = (int) ((long) blocks * (world_rank + 1) / world_size);
+  
+  #pragma omp parallel for
+  for(int b = 0; b < blocks; ++b)
   {
-    for(int j = 0; j < DIM; ++j)
+    double sum = 0.0;
+    
+    if(b >= first && b < last)
     {
-      e_kinetic += 0.5 * mass[mi] * vel[i + j] * vel[i + j];
+      int end = (b + 1) * REDUCE_BLOCK < N ? (b + 1) * REDUCE_BLOCK : N;
+      
+      for(int mi = b * REDUCE_BLOCK; mi < end; ++mi)
+      {
+        double v2 = 0.0;
+        
+        for(int k = 0; k < DIM; ++k)
+        {
+          v2 += vel[k * N + mi] * vel[k * N + mi];
+        }
+        
+        sum += 0.5 * mass[mi] * v2;
+      }
+    }
+    
+    energy[b] = sum;
+  }
+}
+
+/*
+ * Function:  potential_tile 
+ * ====================
+ *  Calculates the potential energy of all pairs between two tiles,
+ *  within a single tile every pair is only counted once.
+ *
+ *  N: amout of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  ti: first tile
+ *  tj: second tile, not smaller than ti
+ *
+ *  returns: potential energy of the pairs
+ * --------------------
+ */
+static double potential_tile(int N, int DIM, const double *mass, const double *pos, int ti, int tj)
+{
+  int i_end = (ti + 1) * TILE < N ? (ti + 1) * TILE : N;
+  int j_end = (tj + 1) * TILE < N ? (tj + 1) * TILE : N;
+  double energy = 0.0;
+  
+  for(int mi = ti * TILE; mi < i_end; ++mi)
+  {
+    int j_begin = (ti == tj) ? mi + 1 : tj * TILE;
+    double sum = 0.0; /* sum of mj / rij */
+    
+    #pragma omp simd reduction(+:sum)
+    for(int mj = j_begin; mj < j_end; ++mj)
+    {
+      double r2 = 0.0;
+      
+      for(int k = 0; k < DIM; ++k)
+      {
+        double d = pos[k * N + mj] - pos[k * N + mi];
+        r2 += d * d;
+      }
+      
+      sum += mass[mj] / sqrt(r2);
     }
+    
+    energy -= mass[mi] * sum;
   }
+  
+  return energy;
 }
 
 /*
  * Function:  potential_energy 
  * ====================
- *  Calculates potential energy of the cluster.
+ *  Calculates the potential energy of the pairs in every row of tiles.
+ *  Rows are dealt to the processes back and forth, which balances the
+ *  shrinking rows, and to the threads dynamically. Rows of other 
+ *  processes are set to zero.
  *
  *  N: amout of particles
  *  DIM: dimensions of space
  *  mass: masses of all particles
- *  pos: positions of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  energy: potential energy of every row of tiles
  *
  *  returns: void
  * --------------------
  */
-void potential_energy(int N, int DIM, double *mass, double complex *pos)
+void potential_energy(int N, int DIM, const double *mass, const double *pos, double *energy)
 {
-  for (int i = 0, mi = 0; i < (N * DIM) ; i += DIM, ++mi)
+  int tiles = (N + TILE - 1) / TILE;
+  
+  #pragma omp parallel for schedule(dynamic, 1)
+  for(int ti = 0; ti < tiles; ++ti)
   {
-    for (int j = i + DIM, mj = 0; j < (N * DIM) ; j += DIM, ++mj)
+    int turn = ti % (2 * world_size);
+    int owner = (turn < world_size) ? turn : 2 * world_size - 1 - turn;
+    double sum = 0.0;
+    
+    if(owner == world_rank)
     {
-      double complex rij2 = 0;
+      for(int tj = ti; tj < tiles; ++tj)
+      {
+        sum += potential_tile(N, DIM, mass, pos, ti, tj);
+      }
+    }
     
-      for (int k = 0; k < DIM ; ++k)
+    energy[ti] = sum;
+  }
+}
+
+/*
+ * Function:  sample_index 
+ * ====================
+ *  Hashes iteration and number of a sample into a particle of the
+ *  stratum (SplitMix64), so every process and thread draws the same 
+ *  particles regardless of how the samples are distributed.
+ *
+ *  iteration: current iteration
+ *  k: number of the sample
+ *  first: first particle of the stratum
+ *  size: amount of particles in the stratum
+ *
+ *  returns: index of the sampled particle
+ * --------------------
+ */
+static int sample_index(int iteration, int k, int first, int size)
+{
+  uint64_t z = ((uint64_t) iteration << 32 | (uint32_t) k) + 0x9E3779B97F4A7C15ULL;
+  
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  
+  return first + (int) (z % (uint64_t) size);
+}
+
+/*
+ * Function:  particle_potential 
+ * ====================
+ *  Calculates the potential energy of one particle with all others.
+ *
+ *  N: amout of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  mi: the particle
+ *
+ *  returns: potential energy of the particle
+ * --------------------
+ */
+static double particle_potential(int N, int DIM, const double *mass, const double *pos, int mi)
+{
+  double sum = 0.0; /* sum of mj / rij */
+  
+  /* the particle itself is left out by splitting the range */
+  for(int part = 0; part < 2; ++part)
+  {
+    int j_begin = (part == 0) ? 0 : mi + 1;
+    int j_end = (part == 0) ? mi : N;
+    
+    #pragma omp simd reduction(+:sum)
+    for(int mj = j_begin; mj < j_end; ++mj)
+    {
+      double r2 = 0.0;
+      
+      for(int k = 0; k < DIM; ++k)
+      {
+        double d = pos[k * N + mj] - pos[k * N + mi];
+        r2 += d * d;
+      }
+      
+      sum += mass[mj] / sqrt(r2);
+    }
+  }
+  
+  return -mass[mi] * sum;
+}
+
+/*
+ * Function:  sampled_potential_energy 
+ * ====================
+ *  Estimates the potential energy from the particles drawn by 
+ *  sample_index, the potential energy of a sampled particle is summed 
+ *  over all others. The particles are split into strata of equal size
+ *  with STRATUM samples each, the estimate of every stratum is its size
+ *  times the mean of its samples, halved since every pair is counted
+ *  twice. Strata are split evenly between the processes, strata of 
+ *  other processes are set to zero.
+ *
+ *  N: amout of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles, dimension by dimension
+ *  iteration: current iteration, selects the samples
+ *  energy: estimated potential energy of every stratum
+ *  variance: variance of the estimate of every stratum
+ *
+ *  returns: void
+ * --------------------
+ */
+void sampled_potential_energy(int N, int DIM, const double *mass, const double *pos, int iteration, 
+                              double *energy, double *variance)
+{
+  int strata = (samples + STRATUM - 1) / STRATUM;
+  int first = (int) ((long) strata * world_rank / world_size);
+  int last = (int) ((long) strata * (world_rank + 1) / world_size);
+  int k_last = (last * STRATUM < samples) ? last * STRATUM : samples;
+  
+  /* samples of the own strata, each one sums over all particles */
+  #pragma omp parallel for schedule(static)
+  for(int k = first * STRATUM; k < k_last; ++k)
+  {
+    int stratum = k / STRATUM;
+    int begin = (int) ((long) N * stratum / strata);
+    int end = (int) ((long) N * (stratum + 1) / strata);
+    
+    sampled[k] = particle_potential(N, DIM, mass, pos, sample_index(iteration, k, begin, end - begin));
+  }
+  
+  #pragma omp parallel for
+  for(int stratum = 0; stratum < strata; ++stratum)
+  {
+    energy[stratum] = variance[stratum] = 0.0;
+    
+    if(stratum >= first && stratum < last)
+    {
+      int k_begin = stratum * STRATUM;
+      int k_end = (k_begin + STRATUM < samples) ? k_begin + STRATUM : samples;
+      int n = k_end - k_begin;
+      double size = (double) ((long) N * (stratum + 1) / strata - (long) N * stratum / strata);
+      double mean = 0.0, deviation = 0.0;
+      
+      for(int k = k_begin; k < k_end; ++k)
+      {
+        mean += sampled[k];
+      }
+      
+      mean /= n;
+      
+      for(int k = k_begin; k < k_end; ++k)
       {
-        rij2 += (pos[j + k] - pos[i + k]) * (pos[j + k] - pos[i + k]);
+        deviation += (sampled[k] - mean) * (sampled[k] - mean);
       }
       
-      e_potential -= mass[mi] * mass[mj] / sqrt(rij2);
+      energy[stratum] = 0.5 * size * mean;
+      
+      /* variance of the mean of the samples, a single sample gives no estimate */
+      if(n > 1)
+      {
+        variance[stratum] = 0.25 * size * size * deviation / ((double) (n - 1) * n);
+      }
     }
   }
 }
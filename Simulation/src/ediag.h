@@ -1,10 +1,23 @@
 #ifndef EDIAG_H_
 #define EDIAG_H_
 
-void kinetic_energy(int N, int DIM, double *mass, double complex *vel);
+#include <stddef.h>
 
-void potential_energy(int N, int DIM, double *mass, double complex *pos);
+void kinetic_energy(int N, int DIM, const double *mass, const double *vel, double *energy);
 
-void energy_diagnostics(int N, int DIM, double *mass, double complex *pos, double complex *vel);
+void potential_energy(int N, int DIM, const double *mass, const double *pos, double *energy);
+
+void sampled_potential_energy(int N, int DIM, const double *mass, const double *pos, int iteration, 
+                              double *energy, double *variance);
+
+void energy_diagnostics(int iteration, double time, int N, int DIM, const double *mass, const double *pos, const double *vel);
+
+size_t diagnostics_bytes(int N, int DIM, int potential_samples);
+
+void initDiagnostics(int N, int DIM, int potential_samples, int potential_exact);
+
+void submit_diagnostics(int iteration, double time, int N, int DIM, double *mass, double complex *pos, double complex *vel);
+
+void freeDiagnostics(void);
 
 #endif // EDIAG_H_
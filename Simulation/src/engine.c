@@ -0,0 +1,130 @@
+/*
+    The following source-code provides the registry of force engines and
+    integrators, both are selected by name at runtime. New backends are
+    added by appending an entry to the respective table.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#include "hermite.h"
+#include "hermite68.h"
+#include "leapfrog.h"
+#include "mpiengine.h"
+#include "pm.h"
+#include <stdio.h>
+#include <string.h>
+
+int world_rank = 0, world_size = 1;
+
+/* available force engines, the first one is the default */
+static const struct force_engine engines[] =
+{
+#ifdef USE_MPI
+  {"mpi", 2, 0, initMPIEngine, acc_mpi, acc_jerk_mpi, NULL, NULL, freeMPIEngine},
+#endif
+  {"direct", 4, 0, NULL, acc_only, acc_jerk, acc_jerk_snap, acc_jerk_snap_crackle, NULL},
+  {"pm", 1, 1, initPM, acc_pm, NULL, NULL, NULL, freePM},
+  {"p3m", 1, 1, initP3M, acc_p3m, NULL, NULL, NULL, freePM}
+};
+
+/* available integrators, the default is selected in driver.c */
+static const struct integrator integrators[] =
+{
+  {"leapfrog", "2", 2, 1, 0, NULL, NULL, leapfrog, NULL},
+  {"hermite4", "4", 4, 2, 4, initHermite, NULL, hermite, NULL},
+  {"hermite6", "6", 6, 3, 12, initHermite68, refreshHermite6, hermite6, reorderHermite68},
+  {"hermite8", "8", 8, 4, 12, initHermite68, refreshHermite8, hermite8, reorderHermite68}
+};
+
+/*
+ * Function:  findEngine
+ * ====================
+ *  Looks up a force engine by name.
+ *
+ *  name: name of the engine, NULL selects the default
+ *
+ *  returns: engine or NULL if there is no such engine
+ * --------------------
+ */
+const struct force_engine *findEngine(const char *name)
+{
+  for(size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e)
+  {
+    if(name == NULL || strcmp(name, engines[e].name) == 0)
+    {
+      return &engines[e];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Function:  findIntegrator
+ * ====================
+ *  Looks up an integrator by name or alias.
+ *
+ *  name: name or alias of the integrator
+ *
+ *  returns: integrator or NULL if there is no such integrator
+ * --------------------
+ */
+const struct integrator *findIntegrator(const char *name)
+{
+  for(size_t s = 0; s < sizeof(integrators) / sizeof(integrators[0]); ++s)
+  {
+    if(strcmp(name, integrators[s].name) == 0 || strcmp(name, integrators[s].alias) == 0)
+    {
+      return &integrators[s];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Function:  printEngines
+ * ====================
+ *  Prints the names of all force engines to stderr, separated by commas.
+ *
+ *  returns: void
+ * --------------------
+ */
+void printEngines()
+{
+  for(size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e)
+  {
+    fprintf(stderr, (e > 0) ? ", %s" : "%s", engines[e].name);
+  }
+}
+
+/*
+ * Function:  printIntegrators
+ * ====================
+ *  Prints the names of all integrators to stderr, separated by commas.
+ *
+ *  returns: void
+ * --------------------
+ */
+void printIntegrators()
+{
+  for(size_t s = 0; s < sizeof(integrators) / sizeof(integrators[0]); ++s)
+  {
+    fprintf(stderr, (s > 0) ? ", %s" : "%s", integrators[s].name);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+/* rank of process and amount of processes, 0 and 1 without MPI */
+extern int world_rank, world_size;
+
+/* particles and their values at the start of the last step, 
+   buffers are exchanged by swapping pointers instead of copying */
+struct state
+{
+  int n; /* amount of particles */
+  int dim; /* dimensions of space */
+  double *mass;
+  double complex *pos, *vel, *acc, *jerk;
+  double complex *old_pos, *old_vel, *old_acc, *old_jerk; /* NULL if not needed by the integrator */
+};
+
+/* force backend, derivatives it cannot provide are NULL */
+struct force_engine
+{
+  const char *name; /* selected with --force */
+  int derivatives; /* highest derivative provided, 1 acceleration, 2 jerk, 3 snap, 4 crackle */
+  int mesh; /* nonzero if the engine uses the mesh, which does not resolve regularized pairs */
+
+  void (*init)(int N, int DIM, int grid);
+
+  void (*acc)(int N, int DIM, double *mass, double complex *pos, double complex *acc);
+
+  void (*acc_jerk)(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                   double complex *acc, double complex *jerk);
+
+  void (*acc_jerk_snap)(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                        double complex *pred_acc, double complex *acc, double complex *jerk, double complex *snap);
+
+  void (*acc_jerk_snap_crackle)(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                                double complex *pred_acc, double complex *pred_jerk, double complex *acc,
+                                double complex *jerk, double complex *snap, double complex *crackle);
+
+  void (*free)(void);
+};
+
+/* integration scheme, hooks which are not needed are NULL */
+struct integrator
+{
+  const char *name; /* selected with --integrator */
+  const char *alias; /* alternative name */
+  int order; /* order of the scheme */
+  int derivatives; /* highest derivative needed from the force engine */
+  int buffers; /* arrays of N * DIM values init takes from the workspace */
+
+  void (*init)(struct state *s);
+
+  /* recalculates derivatives which are not provided by the engine, expects acceleration and jerk to be up to date */
+  void (*refresh)(struct state *s, const struct force_engine *engine);
+
+  void (*step)(struct state *s, double dt, int pec, const struct force_engine *engine);
+
+  /* moves derivatives kept between steps along with the particles after reordering */
+  void (*reorder)(struct state *s);
+};
+
+const struct force_engine *findEngine(const char *name);
+
+const struct integrator *findIntegrator(const char *name);
+
+void printEngines(void);
+
+void printIntegrators(void);
+
+#endif // ENGINE_H_
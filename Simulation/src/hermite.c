@@ -21,50 +21,218 @@
 
 #include <complex.h>
 #include "ediag.h"
+#include "engine.h"
 #include "hermite.h"
+#include "ks.h"
 #include "output.h"
-#include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include "reorder.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "workspace.h"
 
 /*
  * Function:  startHermite 
  * ====================
- *  Entry point for the Hermite scheme. Controls current computation
+ *  Entry point for the time integration. Controls current computation
  *  and checks wether or not end of simulation has been reached.
+ *  Drives every integrator of the registry in engine.h, all processes 
+ *  integrate redundantly while only the root process writes output.
+ *  Memory is only allocated before the time loop, which is verified
+ *  with the counter of the workspace. A run continued from a checkpoint
+ *  restores the state of all modules instead of starting from the 
+ *  initial conditions, the run stops after a checkpoint requested by
+ *  a signal.
  *
- *  N: amount of particles
- *  DIM: dimensions of space
+ *  s: particles
  *  dt: timestep
  *  end_time: end of simulation
- *  mass: masses of all particles
- *  pos: positions of all particles
- *  vel: velocity of all particles
- *  acc: acceleration for all particles
- *  jerk: jerk for all particles
+ *  scheme: integrator
+ *  engine: force engine providing the derivatives
+ *  pec: amount of evaluation and correction passes per step, P(EC)^n, more passes approach
+ *       time symmetry, which keeps the energy error bounded at larger timesteps
+ *  ks_radius: separation below which pairs are regularized, zero disables regularization
+ *  reorder_steps: steps between sorting the particles along a curve, zero disables reordering
+ *  curve: REORDER_MORTON or REORDER_HILBERT
+ *  diag_every: steps between energy diagnostics
+ *  diag_dt: time between energy diagnostics, zero uses diag_every instead
+ *  potential_samples: sampled particles per estimate of the potential energy, zero always sums exactly
+ *  potential_exact: diagnostics between exact potential energies while sampling
  *
- *  returns: void
+ *  returns: amount of allocations within the time loop
  * --------------------
  */
-void startHermite(int N, int DIM, double dt, double end_time, double *mass, double complex *pos, double complex *vel, 
-                  double complex *acc, double complex *jerk)
+long startHermite(struct state *s, double dt, double end_time, const struct integrator *scheme, 
+                  const struct force_engine *engine, int pec, double ks_radius, int reorder_steps, int curve,
+                  int diag_every, double diag_dt, int potential_samples, int potential_exact)
 {
   double time = 0.0; /* default time */
+  double diag_time = diag_dt; /* time of the next diagnostics if selected by time */
   int iterations = 0; /* iteration counter, iteration 0 is equal to initial conditions */
+  int N = s->n, DIM = s->dim;
+  
+  /* particles and clocks of the time loop, the integrators and the other modules register their own state */
+  checkpoint_array("mass", (void **) &s->mass, N * sizeof(double)); /* provided by checkpoint.h */
+  checkpoint_array("pos", (void **) &s->pos, (N * DIM) * sizeof(double complex));
+  checkpoint_array("vel", (void **) &s->vel, (N * DIM) * sizeof(double complex));
+  checkpoint_array("acc", (void **) &s->acc, (N * DIM) * sizeof(double complex));
+  checkpoint_array("jerk", (void **) &s->jerk, (N * DIM) * sizeof(double complex));
+  checkpoint_value("time", &time, sizeof(time));
+  checkpoint_value("iterations", &iterations, sizeof(iterations));
+  checkpoint_value("diag_time", &diag_time, sizeof(diag_time));
+  
+  if(scheme->init != NULL)
+  {
+    scheme->init(s);
+  }
+  
+  if(ks_radius > 0)
+  {
+    initKS(N, ks_radius); /* provided by ks.h */
+  }
+  
+  if(reorder_steps > 0)
+  {
+    initReorder(N, DIM, curve); /* provided by reorder.h */
+  }
+  
+  /* all processes share the diagnostics */
+  initDiagnostics(N, DIM, potential_samples, potential_exact); /* provided by ediag.h */
+  
+  if(checkpoint_resumed() != NULL)
+  {
+    restore_checkpoint(); /* derivatives and diagnostics of the checkpoint are restored as well */
+  }
+  else
+  {
+    derivatives(s, scheme, engine); /* calculate inital derivatives for all particles */
+    
+    /* regularized pairs must not feel their mutual force */
+    if(ks_partner != NULL && ks_detect(N, DIM, s->mass, s->pos, s->vel, s->acc) > 0)
+    {
+      derivatives(s, scheme, engine);
+    }
+    
+    submit_diagnostics(0, time, N, DIM, s->mass, s->pos, s->vel); /* calculate energy diagnostics for initial conditions */
+  }
   
-  acc_jerk(N, DIM, mass, pos, vel, acc, jerk); /* calculate inital acceleration and jerk for all particles */
-  energy_diagnostics(N, DIM, mass, pos, vel); /* calculate energy diagnostics for initial conditions */
+  long allocations = workspace_allocations(); /* provided by workspace.h */
   
   /* continues until specified end of simulation is reached */
   while(time < end_time)
   {
     ++iterations; /* increment iteration counter from last iteration to current iteration */
+    time += dt; /* add timestep to current time to advance to next iteration */
     
-    hermite(N, DIM, dt, mass, pos, vel, acc, jerk); /* calculate movement for current iteration */
-    printIteration(N, DIM, iterations, mass, pos, vel); /* provided by output.h */
-    energy_diagnostics(N, DIM, mass, pos, vel); /* provided by ediag.h */
+    if(ks_partner != NULL)
+    {
+      ks_perturbation(DIM, s->acc, s->jerk); /* provided by ks.h */
+    }
     
-    time += dt; /* add timestep to current time to advance to next iteration */
+    scheme->step(s, dt, pec, engine); /* calculate movement for current iteration */
+    
+    /* integrate regularized pairs on their own clock, pairs that have been 
+       started or terminated change the forces of both particles */
+    if(ks_partner != NULL)
+    {
+      ks_advance(DIM, dt, s->mass, s->pos, s->vel); /* provided by ks.h */
+      
+      if(ks_detect(N, DIM, s->mass, s->pos, s->vel, s->acc) > 0)
+      {
+        derivatives(s, scheme, engine);
+      }
+    }
+    
+    /* sort spatially close particles next to each other */
+    if(reorder_steps > 0 && iterations % reorder_steps == 0)
+    {
+      reorder(s); /* provided by reorder.h */
+      
+      if(scheme->reorder != NULL)
+      {
+        scheme->reorder(s);
+      }
+    }
+    
+    if(snapshot_due(iterations, time, dt))
+    {
+      write_snapshot(iterations, time, s, reorder_slot); /* provided by snapshot.h */
+    }
+    
+    if(stream_due(iterations))
+    {
+      stream_frame(iterations, time, s, reorder_slot); /* provided by stream.h */
+    }
+    
+    /* diagnostics are evaluated in the background on a copy of the particles */
+    if(diag_dt > 0 ? time >= diag_time - 0.5 * dt : iterations % diag_every == 0)
+    {
+      submit_diagnostics(iterations, time, N, DIM, s->mass, s->pos, s->vel); /* provided by ediag.h */
+    }
+    
+    /* next multiple of diag_dt after the current time */
+    while(diag_dt > 0 && time >= diag_time - 0.5 * dt)
+    {
+      diag_time += diag_dt;
+    }
+    
+    if(checkpoint_due(iterations))
+    {
+      write_checkpoint(iterations, time); /* provided by checkpoint.h */
+      
+      if(checkpoint_stop())
+      {
+        break;
+      }
+    }
+  }
+  
+  allocations = workspace_allocations() - allocations;
+  
+  freeDiagnostics(); /* provided by ediag.h */
+  
+  if(ks_partner != NULL)
+  {
+    freeKS();
+  }
+  
+  if(reorder_slot != NULL)
+  {
+    freeReorder();
+  }
+  
+  return allocations;
+}
+
+/*
+ * Function:  derivatives 
+ * ====================
+ *  Calculates all derivatives needed by the selected integrator
+ *  from scratch, leapfrog only needs the acceleration.
+ *
+ *  s: particles
+ *  scheme: integrator
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+void derivatives(struct state *s, const struct integrator *scheme, const struct force_engine *engine)
+{
+  if(scheme->derivatives == 1)
+  {
+    engine->acc(s->n, s->dim, s->mass, s->pos, s->acc);
+  }
+  else
+  {
+    engine->acc_jerk(s->n, s->dim, s->mass, s->pos, s->vel, s->acc, s->jerk);
+  }
+  
+  if(scheme->refresh != NULL)
+  {
+    scheme->refresh(s, engine);
   }
 }
 
@@ -99,10 +267,18 @@ void acc_jerk(int N, int DIM, double *mass, double complex *pos, double complex
   
   /* loops over all particles */
   for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
-  { 
+  {
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+    
     /* only loops over half of the particles because force acts equally on both particles (Newton) */
-    for(int j = i + DIM, mj = 0; j < (N * DIM); j += DIM, ++mj)
+    for(int j = i + DIM, mj = mi + 1; j < (N * DIM); j += DIM, ++mj)
     {
+      /* mutual force of a regularized pair is integrated separately */
+      if(mj == partner)
+      {
+        continue;
+      }
+      
       double complex rji[DIM], vji[DIM]; /* position vector from particle i to j */
       
       for(int k = 0; k < DIM; ++k)
@@ -148,67 +324,90 @@ void acc_jerk(int N, int DIM, double *mass, double complex *pos, double complex
   }
 }
 
+/*
+ * Function:  initHermite 
+ * ====================
+ *  Takes the values of the last step from the workspace.
+ *
+ *  s: particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void initHermite(struct state *s)
+{
+  s->old_pos = workspace_alloc((s->n * s->dim), sizeof(double complex)); /* provided by workspace.h */
+  s->old_vel = workspace_alloc((s->n * s->dim), sizeof(double complex));
+  s->old_acc = workspace_alloc((s->n * s->dim), sizeof(double complex));
+  s->old_jerk = workspace_alloc((s->n * s->dim), sizeof(double complex));
+}
+
+/*
+ * Function:  begin_step 
+ * ====================
+ *  Turns the current values into the values of the last step by 
+ *  swapping pointers, the current buffers are overwritten by the 
+ *  prediction afterwards.
+ *
+ *  s: particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void begin_step(struct state *s)
+{
+  double complex *tmp;
+  
+  tmp = s->old_pos; s->old_pos = s->pos; s->pos = tmp;
+  tmp = s->old_vel; s->old_vel = s->vel; s->vel = tmp;
+  tmp = s->old_acc; s->old_acc = s->acc; s->acc = tmp;
+  tmp = s->old_jerk; s->old_jerk = s->jerk; s->jerk = tmp;
+}
+
 /*
  * Function:  hermite 
  * ====================
  *  Implementation of the Hermite scheme, calculates new positions 
- *  and velocities for all particles. 
+ *  and velocities for all particles. Evaluation and correction are 
+ *  repeated pec times on the corrected values, which converges 
+ *  towards the time-symmetric scheme for larger values of pec.
  *  Based on Kokubo E., Yoshinaga K., Makino J., 1998, MNRAS 297, 1067
  *
- *  N: amount of particles
- *  DIM: dimensions of space
+ *  s: particles
  *  dt: timestep
- *  mass: masses of all particles
- *  pos: positions of all particles
- *  vel: velocity of all particles
- *  acc: acceleration for all particles
- *  jerk: jerk for all particles
+ *  pec: amount of evaluation and correction passes, P(EC)^n
+ *  engine: force engine providing acceleration and jerk
  *
  *  returns: void
  * --------------------
  */
-void hermite(int N, int DIM, double dt, double *mass, double complex *pos, 
-             double complex *vel, double complex *acc, double complex *jerk)
+void hermite(struct state *s, double dt, int pec, const struct force_engine *engine)
 {
-  /* storing positions, velocities, acceleration and jerk from last iteration */
-  double complex *old_pos = calloc((N * DIM), sizeof(double complex));
-  double complex *old_vel = calloc((N * DIM), sizeof(double complex));
-  double complex *old_acc = calloc((N * DIM), sizeof(double complex));
-  double complex *old_jerk = calloc((N * DIM), sizeof(double complex));
-  
-  /* allocation guard */
-  if(old_pos == NULL || old_vel == NULL || old_acc == NULL || old_jerk == NULL)
-  {
-    fprintf(stderr, "Out of memory!\n");
-    exit(0);
-  }
+  begin_step(s);
   
-  /* copy data from last iteration */
-  memcpy(old_pos, pos, ((N * DIM) * sizeof(double complex)));
-  memcpy(old_vel, vel, ((N * DIM) * sizeof(double complex)));
-  memcpy(old_acc, acc, ((N * DIM) * sizeof(double complex)));
-  memcpy(old_jerk, jerk, ((N * DIM) * sizeof(double complex)));
+  int N = s->n, DIM = s->dim;
+  double complex *pos = s->pos, *vel = s->vel, *acc = s->acc, *jerk = s->jerk;
+  double complex *old_pos = s->old_pos, *old_vel = s->old_vel, *old_acc = s->old_acc, *old_jerk = s->old_jerk;
   
   /* prediction for all particles using old values*/
   for(int i = 0; i < (N * DIM); ++i)
   {
-    pos[i] += vel[i] * dt + acc[i] * ((dt * dt)/2) + jerk[i] * ((dt * dt * dt)/6);
-    vel[i] += acc[i] * dt + jerk[i] * ((dt * dt)/2);
+    pos[i] = old_pos[i] + old_vel[i] * dt + old_acc[i] * ((dt * dt)/2) + old_jerk[i] * ((dt * dt * dt)/6);
+    vel[i] = old_vel[i] + old_acc[i] * dt + old_jerk[i] * ((dt * dt)/2);
   }
   
-  /* calculate new acceleration and jerk for all particles*/
-  acc_jerk(N, DIM, mass, pos, vel, acc, jerk);
-  
-  /* correction in reversed order of computation, allows the corrected velocities 
-     to be used to correct the positions for better energy behaviour */
-  for (int i = 0; i < (N * DIM); ++i)
+  /* predicted positions and velocities are overwritten by each correction */
+  for(int n = 0; n < pec; ++n)
   {
-    vel[i] = old_vel[i] + (old_acc[i] + acc[i]) * (dt/2) + (old_jerk[i] - jerk[i]) * ((dt * dt)/12);       
-    pos[i] = old_pos[i] + (old_vel[i] + vel[i]) * (dt/2) + (old_acc[i] - acc[i]) * ((dt * dt)/12);
+    /* calculate new acceleration and jerk for all particles*/
+    engine->acc_jerk(N, DIM, s->mass, pos, vel, acc, jerk);
+    
+    /* correction in reversed order of computation, allows the corrected velocities 
+       to be used to correct the positions for better energy behaviour */
+    for (int i = 0; i < (N * DIM); ++i)
+    {
+      vel[i] = old_vel[i] + (old_acc[i] + acc[i]) * (dt/2) + (old_jerk[i] - jerk[i]) * ((dt * dt)/12);       
+      pos[i] = old_pos[i] + (old_vel[i] + vel[i]) * (dt/2) + (old_acc[i] - acc[i]) * ((dt * dt)/12);
+    }
   }
-  
-  free(old_pos);
-  free(old_vel);
-  free(old_acc);
-  free(old_jerk);
 }
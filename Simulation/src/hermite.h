@@ -4,10 +4,16 @@
 void acc_jerk(int N, int DIM, double *mass, double complex *pos, double complex *vel, 
               double complex *acc, double complex *jerk);
 
-void hermite(int N, int DIM, double dt, double *mass, double complex *pos, 
-             double complex *vel, double complex *acc, double complex *jerk);
+void initHermite(struct state *s);
 
-void startHermite(int N, int DIM, double dt, double end_time, double *mass, double complex *pos, double complex *vel, 
-                  double complex *acc, double complex *jerk);
+void begin_step(struct state *s);
+
+void hermite(struct state *s, double dt, int pec, const struct force_engine *engine);
+
+void derivatives(struct state *s, const struct integrator *scheme, const struct force_engine *engine);
+
+long startHermite(struct state *s, double dt, double end_time, const struct integrator *scheme, 
+                  const struct force_engine *engine, int pec, double ks_radius, int reorder_steps, int curve,
+                  int diag_every, double diag_dt, int potential_samples, int potential_exact);
 
 #endif // HERMITE_H_
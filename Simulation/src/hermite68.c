@@ -0,0 +1,524 @@
+/*
+    The following source-code is an implementation of the sixth and eighth
+    order Hermite integrators as described by Nitadori & Makino, 2008.
+    Both schemes additionally compute snap (and crackle) pairwise and are
+    able to take considerably larger timesteps than the fourth order scheme
+    at the same accuracy.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#include "hermite.h"
+#include "hermite68.h"
+#include "ks.h"
+#include <string.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include "reorder.h"
+#include "workspace.h"
+
+/* higher derivatives of the acceleration for all particles,
+   snap and crackle are either computed pairwise or interpolated from the last step */
+static double complex *snap, *crackle, *pop, *a5;
+
+/* snap and crackle from last iteration and predicted acceleration and jerk,
+   position, velocity, acceleration and jerk from last iteration are part of the state */
+static double complex *old_snap, *old_crackle;
+static double complex *pred_acc, *pred_jerk;
+
+/*
+ * Function:  swap
+ * ====================
+ *  Exchanges two buffers.
+ *
+ *  a: first buffer
+ *  b: second buffer
+ *
+ *  returns: void
+ * --------------------
+ */
+static void swap(double complex **a, double complex **b)
+{
+  double complex *tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/*
+ * Function:  initHermite68
+ * ====================
+ *  Takes the additional derivatives and buffers needed by the
+ *  sixth or eighth order scheme from the workspace. Derivatives
+ *  kept between steps are registered for checkpoints.
+ *
+ *  s: particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void initHermite68(struct state *s)
+{
+  int N = s->n, DIM = s->dim;
+
+  initHermite(s); /* provided by hermite.h */
+
+  snap = workspace_alloc((N * DIM), sizeof(double complex)); /* provided by workspace.h */
+  crackle = workspace_alloc((N * DIM), sizeof(double complex));
+  pop = workspace_alloc((N * DIM), sizeof(double complex));
+  a5 = workspace_alloc((N * DIM), sizeof(double complex));
+
+  old_snap = workspace_alloc((N * DIM), sizeof(double complex));
+  old_crackle = workspace_alloc((N * DIM), sizeof(double complex));
+
+  pred_acc = workspace_alloc((N * DIM), sizeof(double complex));
+  pred_jerk = workspace_alloc((N * DIM), sizeof(double complex));
+
+  checkpoint_array("snap", (void **) &snap, (N * DIM) * sizeof(double complex)); /* provided by checkpoint.h */
+  checkpoint_array("crackle", (void **) &crackle, (N * DIM) * sizeof(double complex));
+  checkpoint_array("pop", (void **) &pop, (N * DIM) * sizeof(double complex));
+  checkpoint_array("a5", (void **) &a5, (N * DIM) * sizeof(double complex));
+}
+
+/*
+ * Function:  refresh
+ * ====================
+ *  Calculates snap (and crackle) from scratch and discards all
+ *  derivatives interpolated from the last step. Expects acceleration
+ *  and jerk to be up to date.
+ *
+ *  s: particles
+ *  order: order of the integrator, either 6 or 8
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+static void refresh(struct state *s, int order, const struct force_engine *engine)
+{
+  int N = s->n, DIM = s->dim;
+
+  /* snap and crackle depend on the acceleration and jerk of both particles */
+  swap(&pred_acc, &s->acc);
+  swap(&pred_jerk, &s->jerk);
+
+  if(order == 8)
+  {
+    engine->acc_jerk_snap_crackle(N, DIM, s->mass, s->pos, s->vel, pred_acc, pred_jerk, s->acc, s->jerk, snap, crackle);
+  }
+  else
+  {
+    engine->acc_jerk_snap(N, DIM, s->mass, s->pos, s->vel, pred_acc, s->acc, s->jerk, snap);
+    memset(crackle, 0, ((N * DIM) * sizeof(double complex)));
+  }
+
+  memset(pop, 0, ((N * DIM) * sizeof(double complex)));
+  memset(a5, 0, ((N * DIM) * sizeof(double complex)));
+}
+
+/*
+ * Function:  reorderHermite68
+ * ====================
+ *  Moves the derivatives kept between steps to the new
+ *  indices of their particles after reordering.
+ *
+ *  s: particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void reorderHermite68(struct state *s)
+{
+  reorder_array(s->n, s->dim, &snap); /* provided by reorder.h */
+  reorder_array(s->n, s->dim, &crackle);
+  reorder_array(s->n, s->dim, &pop);
+  reorder_array(s->n, s->dim, &a5);
+}
+
+/*
+ * Function:  refreshHermite6
+ * ====================
+ *  Calculates snap from scratch for the sixth order scheme.
+ *
+ *  s: particles
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+void refreshHermite6(struct state *s, const struct force_engine *engine)
+{
+  refresh(s, 6, engine);
+}
+
+/*
+ * Function:  refreshHermite8
+ * ====================
+ *  Calculates snap and crackle from scratch for the eighth order scheme.
+ *
+ *  s: particles
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+void refreshHermite8(struct state *s, const struct force_engine *engine)
+{
+  refresh(s, 8, engine);
+}
+
+/*
+ * Function:  acc_jerk_snap
+ * ====================
+ *  Calculates acceleration, jerk and snap for all particles by
+ *  comparing them pairwise, using the same optimization as acc_jerk.
+ *  Snap depends on the relative acceleration of both particles,
+ *  therefore the predicted acceleration has to be passed separately.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  vel: velocity of all particles
+ *  pred_acc: predicted acceleration for all particles
+ *  acc: acceleration for all particles
+ *  jerk: jerk for all particles
+ *  snap: snap for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_jerk_snap(int N, int DIM, double *mass, double complex *pos, double complex *vel, double complex *pred_acc,
+                   double complex *acc, double complex *jerk, double complex *snap)
+{
+  /* default values for acceleration, jerk and snap */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    acc[i] = jerk[i] = snap[i] = 0;
+  }
+
+  /* loops over all particles */
+  for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
+  {
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+
+    /* only loops over half of the particles because force acts equally on both particles (Newton) */
+    for(int j = i + DIM, mj = mi + 1; j < (N * DIM); j += DIM, ++mj)
+    {
+      /* mutual force of a regularized pair is integrated separately */
+      if(mj == partner)
+      {
+        continue;
+      }
+
+      double complex rji[DIM], vji[DIM], aji[DIM]; /* relative position, velocity and acceleration */
+
+      double complex r2 = 0.0; /* rij^2 */
+      double complex rv = 0.0; /* rij*vij */
+      double complex v2 = 0.0; /* vij^2 */
+      double complex ra = 0.0; /* rij*aij */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        rji[k] = pos[j + k] - pos[i + k];
+        vji[k] = vel[j + k] - vel[i + k];
+        aji[k] = pred_acc[j + k] - pred_acc[i + k];
+
+        r2 += rji[k] * rji[k];
+        rv += rji[k] * vji[k];
+        v2 += vji[k] * vji[k];
+        ra += rji[k] * aji[k];
+      }
+
+      double complex r3 = csqrt(r2) * r2; /* |rij| * rij^2 */
+
+      double complex alpha = rv / r2;
+      double complex beta = (v2 + ra) / r2 + alpha * alpha;
+
+      /* calculates new acceleration, jerk and snap for both particles i and j */
+      for(int k = 0; k < DIM; ++k)
+      {
+        double complex da = rji[k] / r3;
+        double complex dj = vji[k] / r3 - 3 * alpha * da;
+        double complex ds = aji[k] / r3 - 6 * alpha * dj - 3 * beta * da;
+
+        acc[i + k] += mass[mj] * da;
+        acc[j + k] -= mass[mi] * da;
+
+        jerk[i + k] += mass[mj] * dj;
+        jerk[j + k] -= mass[mi] * dj;
+
+        snap[i + k] += mass[mj] * ds;
+        snap[j + k] -= mass[mi] * ds;
+      }
+    }
+  }
+}
+
+/*
+ * Function:  acc_jerk_snap_crackle
+ * ====================
+ *  Calculates acceleration, jerk, snap and crackle for all particles
+ *  by comparing them pairwise, using the same optimization as acc_jerk.
+ *  Snap and crackle depend on the relative acceleration and jerk of both
+ *  particles, therefore the predicted values have to be passed separately.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  vel: velocity of all particles
+ *  pred_acc: predicted acceleration for all particles
+ *  pred_jerk: predicted jerk for all particles
+ *  acc: acceleration for all particles
+ *  jerk: jerk for all particles
+ *  snap: snap for all particles
+ *  crackle: crackle for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_jerk_snap_crackle(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                           double complex *pred_acc, double complex *pred_jerk, double complex *acc,
+                           double complex *jerk, double complex *snap, double complex *crackle)
+{
+  /* default values for acceleration, jerk, snap and crackle */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    acc[i] = jerk[i] = snap[i] = crackle[i] = 0;
+  }
+
+  /* loops over all particles */
+  for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
+  {
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+
+    /* only loops over half of the particles because force acts equally on both particles (Newton) */
+    for(int j = i + DIM, mj = mi + 1; j < (N * DIM); j += DIM, ++mj)
+    {
+      /* mutual force of a regularized pair is integrated separately */
+      if(mj == partner)
+      {
+        continue;
+      }
+
+      double complex rji[DIM], vji[DIM], aji[DIM], jji[DIM]; /* relative position, velocity, acceleration and jerk */
+
+      double complex r2 = 0.0; /* rij^2 */
+      double complex rv = 0.0; /* rij*vij */
+      double complex v2 = 0.0; /* vij^2 */
+      double complex ra = 0.0; /* rij*aij */
+      double complex va = 0.0; /* vij*aij */
+      double complex rj = 0.0; /* rij*jij */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        rji[k] = pos[j + k] - pos[i + k];
+        vji[k] = vel[j + k] - vel[i + k];
+        aji[k] = pred_acc[j + k] - pred_acc[i + k];
+        jji[k] = pred_jerk[j + k] - pred_jerk[i + k];
+
+        r2 += rji[k] * rji[k];
+        rv += rji[k] * vji[k];
+        v2 += vji[k] * vji[k];
+        ra += rji[k] * aji[k];
+        va += vji[k] * aji[k];
+        rj += rji[k] * jji[k];
+      }
+
+      double complex r3 = csqrt(r2) * r2; /* |rij| * rij^2 */
+
+      double complex alpha = rv / r2;
+      double complex beta = (v2 + ra) / r2 + alpha * alpha;
+      double complex gamma = (3 * va + rj) / r2 + alpha * (3 * beta - 4 * alpha * alpha);
+
+      /* calculates new acceleration, jerk, snap and crackle for both particles i and j */
+      for(int k = 0; k < DIM; ++k)
+      {
+        double complex da = rji[k] / r3;
+        double complex dj = vji[k] / r3 - 3 * alpha * da;
+        double complex ds = aji[k] / r3 - 6 * alpha * dj - 3 * beta * da;
+        double complex dc = jji[k] / r3 - 9 * alpha * ds - 9 * beta * dj - 3 * gamma * da;
+
+        acc[i + k] += mass[mj] * da;
+        acc[j + k] -= mass[mi] * da;
+
+        jerk[i + k] += mass[mj] * dj;
+        jerk[j + k] -= mass[mi] * dj;
+
+        snap[i + k] += mass[mj] * ds;
+        snap[j + k] -= mass[mi] * ds;
+
+        crackle[i + k] += mass[mj] * dc;
+        crackle[j + k] -= mass[mi] * dc;
+      }
+    }
+  }
+}
+
+/*
+ * Function:  hermite6
+ * ====================
+ *  Implementation of the sixth order Hermite scheme, calculates new
+ *  positions and velocities for all particles. Crackle is not computed
+ *  pairwise but interpolated from the last step and only used for prediction.
+ *  Evaluation and correction are repeated pec times, later evaluations
+ *  use the last evaluated acceleration.
+ *  Based on Nitadori K., Makino J., 2008, New Astronomy 13, 498
+ *
+ *  s: particles
+ *  dt: timestep
+ *  pec: amount of evaluation and correction passes, P(EC)^n
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+void hermite6(struct state *s, double dt, int pec, const struct force_engine *engine)
+{
+  double dt2 = dt * dt;
+  double dt3 = dt2 * dt;
+
+  /* values from last iteration, swapped instead of copied */
+  begin_step(s); /* provided by hermite.h */
+  swap(&old_snap, &snap);
+
+  int N = s->n, DIM = s->dim;
+  double complex *old_pos = s->old_pos, *old_vel = s->old_vel, *old_acc = s->old_acc, *old_jerk = s->old_jerk;
+
+  /* prediction for all particles using old values */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    s->pos[i] = old_pos[i] + old_vel[i] * dt + old_acc[i] * (dt2/2) + old_jerk[i] * (dt3/6)
+                + old_snap[i] * ((dt2 * dt2)/24) + crackle[i] * ((dt3 * dt2)/120);
+    s->vel[i] = old_vel[i] + old_acc[i] * dt + old_jerk[i] * (dt2/2) + old_snap[i] * (dt3/6)
+                + crackle[i] * ((dt2 * dt2)/24);
+    pred_acc[i] = old_acc[i] + old_jerk[i] * dt + old_snap[i] * (dt2/2) + crackle[i] * (dt3/6);
+  }
+
+  /* predicted positions and velocities are overwritten by each correction */
+  for(int n = 0; n < pec; ++n)
+  {
+    if(n > 0)
+    {
+      swap(&pred_acc, &s->acc);
+    }
+
+    /* calculate new acceleration, jerk and snap for all particles */
+    engine->acc_jerk_snap(N, DIM, s->mass, s->pos, s->vel, pred_acc, s->acc, s->jerk, snap);
+
+    double complex *pos = s->pos, *vel = s->vel, *acc = s->acc, *jerk = s->jerk;
+
+    /* correction in reversed order of computation, allows the corrected velocities
+       to be used to correct the positions for better energy behaviour */
+    for(int i = 0; i < (N * DIM); ++i)
+    {
+      vel[i] = old_vel[i] + (old_acc[i] + acc[i]) * (dt/2) - (jerk[i] - old_jerk[i]) * (dt2/10)
+               + (old_snap[i] + snap[i]) * (dt3/120);
+      pos[i] = old_pos[i] + (old_vel[i] + vel[i]) * (dt/2) - (acc[i] - old_acc[i]) * (dt2/10)
+               + (old_jerk[i] + jerk[i]) * (dt3/120);
+    }
+  }
+
+  /* crackle at the end of the step from quintic interpolation, used by next prediction */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    crackle[i] = (60 * (s->acc[i] - old_acc[i]) - (24 * old_jerk[i] + 36 * s->jerk[i]) * dt
+                 + (9 * snap[i] - 3 * old_snap[i]) * dt2) / dt3;
+  }
+}
+
+/*
+ * Function:  hermite8
+ * ====================
+ *  Implementation of the eighth order Hermite scheme, calculates new
+ *  positions and velocities for all particles. The fourth and fifth
+ *  derivative of the acceleration are interpolated from the last step
+ *  and only used for prediction. Evaluation and correction are repeated
+ *  pec times, later evaluations use the last evaluated values.
+ *  Based on Nitadori K., Makino J., 2008, New Astronomy 13, 498
+ *
+ *  s: particles
+ *  dt: timestep
+ *  pec: amount of evaluation and correction passes, P(EC)^n
+ *  engine: force engine providing the derivatives
+ *
+ *  returns: void
+ * --------------------
+ */
+void hermite8(struct state *s, double dt, int pec, const struct force_engine *engine)
+{
+  double dt2 = dt * dt;
+  double dt3 = dt2 * dt;
+  double dt4 = dt2 * dt2;
+
+  /* values from last iteration, swapped instead of copied */
+  begin_step(s); /* provided by hermite.h */
+  swap(&old_snap, &snap);
+  swap(&old_crackle, &crackle);
+
+  int N = s->n, DIM = s->dim;
+  double complex *old_pos = s->old_pos, *old_vel = s->old_vel, *old_acc = s->old_acc, *old_jerk = s->old_jerk;
+
+  /* prediction for all particles using old values */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    s->pos[i] = old_pos[i] + old_vel[i] * dt + old_acc[i] * (dt2/2) + old_jerk[i] * (dt3/6) + old_snap[i] * (dt4/24)
+                + old_crackle[i] * ((dt4 * dt)/120) + pop[i] * ((dt4 * dt2)/720) + a5[i] * ((dt4 * dt3)/5040);
+    s->vel[i] = old_vel[i] + old_acc[i] * dt + old_jerk[i] * (dt2/2) + old_snap[i] * (dt3/6) + old_crackle[i] * (dt4/24)
+                + pop[i] * ((dt4 * dt)/120) + a5[i] * ((dt4 * dt2)/720);
+    pred_acc[i] = old_acc[i] + old_jerk[i] * dt + old_snap[i] * (dt2/2) + old_crackle[i] * (dt3/6)
+                  + pop[i] * (dt4/24) + a5[i] * ((dt4 * dt)/120);
+    pred_jerk[i] = old_jerk[i] + old_snap[i] * dt + old_crackle[i] * (dt2/2) + pop[i] * (dt3/6) + a5[i] * (dt4/24);
+  }
+
+  /* predicted positions and velocities are overwritten by each correction */
+  for(int n = 0; n < pec; ++n)
+  {
+    if(n > 0)
+    {
+      swap(&pred_acc, &s->acc);
+      swap(&pred_jerk, &s->jerk);
+    }
+
+    /* calculate new acceleration, jerk, snap and crackle for all particles */
+    engine->acc_jerk_snap_crackle(N, DIM, s->mass, s->pos, s->vel, pred_acc, pred_jerk, s->acc, s->jerk, snap, crackle);
+
+    double complex *pos = s->pos, *vel = s->vel, *acc = s->acc, *jerk = s->jerk;
+
+    /* correction in reversed order of computation, allows the corrected velocities
+       to be used to correct the positions for better energy behaviour */
+    for(int i = 0; i < (N * DIM); ++i)
+    {
+      vel[i] = old_vel[i] + (old_acc[i] + acc[i]) * (dt/2) - (jerk[i] - old_jerk[i]) * ((3 * dt2)/28)
+               + (old_snap[i] + snap[i]) * (dt3/84) - (crackle[i] - old_crackle[i]) * (dt4/1680);
+      pos[i] = old_pos[i] + (old_vel[i] + vel[i]) * (dt/2) - (acc[i] - old_acc[i]) * ((3 * dt2)/28)
+               + (old_jerk[i] + jerk[i]) * (dt3/84) - (snap[i] - old_snap[i]) * (dt4/1680);
+    }
+  }
+
+  double complex *acc = s->acc, *jerk = s->jerk;
+
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    /* fourth and fifth derivative at the end of the step from septic interpolation, used by next prediction */
+    pop[i] = (840 * (old_acc[i] - acc[i]) + (360 * old_jerk[i] + 480 * jerk[i]) * dt
+             + (60 * old_snap[i] - 120 * snap[i]) * dt2 + (4 * old_crackle[i] + 16 * crackle[i]) * dt3) / dt4;
+    a5[i] = (10080 * (old_acc[i] - acc[i]) + (4680 * old_jerk[i] + 5400 * jerk[i]) * dt
+            + (840 * old_snap[i] - 1200 * snap[i]) * dt2 + (60 * old_crackle[i] + 120 * crackle[i]) * dt3) / (dt4 * dt);
+  }
+}
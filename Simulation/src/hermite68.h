@@ -0,0 +1,23 @@
+#ifndef HERMITE68_H_
+#define HERMITE68_H_
+
+void acc_jerk_snap(int N, int DIM, double *mass, double complex *pos, double complex *vel, double complex *pred_acc,
+                   double complex *acc, double complex *jerk, double complex *snap);
+
+void acc_jerk_snap_crackle(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                           double complex *pred_acc, double complex *pred_jerk, double complex *acc,
+                           double complex *jerk, double complex *snap, double complex *crackle);
+
+void initHermite68(struct state *s);
+
+void reorderHermite68(struct state *s);
+
+void refreshHermite6(struct state *s, const struct force_engine *engine);
+
+void refreshHermite8(struct state *s, const struct force_engine *engine);
+
+void hermite6(struct state *s, double dt, int pec, const struct force_engine *engine);
+
+void hermite8(struct state *s, double dt, int pec, const struct force_engine *engine);
+
+#endif // HERMITE68_H_
@@ -0,0 +1,560 @@
+/*
+    The following source-code provides Kustaanheimo-Stiefel regularization
+    of close pairs. The relative motion of a regularized pair is integrated
+    separately with its own clock in the fictitious time of the KS transformation,
+    while its center of mass keeps moving with the global timestep of the cluster,
+    so tight binaries no longer force a tiny global timestep.
+    Based on Stiefel E. L., Scheifele G., 1971, Linear and Regular Celestial Mechanics
+    and Aarseth S. J., 2003, Gravitational N-Body Simulations.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "ks.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include "workspace.h"
+
+#define KS_ETA 0.05 /* accuracy parameter for steps in fictitious time */
+#define KS_MAX_STEPS 100000000 /* guard against pairs that can not be synchronized */
+
+/* state of a regularized pair */
+struct ks_pair
+{
+  int i, j; /* indices of both particles */
+  double u[4], up[4]; /* KS coordinates and their derivative with respect to fictitious time */
+  double h; /* binding energy per unit reduced mass */
+  double p0[3], pdot[3]; /* perturbation at the beginning of the step and its derivative */
+};
+
+int *ks_partner = NULL;
+
+static struct ks_pair *pairs;
+static int n_pairs = 0;
+static double ks_radius = 0.0;
+
+/*
+ * Function:  ks_bytes
+ * ====================
+ *  N: amount of particles
+ *
+ *  returns: size of all arrays initKS takes from the workspace
+ * --------------------
+ */
+size_t ks_bytes(int N)
+{
+  return workspace_bytes(N, sizeof(int)) + workspace_bytes((N / 2 + 1), sizeof(struct ks_pair)); /* provided by workspace.h */
+}
+
+/*
+ * Function:  initKS
+ * ====================
+ *  Enables regularization of all pairs closer than the given radius,
+ *  the regularized pairs are registered for checkpoints.
+ *
+ *  N: amount of particles
+ *  radius: separation below which pairs are regularized
+ *
+ *  returns: void
+ * --------------------
+ */
+void initKS(int N, double radius)
+{
+  ks_partner = workspace_alloc(N, sizeof(int)); /* provided by workspace.h */
+  pairs = workspace_alloc((N / 2 + 1), sizeof(struct ks_pair));
+
+  for(int i = 0; i < N; ++i)
+  {
+    ks_partner[i] = -1;
+  }
+
+  n_pairs = 0;
+  ks_radius = radius;
+
+  checkpoint_value("ks_partner", ks_partner, N * sizeof(int)); /* provided by checkpoint.h */
+  checkpoint_value("ks_pairs", pairs, (N / 2 + 1) * sizeof(struct ks_pair));
+  checkpoint_value("ks_count", &n_pairs, sizeof(n_pairs));
+}
+
+/*
+ * Function:  freeKS
+ * ====================
+ *  Frees all memory allocated by initKS and disables regularization.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeKS()
+{
+  workspace_free(ks_partner);
+  workspace_free(pairs);
+
+  ks_partner = NULL;
+  n_pairs = 0;
+}
+
+/*
+ * Function:  ks_reorder
+ * ====================
+ *  Moves the regularized pairs along with their particles after
+ *  the particles have been reordered.
+ *
+ *  N: amount of particles
+ *  index: new index of every former index
+ *  scratch: array of N integers
+ *
+ *  returns: void
+ * --------------------
+ */
+void ks_reorder(int N, const int *index, int *scratch)
+{
+  for(int i = 0; i < N; ++i)
+  {
+    scratch[index[i]] = (ks_partner[i] >= 0) ? index[ks_partner[i]] : -1;
+  }
+
+  for(int i = 0; i < N; ++i)
+  {
+    ks_partner[i] = scratch[i];
+  }
+
+  for(int p = 0; p < n_pairs; ++p)
+  {
+    pairs[p].i = index[pairs[p].i];
+    pairs[p].j = index[pairs[p].j];
+  }
+}
+
+/*
+ * Function:  ks_transpose
+ * ====================
+ *  Multiplies the transposed KS matrix L(u) with a three-dimensional vector.
+ *
+ *  u: KS coordinates
+ *  x: three-dimensional vector
+ *  out: resulting four-dimensional vector
+ *
+ *  returns: void
+ * --------------------
+ */
+static void ks_transpose(const double *u, const double *x, double *out)
+{
+  out[0] = u[0] * x[0] + u[1] * x[1] + u[2] * x[2];
+  out[1] = -u[1] * x[0] + u[0] * x[1] + u[3] * x[2];
+  out[2] = -u[2] * x[0] - u[3] * x[1] + u[0] * x[2];
+  out[3] = u[3] * x[0] - u[2] * x[1] + u[1] * x[2];
+}
+
+/*
+ * Function:  ks_to_relative
+ * ====================
+ *  Converts KS coordinates of a pair back to relative position and velocity.
+ *
+ *  pair: regularized pair
+ *  R: relative position of the second particle to the first one
+ *  V: relative velocity of the second particle to the first one
+ *
+ *  returns: void
+ * --------------------
+ */
+static void ks_to_relative(const struct ks_pair *pair, double *R, double *V)
+{
+  const double *u = pair->u;
+  const double *up = pair->up;
+  double r = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+
+  R[0] = u[0] * u[0] - u[1] * u[1] - u[2] * u[2] + u[3] * u[3];
+  R[1] = 2 * (u[0] * u[1] - u[2] * u[3]);
+  R[2] = 2 * (u[0] * u[2] + u[1] * u[3]);
+
+  V[0] = 2 * (u[0] * up[0] - u[1] * up[1] - u[2] * up[2] + u[3] * up[3]) / r;
+  V[1] = 2 * (u[1] * up[0] + u[0] * up[1] - u[3] * up[2] - u[2] * up[3]) / r;
+  V[2] = 2 * (u[2] * up[0] + u[3] * up[1] + u[0] * up[2] + u[1] * up[3]) / r;
+}
+
+/*
+ * Function:  ks_from_relative
+ * ====================
+ *  Converts relative position and velocity of a pair to KS coordinates.
+ *
+ *  pair: regularized pair
+ *  R: relative position of the second particle to the first one
+ *  V: relative velocity of the second particle to the first one
+ *  M: combined mass of the pair
+ *
+ *  returns: void
+ * --------------------
+ */
+static void ks_from_relative(struct ks_pair *pair, const double *R, const double *V, double M)
+{
+  double *u = pair->u;
+  double r = sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+
+  /* choose the branch which avoids division by small numbers */
+  if(R[0] >= 0)
+  {
+    u[0] = sqrt(0.5 * (r + R[0]));
+    u[1] = R[1] / (2 * u[0]);
+    u[2] = R[2] / (2 * u[0]);
+    u[3] = 0.0;
+  }
+  else
+  {
+    u[1] = sqrt(0.5 * (r - R[0]));
+    u[0] = R[1] / (2 * u[1]);
+    u[2] = 0.0;
+    u[3] = R[2] / (2 * u[1]);
+  }
+
+  ks_transpose(u, V, pair->up);
+
+  for(int k = 0; k < 4; ++k)
+  {
+    pair->up[k] *= 0.5;
+  }
+
+  pair->h = 0.5 * (V[0] * V[0] + V[1] * V[1] + V[2] * V[2]) - M / r;
+}
+
+/*
+ * Function:  ks_derivatives
+ * ====================
+ *  Right hand side of the perturbed KS equations with respect to
+ *  fictitious time. State holds u, u', h and the physical time.
+ *
+ *  pair: regularized pair, provides the perturbation
+ *  y: current state
+ *  dy: derivative of the state
+ *
+ *  returns: void
+ * --------------------
+ */
+static void ks_derivatives(const struct ks_pair *pair, const double *y, double *dy)
+{
+  const double *u = y;
+  const double *up = y + 4;
+  double h = y[8];
+  double t = y[9];
+  double r = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+
+  double P[3], LP[4]; /* perturbation at current time and transposed KS matrix times perturbation */
+
+  for(int k = 0; k < 3; ++k)
+  {
+    P[k] = pair->p0[k] + pair->pdot[k] * t;
+  }
+
+  ks_transpose(u, P, LP);
+
+  dy[8] = 0.0;
+
+  for(int k = 0; k < 4; ++k)
+  {
+    dy[k] = up[k];
+    dy[4 + k] = 0.5 * h * u[k] + 0.5 * r * LP[k];
+    dy[8] += 2 * up[k] * LP[k];
+  }
+
+  dy[9] = r; /* dt/ds */
+}
+
+/*
+ * Function:  ks_step
+ * ====================
+ *  Advances the state of a pair by one classical Runge-Kutta step
+ *  in fictitious time.
+ *
+ *  pair: regularized pair, provides the perturbation
+ *  y: current state
+ *  ds: step in fictitious time
+ *
+ *  returns: void
+ * --------------------
+ */
+static void ks_step(const struct ks_pair *pair, double *y, double ds)
+{
+  double k1[10], k2[10], k3[10], k4[10], tmp[10];
+
+  ks_derivatives(pair, y, k1);
+
+  for(int k = 0; k < 10; ++k)
+  {
+    tmp[k] = y[k] + 0.5 * ds * k1[k];
+  }
+
+  ks_derivatives(pair, tmp, k2);
+
+  for(int k = 0; k < 10; ++k)
+  {
+    tmp[k] = y[k] + 0.5 * ds * k2[k];
+  }
+
+  ks_derivatives(pair, tmp, k3);
+
+  for(int k = 0; k < 10; ++k)
+  {
+    tmp[k] = y[k] + ds * k3[k];
+  }
+
+  ks_derivatives(pair, tmp, k4);
+
+  for(int k = 0; k < 10; ++k)
+  {
+    y[k] += ds * (k1[k] + 2 * k2[k] + 2 * k3[k] + k4[k]) / 6;
+  }
+}
+
+/*
+ * Function:  ks_perturbation
+ * ====================
+ *  Stores the perturbation of all regularized pairs by the rest of the
+ *  cluster at the beginning of a step. Acceleration and jerk must not
+ *  contain the mutual force of the pair.
+ *
+ *  DIM: dimensions of space
+ *  acc: acceleration for all particles
+ *  jerk: jerk for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void ks_perturbation(int DIM, double complex *acc, double complex *jerk)
+{
+  for(int p = 0; p < n_pairs; ++p)
+  {
+    int i = pairs[p].i * DIM;
+    int j = pairs[p].j * DIM;
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      pairs[p].p0[k] = creal(acc[j + k] - acc[i + k]);
+      pairs[p].pdot[k] = creal(jerk[j + k] - jerk[i + k]);
+    }
+  }
+}
+
+/*
+ * Function:  ks_advance
+ * ====================
+ *  Integrates the relative motion of all regularized pairs over one
+ *  timestep of the cluster and places both particles of each pair
+ *  around their center of mass, which has been moved by the integrator.
+ *
+ *  DIM: dimensions of space
+ *  dt: timestep
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  vel: velocity of all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void ks_advance(int DIM, double dt, double *mass, double complex *pos, double complex *vel)
+{
+  for(int p = 0; p < n_pairs; ++p)
+  {
+    struct ks_pair *pair = &pairs[p];
+    double M = mass[pair->i] + mass[pair->j];
+    double y[10];
+
+    for(int k = 0; k < 4; ++k)
+    {
+      y[k] = pair->u[k];
+      y[4 + k] = pair->up[k];
+    }
+
+    y[8] = pair->h;
+    y[9] = 0.0;
+
+    /* integrate in fictitious time until the end of the cluster step is reached */
+    for(int steps = 0; fabs(dt - y[9]) > 1e-14 * dt && steps < KS_MAX_STEPS; ++steps)
+    {
+      double r = y[0] * y[0] + y[1] * y[1] + y[2] * y[2] + y[3] * y[3];
+      double ds = KS_ETA / sqrt(0.5 * fabs(y[8]) + 0.5 * M / r);
+
+      /* last steps are chosen to hit the end of the cluster step */
+      if(fabs(dt - y[9]) < ds * r)
+      {
+        ds = (dt - y[9]) / r;
+      }
+
+      ks_step(pair, y, ds);
+    }
+
+    for(int k = 0; k < 4; ++k)
+    {
+      pair->u[k] = y[k];
+      pair->up[k] = y[4 + k];
+    }
+
+    pair->h = y[8];
+
+    double R[3], V[3];
+    ks_to_relative(pair, R, V);
+
+    /* center of mass has been moved by the integrator */
+    int i = pair->i * DIM;
+    int j = pair->j * DIM;
+    double mi = mass[pair->i];
+    double mj = mass[pair->j];
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      double complex pos_center = (mi * pos[i + k] + mj * pos[j + k]) / M;
+      double complex vel_center = (mi * vel[i + k] + mj * vel[j + k]) / M;
+
+      pos[i + k] = pos_center - (mj / M) * R[k];
+      pos[j + k] = pos_center + (mi / M) * R[k];
+      vel[i + k] = vel_center - (mj / M) * V[k];
+      vel[j + k] = vel_center + (mi / M) * V[k];
+    }
+  }
+}
+
+/*
+ * Function:  ks_detect
+ * ====================
+ *  Terminates regularization of pairs which separated and starts it
+ *  for new close pairs. Only particles with an acceleration hinting at
+ *  a close neighbour are checked, so detection is linear in N for
+ *  every candidate. A pair is regularized if it is closer than the
+ *  radius and either bound or approaching.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  vel: velocity of all particles
+ *  acc: acceleration for all particles
+ *
+ *  returns: amount of pairs that have been started or terminated
+ * --------------------
+ */
+int ks_detect(int N, int DIM, double *mass, double complex *pos, double complex *vel, double complex *acc)
+{
+  int changed = 0;
+
+  /* terminate pairs which left twice the radius, hysteresis avoids toggling */
+  for(int p = 0; p < n_pairs; ++p)
+  {
+    double R[3], V[3];
+    ks_to_relative(&pairs[p], R, V);
+
+    if(sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]) > 2 * ks_radius)
+    {
+      ks_partner[pairs[p].i] = -1;
+      ks_partner[pairs[p].j] = -1;
+
+      pairs[p] = pairs[--n_pairs];
+      --p;
+      ++changed;
+    }
+  }
+
+  double mean_mass = 0.0;
+
+  for(int i = 0; i < N; ++i)
+  {
+    mean_mass += mass[i];
+  }
+
+  mean_mass /= N;
+
+  /* acceleration caused by a neighbour at roughly the regularization radius */
+  double acc_crit = 0.5 * mean_mass / (ks_radius * ks_radius);
+
+  for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
+  {
+    if(ks_partner[mi] != -1)
+    {
+      continue;
+    }
+
+    double a2 = 0.0;
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      a2 += creal(acc[i + k]) * creal(acc[i + k]);
+    }
+
+    if(a2 < acc_crit * acc_crit)
+    {
+      continue;
+    }
+
+    /* find the closest particle which is not regularized yet */
+    int nearest = -1;
+    double nearest_r2 = ks_radius * ks_radius;
+
+    for(int j = 0, mj = 0; j < (N * DIM); j += DIM, ++mj)
+    {
+      if(mj == mi || ks_partner[mj] != -1)
+      {
+        continue;
+      }
+
+      double r2 = 0.0;
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        r2 += creal(pos[j + k] - pos[i + k]) * creal(pos[j + k] - pos[i + k]);
+      }
+
+      if(r2 < nearest_r2)
+      {
+        nearest = mj;
+        nearest_r2 = r2;
+      }
+    }
+
+    if(nearest == -1)
+    {
+      continue;
+    }
+
+    double R[3], V[3], rv = 0.0, v2 = 0.0;
+    double M = mass[mi] + mass[nearest];
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      R[k] = creal(pos[nearest * DIM + k] - pos[i + k]);
+      V[k] = creal(vel[nearest * DIM + k] - vel[i + k]);
+      rv += R[k] * V[k];
+      v2 += V[k] * V[k];
+    }
+
+    /* receding unbound pairs will leave on their own */
+    if(rv > 0 && 0.5 * v2 - M / sqrt(nearest_r2) > 0)
+    {
+      continue;
+    }
+
+    struct ks_pair *pair = &pairs[n_pairs++];
+    pair->i = mi;
+    pair->j = nearest;
+    ks_from_relative(pair, R, V, M);
+
+    ks_partner[mi] = nearest;
+    ks_partner[nearest] = mi;
+    ++changed;
+  }
+
+  return changed;
+}
@@ -0,0 +1,23 @@
+#ifndef KS_H_
+#define KS_H_
+
+#include <stddef.h>
+
+/* regularized companion for every particle or -1, NULL if regularization is disabled */
+extern int *ks_partner;
+
+size_t ks_bytes(int N);
+
+void initKS(int N, double radius);
+
+void ks_perturbation(int DIM, double complex *acc, double complex *jerk);
+
+void ks_advance(int DIM, double dt, double *mass, double complex *pos, double complex *vel);
+
+int ks_detect(int N, int DIM, double *mass, double complex *pos, double complex *vel, double complex *acc);
+
+void ks_reorder(int N, const int *index, int *scratch);
+
+void freeKS(void);
+
+#endif // KS_H_
@@ -0,0 +1,129 @@
+/*
+    The following source-code is an implementation of the second order
+    symplectic kick-drift-kick leapfrog integrator, intended for quick
+    previews and parameter scans where the fourth order Hermite scheme
+    is not needed.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#include "ks.h"
+#include "leapfrog.h"
+#include <stdlib.h>
+
+/*
+ * Function:  acc_only
+ * ====================
+ *  Calculates the acceleration for all particles by comparing
+ *  them pairwise, using the same optimization as acc_jerk.
+ *  Velocities and jerk are not needed, which saves roughly
+ *  forty percent of the operations per pair.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_only(int N, int DIM, double *mass, double complex *pos, double complex *acc)
+{
+  /* default values for acceleration */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    acc[i] = 0;
+  }
+
+  /* loops over all particles */
+  for(int i = 0, mi = 0; i < (N * DIM); i += DIM, ++mi)
+  {
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+
+    /* only loops over half of the particles because force acts equally on both particles (Newton) */
+    for(int j = i + DIM, mj = mi + 1; j < (N * DIM); j += DIM, ++mj)
+    {
+      /* mutual force of a regularized pair is integrated separately */
+      if(mj == partner)
+      {
+        continue;
+      }
+
+      double complex rji[DIM]; /* position vector from particle i to j */
+      double complex r2 = 0.0; /* rij^2 */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        rji[k] = pos[j + k] - pos[i + k];
+        r2 += rji[k] * rji[k];
+      }
+
+      double complex r3 = csqrt(r2) * r2; /* |rij| * rij^2 */
+
+      /* calculates new acceleration for both particles i and j */
+      for(int k = 0; k < DIM; ++k)
+      {
+        double complex da = rji[k] / r3;
+
+        acc[i + k] += mass[mj] * da; /* add positive acceleration to particle i */
+        acc[j + k] -= mass[mi] * da; /* add negative acceleration to particle j */
+      }
+    }
+  }
+}
+
+/*
+ * Function:  leapfrog
+ * ====================
+ *  Implementation of the kick-drift-kick leapfrog scheme, calculates
+ *  new positions and velocities for all particles. Only one evaluation
+ *  of the acceleration is needed per step, since the acceleration at
+ *  the end of a step is reused for the first kick of the next one.
+ *
+ *  s: particles
+ *  dt: timestep
+ *  pec: unused, the scheme has no correction
+ *  engine: force engine providing the acceleration
+ *
+ *  returns: void
+ * --------------------
+ */
+void leapfrog(struct state *s, double dt, int pec, const struct force_engine *engine)
+{
+  int N = s->n, DIM = s->dim;
+  double complex *pos = s->pos, *vel = s->vel, *acc = s->acc;
+
+  (void) pec;
+
+  /* kick for half a timestep and drift for a full timestep */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    vel[i] += acc[i] * (dt/2);
+    pos[i] += vel[i] * dt;
+  }
+
+  /* calculate new acceleration for all particles */
+  engine->acc(N, DIM, s->mass, pos, acc);
+
+  /* kick for the remaining half of the timestep */
+  for(int i = 0; i < (N * DIM); ++i)
+  {
+    vel[i] += acc[i] * (dt/2);
+  }
+}
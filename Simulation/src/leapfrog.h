@@ -0,0 +1,8 @@
+#ifndef LEAPFROG_H_
+#define LEAPFROG_H_
+
+void acc_only(int N, int DIM, double *mass, double complex *pos, double complex *acc);
+
+void leapfrog(struct state *s, double dt, int pec, const struct force_engine *engine);
+
+#endif // LEAPFROG_H_
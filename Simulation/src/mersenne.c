@@ -172,6 +172,13 @@ double genrand_res53(void)
 } 
 /* These real versions are due to Isaku Wada, 2002/01/09 added */
 
+/* returns the state vector of GENRAND_WORDS words, index is set to the position within it */
+unsigned long *genrand_state(int **index)
+{
+    *index = &mti;
+    return mt;
+}
+
 /*
 int main(void)
 {
@@ -1,6 +1,8 @@
 #ifndef MERSENNE_H_
 #define MERSENNE_H_
 
+#define GENRAND_WORDS 624 /* words of the state vector */
+
 void init_genrand(unsigned long s);
 
 double genrand_real1(void);
@@ -17,4 +19,6 @@ double genrand_real3(void);
 
 double genrand_res53(void);
 
+unsigned long *genrand_state(int **index);
+
 #endif // MERSENNE_H_
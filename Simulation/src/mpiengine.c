@@ -0,0 +1,224 @@
+/*
+    The following source-code is an implementation of the direct summation
+    distributed over MPI processes. Every process calculates the derivatives
+    of a contiguous part of the particles against all particles, the parts
+    are gathered on all processes afterwards. Replaces the former separate
+    MPI version of acc_jerk.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef USE_MPI
+
+#include <complex.h>
+#include "engine.h"
+#include "ks.h"
+#include <mpi.h>
+#include "mpiengine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "workspace.h"
+
+static int first, last; /* local particles of this process */
+static int *counts, *displs; /* elements and offsets per process */
+
+/*
+ * Function:  mpi_engine_bytes
+ * ====================
+ *  returns: size of all arrays initMPIEngine takes from the workspace
+ * --------------------
+ */
+size_t mpi_engine_bytes()
+{
+  return 2 * workspace_bytes(world_size, sizeof(int)); /* provided by workspace.h */
+}
+
+/*
+ * Function:  initMPIEngine
+ * ====================
+ *  Splits the particles evenly between all processes.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  grid: unused, the engine does not use a mesh
+ *
+ *  returns: void
+ * --------------------
+ */
+void initMPIEngine(int N, int DIM, int grid)
+{
+  (void) grid;
+
+  counts = workspace_alloc(world_size, sizeof(int)); /* provided by workspace.h */
+  displs = workspace_alloc(world_size, sizeof(int));
+
+  for(int q = 0; q < world_size; ++q)
+  {
+    int begin = (int) ((long) N * q / world_size);
+    int end = (int) ((long) N * (q + 1) / world_size);
+
+    counts[q] = (end - begin) * DIM;
+    displs[q] = begin * DIM;
+  }
+
+  first = displs[world_rank] / DIM;
+  last = first + counts[world_rank] / DIM;
+}
+
+/*
+ * Function:  freeMPIEngine
+ * ====================
+ *  Frees all memory allocated by initMPIEngine.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeMPIEngine()
+{
+  workspace_free(counts);
+  workspace_free(displs);
+}
+
+/*
+ * Function:  acc_mpi
+ * ====================
+ *  Calculates the acceleration for the local particles against all
+ *  particles and gathers the result on all processes. Expects the
+ *  same positions on all processes.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_mpi(int N, int DIM, double *mass, double complex *pos, double complex *acc)
+{
+  #pragma omp parallel for schedule(dynamic, 16)
+  for(int mi = first; mi < last; ++mi)
+  {
+    int i = mi * DIM;
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      acc[i + k] = 0;
+    }
+
+    /* loops over all particles, Newton's third law would need a second reduction */
+    for(int mj = 0; mj < N; ++mj)
+    {
+      int j = mj * DIM;
+
+      if(mj == mi || mj == partner)
+      {
+        continue;
+      }
+
+      double complex rji[DIM]; /* position vector from particle i to j */
+      double complex r2 = 0.0; /* rij^2 */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        rji[k] = pos[j + k] - pos[i + k];
+        r2 += rji[k] * rji[k];
+      }
+
+      double complex r3 = csqrt(r2) * r2; /* |rij| * rij^2 */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        acc[i + k] += mass[mj] * rji[k] / r3;
+      }
+    }
+  }
+
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, acc, counts, displs, MPI_C_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+}
+
+/*
+ * Function:  acc_jerk_mpi
+ * ====================
+ *  Calculates acceleration and jerk for the local particles against
+ *  all particles and gathers the result on all processes. Expects the
+ *  same positions and velocities on all processes.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  vel: velocity of all particles
+ *  acc: acceleration for all particles
+ *  jerk: jerk for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_jerk_mpi(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                  double complex *acc, double complex *jerk)
+{
+  #pragma omp parallel for schedule(dynamic, 16)
+  for(int mi = first; mi < last; ++mi)
+  {
+    int i = mi * DIM;
+    int partner = (ks_partner != NULL) ? ks_partner[mi] : -1; /* regularized companion, provided by ks.h */
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      acc[i + k] = jerk[i + k] = 0;
+    }
+
+    /* loops over all particles, Newton's third law would need a second reduction */
+    for(int mj = 0; mj < N; ++mj)
+    {
+      int j = mj * DIM;
+
+      if(mj == mi || mj == partner)
+      {
+        continue;
+      }
+
+      double complex rji[DIM], vji[DIM]; /* position and velocity vector from particle i to j */
+      double complex r2 = 0.0; /* rij^2 */
+      double complex rv = 0.0; /* rij*vij */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        rji[k] = pos[j + k] - pos[i + k];
+        vji[k] = vel[j + k] - vel[i + k];
+
+        r2 += rji[k] * rji[k];
+        rv += rji[k] * vji[k];
+      }
+
+      double complex r3 = csqrt(r2) * r2; /* |rij| * rij^2 */
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        acc[i + k] += mass[mj] * rji[k] / r3;
+        jerk[i + k] += mass[mj] * (vji[k] - 3 * (rv / r2) * rji[k]) / r3;
+      }
+    }
+  }
+
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, acc, counts, displs, MPI_C_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, jerk, counts, displs, MPI_C_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+}
+
+#endif // USE_MPI
@@ -0,0 +1,17 @@
+#ifndef MPIENGINE_H_
+#define MPIENGINE_H_
+
+#include <stddef.h>
+
+size_t mpi_engine_bytes(void);
+
+void initMPIEngine(int N, int DIM, int grid);
+
+void acc_mpi(int N, int DIM, double *mass, double complex *pos, double complex *acc);
+
+void acc_jerk_mpi(int N, int DIM, double *mass, double complex *pos, double complex *vel,
+                  double complex *acc, double complex *jerk);
+
+void freeMPIEngine(void);
+
+#endif // MPIENGINE_H_
@@ -1,6 +1,8 @@
 /*    
     The following source code provides methods for writing initial conditions,
     important information and iterations of the computation to *.txt or *.csv files.
+    Particles are written to *.csv files by formatting many lines into a large
+    buffer, which is written at once, see dtoa.c.
     
     Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
     
@@ -19,8 +21,11 @@
 */
 
 #include <complex.h>
+#include "engine.h"
 #include "output.h"
 #include <stdio.h>
+#include "dtoa.h"
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <time.h>
@@ -30,6 +35,15 @@ char foldername[40]; /* buffer for name of folder */
 char logname[80]; /* buffer for name of log file */
 char conditionsname[80]; /* buffer for name of intial conditions file */
 char ediagname[80]; /* buffer for name of energy diagnostics file */
+char cdiagname[80]; /* buffer for name of cluster diagnostics file */
+
+#define CHUNK 65536 /* bytes of text formatted before they are written at once */
+#define ROW (7 * (DTOA_MAX + 2)) /* longest line of particles */
+
+static int csv_digits = 0; /* significant digits of particles in *.csv files, zero for shortest round-trip */
+
+static FILE *ediag = NULL; /* energy diagnostics file, open during the run */
+static FILE *cdiag = NULL; /* cluster diagnostics file, open during the run */
 
 /*
  * Function:  createNames 
@@ -52,6 +66,7 @@ void createNames()
   strftime (logname, sizeof(logname), "run_%Y_%m_%d_%H:%M:%S/log_%Y_%m_%d_%H:%M:%S.txt", sTm);
   strftime (conditionsname, sizeof(conditionsname), "run_%Y_%m_%d_%H:%M:%S/initial_conditions.csv", sTm);
   strftime (ediagname, sizeof(ediagname), "run_%Y_%m_%d_%H:%M:%S/energy_diagnostics.csv", sTm);
+  strftime (cdiagname, sizeof(cdiagname), "run_%Y_%m_%d_%H:%M:%S/cluster_diagnostics.csv", sTm);
 
   struct stat st = {0};
 
@@ -61,6 +76,71 @@ void createNames()
   }
 }
 
+/*
+ * Function:  restoreNames 
+ * ====================
+ *  Creates the names of all files of a run which is continued from a
+ *  checkpoint, the output is appended to the files of that run.
+ *
+ *  folder: folder of the run, named after its start
+ *
+ *  returns: void
+ * --------------------
+ */
+void restoreNames(const char *folder)
+{
+  const char *started = folder + 4; /* date and time after "run_" */
+
+  snprintf(foldername, sizeof(foldername), "%s", folder);
+  snprintf(logname, sizeof(logname), "%s/log_%s.txt", folder, started);
+  snprintf(conditionsname, sizeof(conditionsname), "%s/initial_conditions.csv", folder);
+  snprintf(ediagname, sizeof(ediagname), "%s/energy_diagnostics.csv", folder);
+  snprintf(cdiagname, sizeof(cdiagname), "%s/cluster_diagnostics.csv", folder);
+}
+
+/*
+ * Function:  setDigits 
+ * ====================
+ *  Sets the significant digits of particles in *.csv files.
+ *
+ *  digits: significant digits, zero for the shortest digits reading back exactly
+ *
+ *  returns: void
+ * --------------------
+ */
+void setDigits(int digits)
+{
+  csv_digits = digits;
+}
+
+/*
+ * Function:  format_row 
+ * ====================
+ *  Formats one line of a *.csv file.
+ *
+ *  out: buffer of at least ROW characters
+ *  values: values of the line
+ *  count: amount of values, at most 7
+ *
+ *  returns: end of the line within the buffer
+ * --------------------
+ */
+static char *format_row(char *out, const double *values, int count)
+{
+  for(int v = 0; v < count; ++v)
+  {
+    out += format_double(values[v], csv_digits, out); /* provided by dtoa.h */
+    *out++ = ',';
+    *out++ = ' ';
+  }
+
+  /* the last value is followed by " \n" instead */
+  out[-2] = ' ';
+  out[-1] = '\n';
+
+  return out;
+}
+
 /*
  * Function:  printInitialConditions 
  * ====================
@@ -79,14 +159,25 @@ void printInitialConditions(int N, int DIM, double *mass, double complex *pos, d
 { 
   FILE *conditions;
   conditions = fopen(conditionsname, "w");
+  setvbuf(conditions, NULL, _IONBF, 0); /* chunks are written directly */
+
+  char chunk[CHUNK];
+  char *end = chunk;
 
   for(int i = 0, mi = 0; i < (N * DIM); i += 3, ++mi)
   {     
-    fprintf(conditions, "%f, %f, %f, %f, %f, %f, %f \n",
-            creal(pos[i]), creal(pos[i + 1]), creal(pos[i + 2]), mass[mi], 
-            creal(vel[i]), creal(vel[i + 1]), creal(vel[i + 2]));
+    double row[7] = {creal(pos[i]), creal(pos[i + 1]), creal(pos[i + 2]), mass[mi], 
+                     creal(vel[i]), creal(vel[i + 1]), creal(vel[i + 2])};
+    end = format_row(end, row, 7);
+
+    if(end - chunk > CHUNK - ROW)
+    {
+      fwrite(chunk, 1, end - chunk, conditions);
+      end = chunk;
+    }
   }
 
+  fwrite(chunk, 1, end - chunk, conditions);
   fclose(conditions);
 }
 
@@ -103,17 +194,99 @@ void printInitialConditions(int N, int DIM, double *mass, double complex *pos, d
  *  G: gravitational constant
  *  dt: timestep
  *  end_time: end of simulation
+ *  integrator: name of the integrator
+ *  pec: evaluation and correction passes per step
+ *  engine: name of the force engine
+ *  pm_grid: cells per dimension of the mesh, zero if the engine uses no mesh
+ *  ks_radius: separation below which pairs are regularized
+ *  pages: pages backing the particle arrays
+ *  reorder_steps: steps between reordering the particles, zero if disabled
+ *  curve: name of the space-filling curve
+ *  diag_every: steps between energy diagnostics
+ *  diag_dt: time between energy diagnostics, zero if selected by steps
+ *  potential_samples: sampled particles per estimate of the potential energy, zero if exact
+ *  potential_exact: diagnostics between exact potential energies while sampling
+ *  output: format of the snapshots
  *
  *  returns: void
  * --------------------
  */
-void printLog(unsigned long seed, int N, double M, double R, double G, double timestep, double end_time)
+void printLog(unsigned long seed, int N, double M, double R, double G, double timestep, double end_time, 
+              const char *integrator, int pec, const char *engine, int pm_grid, double ks_radius,
+              const char *pages, int reorder_steps, const char *curve,
+              int diag_every, double diag_dt, int potential_samples, int potential_exact, const char *output)
 {
   FILE *log;
   log = fopen(logname, "w"); /* writes to new file log_<currentdate>.txt which holds important parameters */
 
   fprintf(log, "Seed used: %lu \nNumber of particles: %d \n\nTotal mass of cluster: %f \nDimensions of cluster: %f \nGravitational constant: %f \n\nTimestep: %f \nEndtime: %f \n", 
           seed, N, M, R, G, timestep, end_time);
+  
+  fprintf(log, "Integrator: %s, P(EC)^%d \nForce engine: %s \nProcesses: %d \nPages: %s \n", integrator, pec, engine, world_size, pages);
+  
+  if(pm_grid > 0)
+  {
+    fprintf(log, "Mesh: %d^3 \n", pm_grid);
+  }
+  
+  if(ks_radius > 0)
+  {
+    fprintf(log, "KS regularization radius: %f \n", ks_radius);
+  }
+  
+  if(reorder_steps > 0)
+  {
+    fprintf(log, "Reordering: every %d steps along the %s curve \n", reorder_steps, curve);
+  }
+
+  if(diag_dt > 0)
+  {
+    fprintf(log, "Diagnostics: every %f time units \n", diag_dt);
+  }
+  else
+  {
+    fprintf(log, "Diagnostics: every %d steps \n", diag_every);
+  }
+
+  if(potential_samples > 0)
+  {
+    fprintf(log, "Potential energy: sampled from %d particles, exact every %d diagnostics \n", potential_samples, potential_exact);
+  }
+
+  fprintf(log, "Output: %s \n", output);
+
+  if(csv_digits > 0)
+  {
+    fprintf(log, "Particles in *.csv files: %d significant digits \n", csv_digits);
+  }
+  else
+  {
+    fprintf(log, "Particles in *.csv files: shortest round-trip digits \n");
+  }
+
+  fclose(log);
+}
+
+/*
+ * Function:  printRestart 
+ * ====================
+ *  Appends a note to the log file of a run which is continued from
+ *  a checkpoint.
+ *
+ *  iteration: iteration of the checkpoint
+ *  time: time of the checkpoint
+ *  end_time: end of simulation, which may differ from the first start
+ *
+ *  returns: void
+ * --------------------
+ */
+void printRestart(long iteration, double time, double end_time)
+{
+  FILE *log;
+  log = fopen(logname, "a");
+
+  fprintf(log, "\nRestarted from checkpoint at iteration %ld, time %f \nEndtime: %f \nProcesses: %d \n", 
+          iteration, time, end_time, world_size);
 
   fclose(log);
 }
@@ -121,32 +294,150 @@ void printLog(unsigned long seed, int N, double M, double R, double G, double ti
 /*
  * Function:  printEnergyDiagnostics 
  * ====================
- *  Either creates a new file to hold the energy diagnostics and prints
- *  them to it, or appends energy diagnostics to already existing file.
+ *  Creates a new file to hold the energy diagnostics on the first
+ *  call and appends the energy diagnostics of one iteration to it.
+ *  The file stays open until closeEnergyDiagnostics is called.
  *
+ *  iteration: iteration the diagnostics belong to
+ *  time: time of the iteration
  *  e_kinetic: kinetic energy of cluster
  *  e_potential: potential energy of cluster
  *  e_total: total energy of cluster
+ *  method: exact or sampled potential energy
+ *  error: half width of the 95% confidence interval of a sampled potential energy, zero if exact
  *
  *  returns: void
  * --------------------
  */
-void printEnergyDiagnostics(double e_kinetic, double e_potential, double e_total)
+void printEnergyDiagnostics(int iteration, double time, double e_kinetic, double e_potential, double e_total,
+                            const char *method, double error)
 {
-  FILE *ediag;
+  if(ediag == NULL)
+  {
+    ediag = fopen(ediagname, "w");
+  }
   
-  if(access(ediagname, F_OK) != -1)
+  fprintf(ediag, "%d, %f, %f, %f, %f, %s, %e \n", iteration, time, e_kinetic, e_potential, e_total, method, error);
+}
+
+/*
+ * Function:  closeEnergyDiagnostics 
+ * ====================
+ *  Closes the energy diagnostics file.
+ *
+ *  returns: void
+ * --------------------
+ */
+void closeEnergyDiagnostics()
+{
+  if(ediag != NULL)
+  {
+    fclose(ediag);
+    ediag = NULL;
+  }
+}
+
+/*
+ * Function:  syncDiagnostics 
+ * ====================
+ *  Writes everything printed to the energy and cluster diagnostics
+ *  files so far, called before a checkpoint is written.
+ *
+ *  energy: set to the size of the energy diagnostics file
+ *  cluster: set to the size of the cluster diagnostics file
+ *
+ *  returns: void
+ * --------------------
+ */
+void syncDiagnostics(long *energy, long *cluster)
+{
+  *energy = *cluster = 0;
+
+  if(ediag != NULL)
   {
-    ediag = fopen(ediagname, "a");
-    fprintf(ediag, "%f, %f, %f \n", e_kinetic, e_potential, e_total);
-  } 
-  else 
+    fflush(ediag);
+    *energy = ftell(ediag);
+  }
+
+  if(cdiag != NULL)
   {
-    ediag = fopen(ediagname, "w");
-    fprintf(ediag, "%f, %f, %f \n", e_kinetic, e_potential, e_total);
+    fflush(cdiag);
+    *cluster = ftell(cdiag);
+  }
+}
+
+/*
+ * Function:  resumeDiagnostics 
+ * ====================
+ *  Opens the energy and cluster diagnostics files of a run which is 
+ *  continued from a checkpoint, lines printed after the checkpoint
+ *  are removed and the following ones appended.
+ *
+ *  energy: size of the energy diagnostics file at the checkpoint
+ *  cluster: size of the cluster diagnostics file at the checkpoint
+ *
+ *  returns: void
+ * --------------------
+ */
+void resumeDiagnostics(long energy, long cluster)
+{
+  ediag = fopen(ediagname, "a");
+  cdiag = fopen(cdiagname, "a");
+
+  if(ediag == NULL || cdiag == NULL || ftruncate(fileno(ediag), energy) != 0 || ftruncate(fileno(cdiag), cluster) != 0)
+  {
+    fprintf(stderr, "Unable to continue the diagnostics files!\n");
+    exit(0);
+  }
+}
+
+/*
+ * Function:  printClusterDiagnostics 
+ * ====================
+ *  Creates a new file to hold the cluster diagnostics on the first
+ *  call and appends the cluster diagnostics of one iteration to it.
+ *  The file stays open until closeClusterDiagnostics is called.
+ *
+ *  iteration: iteration the diagnostics belong to
+ *  time: time of the iteration
+ *  values: diagnostics of the cluster, in the order of the columns
+ *  count: amount of values
+ *
+ *  returns: void
+ * --------------------
+ */
+void printClusterDiagnostics(int iteration, double time, const double *values, int count)
+{
+  if(cdiag == NULL)
+  {
+    cdiag = fopen(cdiagname, "w");
+  }
+  
+  fprintf(cdiag, "%d, %f", iteration, time);
+  
+  for(int v = 0; v < count; ++v)
+  {
+    fprintf(cdiag, ", %e", values[v]);
   }
   
-  fclose(ediag);
+  fprintf(cdiag, "\n");
+}
+
+/*
+ * Function:  closeClusterDiagnostics 
+ * ====================
+ *  Closes the cluster diagnostics file.
+ *
+ *  returns: void
+ * --------------------
+ */
+void closeClusterDiagnostics()
+{
+  if(cdiag != NULL)
+  {
+    fclose(cdiag);
+    cdiag = NULL;
+  }
 }
 
 /*
@@ -157,27 +448,39 @@ void printEnergyDiagnostics(double e_kinetic, double e_potential, double e_total
  *  N: amount of particles
  *  DIM: dimensions of space
  *  iteration: current iteration
- *  mass: masses of all particles
- *  pos: positions of all particles
- *  vel: velocity of all particles
+ *  mass: masses of all particles, in the order of their IDs
+ *  pos: positions of all particles, in the order of their IDs
+ *  vel: velocity of all particles, in the order of their IDs
  *
  *  returns: void
  * --------------------
  */
-void printIteration(int N, int DIM, int iteration, double *mass, double complex *pos, double complex *vel)
+void printIteration(int N, int DIM, int iteration, const double *mass, const double *pos, const double *vel)
 {
   char buffer[80];
   snprintf(buffer, sizeof(buffer), "./%s/iteration_%d.csv", foldername, iteration);
   
   FILE *out;
   out = fopen(buffer, "w");
+  setvbuf(out, NULL, _IONBF, 0); /* chunks are written directly */
   
-  for(int i = 0, mi = 0; i < (N * DIM); i += 3, ++mi)
+  char chunk[CHUNK];
+  char *end = chunk;
+  
+  for(int mi = 0; mi < N; ++mi)
   {
-    fprintf(out, "%f, %f, %f, %f, %f, %f, %f \n", 
-            creal(pos[i]), creal(pos[i + 1]), creal(pos[i + 2]), mass[mi], 
-            creal(vel[i]), creal(vel[i + 1]), creal(vel[i + 2]));
+    int i = mi * DIM;
+    double row[7] = {pos[i], pos[i + 1], pos[i + 2], mass[mi], vel[i], vel[i + 1], vel[i + 2]};
+    
+    end = format_row(end, row, 7);
+    
+    if(end - chunk > CHUNK - ROW)
+    {
+      fwrite(chunk, 1, end - chunk, out);
+      end = chunk;
+    }
   }
   
+  fwrite(chunk, 1, end - chunk, out);
   fclose(out);
 }
@@ -1,14 +1,36 @@
 #ifndef OUTPUT_H_
 #define OUTPUT_H_
 
+extern char foldername[40]; /* folder of the current run */
+
 void createNames(void);
 
+void restoreNames(const char *folder);
+
+void setDigits(int digits);
+
 void printInitialConditions(int N, int DIM, double *mass, double complex *pos, double complex *vel);
 
-void printLog(unsigned long seed, int N, double M, double R, double G, double timestep, double end_time);
+void printLog(unsigned long seed, int N, double M, double R, double G, double timestep, double end_time, 
+              const char *integrator, int pec, const char *engine, int pm_grid, double ks_radius,
+              const char *pages, int reorder_steps, const char *curve,
+              int diag_every, double diag_dt, int potential_samples, int potential_exact, const char *output);
+
+void printRestart(long iteration, double time, double end_time);
+
+void printEnergyDiagnostics(int iteration, double time, double e_kinetic, double e_potential, double e_total,
+                            const char *method, double error);
+
+void closeEnergyDiagnostics(void);
+
+void syncDiagnostics(long *energy, long *cluster);
+
+void resumeDiagnostics(long energy, long cluster);
+
+void printClusterDiagnostics(int iteration, double time, const double *values, int count);
 
-void printEnergyDiagnostics(double e_kinetic, double e_potential, double e_total);
+void closeClusterDiagnostics(void);
 
-void printIteration(int N, int DIM, int iteration, double *mass, double complex *pos, double complex *vel);
+void printIteration(int N, int DIM, int iteration, const double *mass, const double *pos, const double *vel);
 
 #endif // OUTPUT_H_
@@ -23,6 +23,9 @@
 #include <math.h>
 #include "mersenne.h"
 #include "plummer.h"
+#include "reduce.h"
+#include <stdlib.h>
+#include "workspace.h"
 
 /* factor for scaling to standard units (Heggie units) */
 static const double scale = 16.0 / (3.0 * 3.14159265359);
@@ -126,11 +129,26 @@ void plummer(int N, double *mass, double complex *pos, double complex *vel, int
   vel[i + 2] = (velocity * ccos(theta)) * csqrt(scale);
 }
 
+/*
+ * Function:  plummer_bytes
+ * ====================
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *
+ *  returns: size of the partial sums center_of_mass_adjustment takes from the workspace
+ * --------------------
+ */
+size_t plummer_bytes(int N, int DIM)
+{
+  return workspace_bytes((size_t) 2 * DIM * reduce_blocks(N), sizeof(double)); /* provided by workspace.h */
+}
+
 /*
  * Function:  center_of_mass_adjustment 
  * ====================
  *  Calculates center of mass for the whole cluster and adjusts
- *  position and velocity of all particles towards it.
+ *  position and velocity of all particles towards it. The sums are
+ *  reproducible, independent of the amount of threads.
  *
  *  N: amount of particles
  *  DIM: dimensions of space
@@ -143,26 +161,47 @@ void plummer(int N, double *mass, double complex *pos, double complex *vel, int
  */
 void center_of_mass_adjustment(int N, int DIM, double *mass, double complex *pos, double complex *vel)
 {
-  double complex pos_center[3] = {0, 0, 0}; /* position of center of mass */
-  double complex vel_center[3] = {0, 0, 0}; /* velocity of center of mass */
+  int blocks = reduce_blocks(N); /* provided by reduce.h */
+  double *partials = workspace_alloc((size_t) 2 * DIM * blocks, sizeof(double)); /* provided by workspace.h */
+  double pos_center[DIM], vel_center[DIM]; /* position and velocity of center of mass */
   
-  /* measuring position and velocity of center of mass */
-  for(int i = 0, mi = 0; i < (N * DIM); i += 3, ++mi) 
+  /* measuring position and velocity of center of mass, block by block */
+  #pragma omp parallel for
+  for(int b = 0; b < blocks; ++b)
   {
+    int end = (b + 1) * REDUCE_BLOCK < N ? (b + 1) * REDUCE_BLOCK : N;
+    
     for(int j = 0; j < DIM; ++j)
     {
-      pos_center[j] += pos[i + j] * mass[mi];
-      vel_center[j] += vel[i + j] * mass[mi];
+      double pos_sum = 0.0, vel_sum = 0.0;
+      
+      for(int mi = b * REDUCE_BLOCK; mi < end; ++mi)
+      {
+        pos_sum += creal(pos[mi * DIM + j]) * mass[mi];
+        vel_sum += creal(vel[mi * DIM + j]) * mass[mi];
+      }
+      
+      partials[j * blocks + b] = pos_sum;
+      partials[(DIM + j) * blocks + b] = vel_sum;
     }
   }
   
+  for(int j = 0; j < DIM; ++j)
+  {
+    pos_center[j] = reduce_tree(partials + j * blocks, blocks);
+    vel_center[j] = reduce_tree(partials + (DIM + j) * blocks, blocks);
+  }
+  
+  workspace_free(partials);
+  
   /* subtracting position and velocity of center of mass from each particle */
-  for(int k = 0; k < (N * DIM); k += 3) 
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
   {
     for(int l = 0; l < DIM; ++l)
     {
-      pos[k + l] -= pos_center[l];
-      vel[k + l] -= vel_center[l];
+      pos[mi * DIM + l] -= pos_center[l];
+      vel[mi * DIM + l] -= vel_center[l];
     }
   }
 }
@@ -1,10 +1,14 @@
 #ifndef PLUMMER_H_
 #define PLUMMER_H_
 
+#include <stddef.h>
+
 double rrand(double low, double high);
 
 void plummer(int N, double *mass, double complex *pos, double complex *vel, int i, int mi, double M, double R);
 
+size_t plummer_bytes(int N, int DIM);
+
 void center_of_mass_adjustment(int N, int DIM, double *mass, double complex *pos, double complex *vel);
 
 void startPlummer(unsigned long s, int N, int DIM, double *mass, double complex *pos, double complex *vel, 
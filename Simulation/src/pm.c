@@ -0,0 +1,1243 @@
+/*
+    The following source-code is an implementation of a particle-particle/
+    particle-mesh (P3M) force calculation for isolated systems. Masses are
+    assigned to a zero padded grid (Hockney & Eastwood, 1988), the Poisson
+    equation is solved with an in-tree FFT and forces are interpolated back
+    to the particles. P3M splits the interaction with a Gaussian kernel, the
+    long-range part is calculated on the grid and the short-range part
+    within a cutoff is added directly. PM calculates the whole interaction
+    on the grid, softened over about one cell.
+    The grid covers most of the particles, the few outside of it only feel
+    the grid as a point mass. The FFT is distributed with a slab
+    decomposition when compiled with MPI. All sums are formed in a fixed
+    order, so the forces do not depend on the timing of the threads.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include <math.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "engine.h"
+#include "pm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include "reduce.h"
+#include "workspace.h"
+
+#define PI 3.14159265358979323846
+#define MAX_CELLS 128 /* upper bound for cells per dimension of the short-range search */
+#define SAMPLES  4096 /* particles sampled to estimate the extent of the system */
+#define QUANTILE 0.99 /* fraction of sampled particles which has to fit on the grid */
+#define TABLE    4096 /* entries of the short-range force table */
+
+static int ng; /* cells per dimension covering the particles */
+static int n; /* cells per dimension of the zero padded grid */
+static int nx_local, ny_local; /* planes per process before and after transposition */
+
+static double complex *slab; /* padded grid, local x planes [x][y][z] */
+static double complex *trans; /* padded grid, local y planes [y][x][z] */
+static double *green; /* Green's function in Fourier space, layout of trans */
+static double *mesh; /* mass and potential on the unpadded grid */
+static double *mesh_local; /* local x planes of the unpadded grid */
+static double complex *twiddle; /* roots of unity */
+static double complex *lines; /* one line of scratch per thread */
+
+static int *cell_start, *cell_index, *particle_cell; /* particles sorted by short-range cells */
+static int nc; /* cells per dimension of the short-range search */
+
+static int *counts, *displs; /* planes and particles per process */
+static double *radii; /* sampled distances from the center of mass */
+static double *partials; /* partial sums of mass and mass weighted positions, block by block */
+
+static double origin[3]; /* position of grid point zero */
+static double box[4]; /* center and radius of the sphere the grid was placed around, zero radius if none */
+static double h = 0.0; /* cell size, zero if no grid has been set up */
+static int split = 1; /* nonzero if the grid only holds the long-range part (P3M) */
+static double r_s, r_cut; /* splitting scale and cutoff of the short-range force */
+static double softening; /* softening length of the whole interaction on the grid (PM) */
+static double table[TABLE + 2]; /* short-range factor over squared separation in units of the cutoff */
+
+static void restore_box(void);
+
+/*
+ * Function:  thread_id
+ * ====================
+ *  returns: number of the calling thread, zero without OpenMP
+ * --------------------
+ */
+static int thread_id()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Function:  thread_count
+ * ====================
+ *  returns: amount of threads of the enclosing parallel region, one without OpenMP
+ * --------------------
+ */
+static int thread_count()
+{
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+/*
+ * Function:  pm_bytes
+ * ====================
+ *  N: amount of particles
+ *  grid: cells per dimension, has to be a power of two
+ *
+ *  returns: size of all arrays initPM and initP3M take from the workspace
+ * --------------------
+ */
+size_t pm_bytes(int N, int grid)
+{
+  int threads = 1;
+
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  size_t padded = 2 * (size_t) grid;
+  size_t local = padded / world_size * padded * padded;
+
+  return 2 * workspace_bytes(local, sizeof(double complex)) + workspace_bytes(local, sizeof(double)) /* provided by workspace.h */
+         + workspace_bytes((size_t) grid * grid * grid, sizeof(double))
+         + ((world_size > 1) ? workspace_bytes(padded / world_size * grid * grid, sizeof(double)) : 0)
+         + workspace_bytes(padded / 2, sizeof(double complex)) + workspace_bytes(threads * padded, sizeof(double complex))
+         + workspace_bytes(MAX_CELLS * MAX_CELLS * MAX_CELLS + 1, sizeof(int)) + 2 * workspace_bytes(N, sizeof(int))
+         + 2 * workspace_bytes(world_size, sizeof(int)) + workspace_bytes(SAMPLES, sizeof(double))
+         + workspace_bytes((size_t) 4 * reduce_blocks(N), sizeof(double)); /* provided by reduce.h */
+}
+
+/*
+ * Function:  init_mesh
+ * ====================
+ *  Allocates the grids for the mesh force calculation.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space, has to be three
+ *  grid: cells per dimension, has to be a power of two
+ *
+ *  returns: void
+ * --------------------
+ */
+static void init_mesh(int N, int DIM, int grid)
+{
+  int threads = 1;
+
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  if(DIM != 3)
+  {
+    fprintf(stderr, "The mesh is only implemented for three dimensions!\n");
+    exit(0);
+  }
+
+  ng = grid;
+  n = 2 * grid;
+
+  if(n % world_size != 0)
+  {
+    fprintf(stderr, "Twice the PM grid size must be divisible by world size!\n");
+    exit(0);
+  }
+
+  nx_local = ny_local = n / world_size;
+
+  size_t local = (size_t) nx_local * n * n;
+
+  slab = workspace_alloc(local, sizeof(double complex)); /* provided by workspace.h */
+  trans = workspace_alloc(local, sizeof(double complex));
+  green = workspace_alloc(local, sizeof(double));
+  mesh = workspace_alloc((size_t) ng * ng * ng, sizeof(double));
+  mesh_local = (world_size > 1) ? workspace_alloc((size_t) nx_local * ng * ng, sizeof(double)) : mesh;
+  twiddle = workspace_alloc(n / 2, sizeof(double complex));
+  lines = workspace_alloc((size_t) threads * n, sizeof(double complex));
+
+  cell_start = workspace_alloc(MAX_CELLS * MAX_CELLS * MAX_CELLS + 1, sizeof(int));
+  cell_index = workspace_alloc(N, sizeof(int));
+  particle_cell = workspace_alloc(N, sizeof(int));
+
+  counts = workspace_alloc(world_size, sizeof(int));
+  displs = workspace_alloc(world_size, sizeof(int));
+  radii = workspace_alloc(SAMPLES, sizeof(double));
+  partials = workspace_alloc((size_t) 4 * reduce_blocks(N), sizeof(double)); /* provided by reduce.h */
+
+  for(int k = 0; k < n / 2; ++k)
+  {
+    twiddle[k] = cexp(-2.0 * PI * I * k / n);
+  }
+
+  h = 0.0;
+  box[3] = 0.0;
+
+  /* the grid only moves if the particles leave it, so its place is part of the state */
+  checkpoint_value("pm_box", box, sizeof(box)); /* provided by checkpoint.h */
+  checkpoint_hooks(NULL, restore_box);
+}
+
+/*
+ * Function:  initPM
+ * ====================
+ *  Allocates the grids for the whole interaction on the mesh.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space, has to be three
+ *  grid: cells per dimension, has to be a power of two
+ *
+ *  returns: void
+ * --------------------
+ */
+void initPM(int N, int DIM, int grid)
+{
+  split = 0;
+  init_mesh(N, DIM, grid);
+}
+
+/*
+ * Function:  initP3M
+ * ====================
+ *  Allocates the grids for the long-range part of the interaction on
+ *  the mesh and the chaining mesh of the short-range part.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space, has to be three
+ *  grid: cells per dimension, has to be a power of two
+ *
+ *  returns: void
+ * --------------------
+ */
+void initP3M(int N, int DIM, int grid)
+{
+  split = 1;
+  init_mesh(N, DIM, grid);
+}
+
+/*
+ * Function:  freePM
+ * ====================
+ *  Frees all memory allocated by initPM.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freePM()
+{
+  if(mesh_local != mesh)
+  {
+    workspace_free(mesh_local);
+  }
+
+  workspace_free(slab);
+  workspace_free(trans);
+  workspace_free(green);
+  workspace_free(mesh);
+  workspace_free(twiddle);
+  workspace_free(lines);
+  workspace_free(cell_start);
+  workspace_free(cell_index);
+  workspace_free(particle_cell);
+  workspace_free(counts);
+  workspace_free(displs);
+  workspace_free(radii);
+  workspace_free(partials);
+}
+
+/*
+ * Function:  fft_line
+ * ====================
+ *  Iterative radix-2 FFT of one contiguous line of the padded grid.
+ *
+ *  x: line of length n
+ *  inverse: nonzero for the (unnormalized) inverse transform
+ *
+ *  returns: void
+ * --------------------
+ */
+static void fft_line(double complex *x, int inverse)
+{
+  /* bit reversal permutation */
+  for(int i = 1, j = 0; i < n; ++i)
+  {
+    int bit = n >> 1;
+
+    for(; j & bit; bit >>= 1)
+    {
+      j ^= bit;
+    }
+
+    j ^= bit;
+
+    if(i < j)
+    {
+      double complex tmp = x[i];
+      x[i] = x[j];
+      x[j] = tmp;
+    }
+  }
+
+  /* butterflies */
+  for(int len = 2; len <= n; len <<= 1)
+  {
+    int step = n / len;
+
+    for(int i = 0; i < n; i += len)
+    {
+      for(int k = 0; k < len / 2; ++k)
+      {
+        double complex w = inverse ? conj(twiddle[k * step]) : twiddle[k * step];
+        double complex u = x[i + k];
+        double complex v = x[i + k + len / 2] * w;
+
+        x[i + k] = u + v;
+        x[i + k + len / 2] = u - v;
+      }
+    }
+  }
+}
+
+/*
+ * Function:  fft_strided
+ * ====================
+ *  FFT of one line of the padded grid with arbitrary stride,
+ *  the line is copied to a contiguous buffer first.
+ *
+ *  x: first element of the line
+ *  stride: distance between elements of the line
+ *  line: scratch of length n
+ *  inverse: nonzero for the (unnormalized) inverse transform
+ *
+ *  returns: void
+ * --------------------
+ */
+static void fft_strided(double complex *x, size_t stride, double complex *line, int inverse)
+{
+  for(int k = 0; k < n; ++k)
+  {
+    line[k] = x[k * stride];
+  }
+
+  fft_line(line, inverse);
+
+  for(int k = 0; k < n; ++k)
+  {
+    x[k * stride] = line[k];
+  }
+}
+
+/*
+ * Function:  transpose
+ * ====================
+ *  Redistributes the padded grid between x planes (slab) and
+ *  y planes (trans). With several processes blocks are exchanged
+ *  with MPI_Alltoall, the source grid is used as buffer.
+ *
+ *  forward: nonzero for slab to trans, zero for trans to slab
+ *
+ *  returns: void
+ * --------------------
+ */
+static void transpose(int forward)
+{
+  if(world_size == 1)
+  {
+    #pragma omp parallel for
+    for(int y = 0; y < n; ++y)
+    {
+      for(int x = 0; x < n; ++x)
+      {
+        for(int z = 0; z < n; ++z)
+        {
+          if(forward)
+          {
+            trans[((size_t) y * n + x) * n + z] = slab[((size_t) x * n + y) * n + z];
+          }
+          else
+          {
+            slab[((size_t) x * n + y) * n + z] = trans[((size_t) y * n + x) * n + z];
+          }
+        }
+      }
+    }
+
+    return;
+  }
+
+#ifdef USE_MPI
+  size_t block = (size_t) nx_local * ny_local * n;
+  double complex *src = forward ? slab : trans;
+  double complex *dst = forward ? trans : slab;
+
+  /* pack blocks for every process into the destination, which is unused at this point */
+  #pragma omp parallel for
+  for(int q = 0; q < world_size; ++q)
+  {
+    for(int a = 0; a < nx_local; ++a)
+    {
+      for(int b = 0; b < ny_local; ++b)
+      {
+        for(int z = 0; z < n; ++z)
+        {
+          /* forward: a is the local x plane, b the y plane of process q and vice versa */
+          size_t from = forward ? ((size_t) a * n + q * ny_local + b) * n + z
+                                : ((size_t) b * n + q * nx_local + a) * n + z;
+
+          dst[q * block + ((size_t) a * ny_local + b) * n + z] = src[from];
+        }
+      }
+    }
+  }
+
+  MPI_Alltoall(dst, block, MPI_C_DOUBLE_COMPLEX, src, block, MPI_C_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+
+  /* unpack blocks received from every process */
+  #pragma omp parallel for
+  for(int p = 0; p < world_size; ++p)
+  {
+    for(int a = 0; a < nx_local; ++a)
+    {
+      for(int b = 0; b < ny_local; ++b)
+      {
+        for(int z = 0; z < n; ++z)
+        {
+          size_t to = forward ? ((size_t) b * n + p * nx_local + a) * n + z
+                              : ((size_t) a * n + p * ny_local + b) * n + z;
+
+          dst[to] = src[p * block + ((size_t) a * ny_local + b) * n + z];
+        }
+      }
+    }
+  }
+#endif
+}
+
+/*
+ * Function:  fft_forward
+ * ====================
+ *  Three-dimensional FFT of the padded grid, from slab to trans.
+ *
+ *  padded: nonzero to skip lines which only contain zero padding
+ *
+ *  returns: void
+ * --------------------
+ */
+static void fft_forward(int padded)
+{
+  #pragma omp parallel
+  {
+    double complex *line = lines + (size_t) thread_id() * n;
+
+    /* along z, lines are contiguous */
+    #pragma omp for schedule(static)
+    for(int l = 0; l < nx_local * n; ++l)
+    {
+      int x = world_rank * nx_local + l / n;
+
+      if(!padded || (x < ng && l % n < ng))
+      {
+        fft_line(slab + (size_t) l * n, 0);
+      }
+    }
+
+    /* along y */
+    #pragma omp for schedule(static)
+    for(int l = 0; l < nx_local * n; ++l)
+    {
+      int x = world_rank * nx_local + l / n;
+
+      if(!padded || x < ng)
+      {
+        fft_strided(slab + (size_t) (l / n) * n * n + l % n, n, line, 0);
+      }
+    }
+  }
+
+  transpose(1);
+
+  /* along x */
+  #pragma omp parallel
+  {
+    double complex *line = lines + (size_t) thread_id() * n;
+
+    #pragma omp for schedule(static)
+    for(int l = 0; l < ny_local * n; ++l)
+    {
+      fft_strided(trans + (size_t) (l / n) * n * n + l % n, n, line, 0);
+    }
+  }
+}
+
+/*
+ * Function:  fft_inverse
+ * ====================
+ *  Unnormalized inverse three-dimensional FFT, from trans to slab.
+ *  Only lines which reach the unpadded grid are transformed.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void fft_inverse()
+{
+  /* along x */
+  #pragma omp parallel
+  {
+    double complex *line = lines + (size_t) thread_id() * n;
+
+    #pragma omp for schedule(static)
+    for(int l = 0; l < ny_local * n; ++l)
+    {
+      fft_strided(trans + (size_t) (l / n) * n * n + l % n, n, line, 1);
+    }
+  }
+
+  transpose(0);
+
+  #pragma omp parallel
+  {
+    double complex *line = lines + (size_t) thread_id() * n;
+
+    /* along y */
+    #pragma omp for schedule(static)
+    for(int l = 0; l < nx_local * n; ++l)
+    {
+      int x = world_rank * nx_local + l / n;
+
+      if(x < ng)
+      {
+        fft_strided(slab + (size_t) (l / n) * n * n + l % n, n, line, 1);
+      }
+    }
+
+    /* along z */
+    #pragma omp for schedule(static)
+    for(int l = 0; l < nx_local * n; ++l)
+    {
+      int x = world_rank * nx_local + l / n;
+
+      if(x < ng && l % n < ng)
+      {
+        fft_line(slab + (size_t) l * n, 1);
+      }
+    }
+  }
+}
+
+/*
+ * Function:  window
+ * ====================
+ *  Fourier transform of the cloud-in-cell assignment along one dimension.
+ *
+ *  k: index of the wave number
+ *
+ *  returns: sinc^2 of the signed wave number
+ * --------------------
+ */
+static double window(int k)
+{
+  int s = (k <= n / 2) ? k : k - n;
+
+  if(s == 0)
+  {
+    return 1.0;
+  }
+
+  double arg = PI * s / n;
+
+  return (sin(arg) / arg) * (sin(arg) / arg);
+}
+
+/*
+ * Function:  setup_green
+ * ====================
+ *  Calculates the Fourier transform of the potential of a unit mass on
+ *  the padded grid, deconvolved by the assignment and interpolation
+ *  window and normalized for the inverse FFT. P3M only takes the
+ *  long-range part of the split potential, PM the whole potential
+ *  softened over about one cell.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void setup_green()
+{
+  #pragma omp parallel for
+  for(int a = 0; a < nx_local; ++a)
+  {
+    int x = world_rank * nx_local + a;
+    int dx = (x <= n / 2) ? x : n - x;
+
+    for(int y = 0; y < n; ++y)
+    {
+      int dy = (y <= n / 2) ? y : n - y;
+
+      for(int z = 0; z < n; ++z)
+      {
+        int dz = (z <= n / 2) ? z : n - z;
+        double d = h * sqrt((double) (dx * dx + dy * dy + dz * dz));
+
+        if(split)
+        {
+          slab[((size_t) a * n + y) * n + z] = (d > 0) ? -erf(d / (2 * r_s)) / d : -1.0 / (r_s * sqrt(PI));
+        }
+        else
+        {
+          slab[((size_t) a * n + y) * n + z] = -1.0 / sqrt(d * d + softening * softening);
+        }
+      }
+    }
+  }
+
+  fft_forward(0);
+
+  double norm = (double) n * n * n;
+
+  #pragma omp parallel for
+  for(int b = 0; b < ny_local; ++b)
+  {
+    double wy = window(world_rank * ny_local + b);
+
+    for(int x = 0; x < n; ++x)
+    {
+      double wxy = wy * window(x);
+
+      for(int z = 0; z < n; ++z)
+      {
+        double w = wxy * window(z);
+        size_t idx = ((size_t) b * n + x) * n + z;
+
+        green[idx] = creal(trans[idx]) / (w * w * norm);
+      }
+    }
+  }
+}
+
+/*
+ * Function:  setup_box
+ * ====================
+ *  Places the grid around a sphere, leaving room for the interpolation
+ *  stencil, and recalculates everything that depends on the cell size.
+ *
+ *  center: center of the sphere
+ *  radius: radius of the sphere
+ *
+ *  returns: void
+ * --------------------
+ */
+static void setup_box(const double *center, double radius)
+{
+  for(int k = 0; k < 3; ++k)
+  {
+    box[k] = center[k];
+  }
+
+  box[3] = radius;
+
+  /* the sphere stays within cells 2 to ng - 4 while it grows by a quarter */
+  h = 2.5 * radius / (ng - 8);
+
+  for(int k = 0; k < 3; ++k)
+  {
+    origin[k] = center[k] - 0.5 * ng * h;
+  }
+
+  r_s = 1.25 * h;
+  r_cut = 4.5 * r_s;
+  softening = h;
+
+  /* tabulated to avoid erfc and exp in the pair loop, smooth in the squared separation */
+  for(int t = 0; t <= TABLE + 1; ++t)
+  {
+    double r = r_cut * sqrt((double) t / TABLE);
+    double u = r / (2 * r_s);
+
+    table[t] = erfc(u) + r / (r_s * sqrt(PI)) * exp(-u * u);
+  }
+
+  nc = (int) (ng * h / r_cut);
+  nc = (nc < 1) ? 1 : ((nc > MAX_CELLS) ? MAX_CELLS : nc);
+
+  setup_green();
+}
+
+/*
+ * Function:  restore_box
+ * ====================
+ *  Checkpoint hook, places the grid where it was at the checkpoint.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void restore_box()
+{
+  if(box[3] > 0)
+  {
+    setup_box(box, box[3]);
+  }
+  else
+  {
+    h = 0.0;
+  }
+}
+
+/*
+ * Function:  on_mesh
+ * ====================
+ *  Checks wether the interpolation stencil of a particle fits on the grid.
+ *
+ *  x: position of the particle
+ *
+ *  returns: nonzero if the particle is on the grid
+ * --------------------
+ */
+static int on_mesh(const double complex *x)
+{
+  for(int k = 0; k < 3; ++k)
+  {
+    double g = (creal(x[k]) - origin[k]) / h;
+
+    if(!(g >= 2 && g < ng - 4))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Function:  compare
+ * ====================
+ *  Compares two doubles for qsort.
+ *
+ *  returns: negative, zero or positive
+ * --------------------
+ */
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * Function:  short_range_forces
+ * ====================
+ *  Adds the short-range part of the pairwise forces within the cutoff
+ *  to the local particles, neighbours are found with a chaining mesh.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *  first: first local particle
+ *  last: one past the last local particle
+ *
+ *  returns: void
+ * --------------------
+ */
+static void short_range_forces(int N, int DIM, double *mass, double complex *pos, double complex *acc,
+                               int first, int last)
+{
+  double size = ng * h / nc; /* edge length of a cell, at least the cutoff */
+  int cells = nc * nc * nc;
+
+  memset(cell_start, 0, (cells + 1) * sizeof(int));
+
+  /* counting sort of all particles by cell */
+  for(int i = 0; i < N; ++i)
+  {
+    int c[3];
+
+    /* particles off the grid only feel the far field */
+    if(!on_mesh(pos + i * DIM))
+    {
+      particle_cell[i] = -1;
+      continue;
+    }
+
+    for(int k = 0; k < 3; ++k)
+    {
+      c[k] = (int) ((creal(pos[i * DIM + k]) - origin[k]) / size);
+      c[k] = (c[k] < 0) ? 0 : ((c[k] >= nc) ? nc - 1 : c[k]);
+    }
+
+    particle_cell[i] = (c[0] * nc + c[1]) * nc + c[2];
+    ++cell_start[particle_cell[i] + 1];
+  }
+
+  for(int c = 0; c < cells; ++c)
+  {
+    cell_start[c + 1] += cell_start[c];
+  }
+
+  for(int i = 0; i < N; ++i)
+  {
+    if(particle_cell[i] >= 0)
+    {
+      cell_index[cell_start[particle_cell[i]]++] = i;
+    }
+  }
+
+  /* restore start of each cell after filling */
+  for(int c = cells; c > 0; --c)
+  {
+    cell_start[c] = cell_start[c - 1];
+  }
+
+  cell_start[0] = 0;
+
+  double rc2 = r_cut * r_cut;
+
+  #pragma omp parallel for schedule(dynamic, 64)
+  for(int i = first; i < last; ++i)
+  {
+    int ci = particle_cell[i];
+
+    if(ci < 0)
+    {
+      continue;
+    }
+
+    int cx = ci / (nc * nc), cy = (ci / nc) % nc, cz = ci % nc;
+    double xi = creal(pos[i * DIM]), yi = creal(pos[i * DIM + 1]), zi = creal(pos[i * DIM + 2]);
+    double ax = 0.0, ay = 0.0, az = 0.0;
+
+    for(int a = cx - 1; a <= cx + 1; ++a)
+    {
+      for(int b = cy - 1; b <= cy + 1; ++b)
+      {
+        for(int c = cz - 1; c <= cz + 1; ++c)
+        {
+          if(a < 0 || a >= nc || b < 0 || b >= nc || c < 0 || c >= nc)
+          {
+            continue;
+          }
+
+          int cell = (a * nc + b) * nc + c;
+
+          for(int l = cell_start[cell]; l < cell_start[cell + 1]; ++l)
+          {
+            int j = cell_index[l];
+            double dx = creal(pos[j * DIM]) - xi;
+            double dy = creal(pos[j * DIM + 1]) - yi;
+            double dz = creal(pos[j * DIM + 2]) - zi;
+            double r2 = dx * dx + dy * dy + dz * dz;
+
+            if(j == i || r2 >= rc2)
+            {
+              continue;
+            }
+
+            double x = r2 * (TABLE / rc2);
+            int t = (int) x;
+            double s = table[t] + (x - t) * (table[t + 1] - table[t]);
+            double f = mass[j] * s / (r2 * sqrt(r2));
+
+            ax += f * dx;
+            ay += f * dy;
+            az += f * dz;
+          }
+        }
+      }
+    }
+
+    acc[i * DIM] += ax;
+    acc[i * DIM + 1] += ay;
+    acc[i * DIM + 2] += az;
+  }
+}
+
+/*
+ * Function:  mass_moments
+ * ====================
+ *  Sums the mass and the mass weighted positions block by block, the
+ *  partial sums are added by reduce_tree, so the sums do not depend
+ *  on the amount of threads.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  grid_only: nonzero to only sum the particles on the grid
+ *  moments: sums of mass times x, y and z and of mass
+ *
+ *  returns: void
+ * --------------------
+ */
+static void mass_moments(int N, int DIM, double *mass, double complex *pos, int grid_only, double moments[4])
+{
+  int blocks = reduce_blocks(N);
+
+  #pragma omp parallel for
+  for(int b = 0; b < blocks; ++b)
+  {
+    int end = (b + 1) * REDUCE_BLOCK < N ? (b + 1) * REDUCE_BLOCK : N;
+    double sum[4] = {0.0, 0.0, 0.0, 0.0};
+
+    for(int i = b * REDUCE_BLOCK; i < end; ++i)
+    {
+      if(grid_only && !on_mesh(pos + i * DIM))
+      {
+        continue;
+      }
+
+      for(int k = 0; k < 3; ++k)
+      {
+        sum[k] += mass[i] * creal(pos[i * DIM + k]);
+      }
+
+      sum[3] += mass[i];
+    }
+
+    for(int k = 0; k < 4; ++k)
+    {
+      partials[k * blocks + b] = sum[k];
+    }
+  }
+
+  for(int k = 0; k < 4; ++k)
+  {
+    moments[k] = reduce_tree(partials + k * blocks, blocks);
+  }
+}
+
+/*
+ * Function:  mesh_forces
+ * ====================
+ *  Calculates the acceleration for all particles with the mesh,
+ *  optionally corrected by short-range forces (P3M). Every process
+ *  handles a contiguous part of the particles and a slab of the
+ *  padded grid, accelerations are available on all processes afterwards.
+ *  Expects the same positions on all processes.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *  short_range: nonzero to add short-range forces directly
+ *
+ *  returns: void
+ * --------------------
+ */
+static void mesh_forces(int N, int DIM, double *mass, double complex *pos, double complex *acc, int short_range)
+{
+  int first = (int) ((long) N * world_rank / world_size);
+  int last = (int) ((long) N * (world_rank + 1) / world_size);
+
+  /* center of mass of all particles */
+  double all[4];
+  mass_moments(N, DIM, mass, pos, 0, all);
+
+  double center[3] = {all[0] / all[3], all[1] / all[3], all[2] / all[3]};
+
+  /* radius enclosing most of the particles, estimated from an evenly spaced sample, 
+     a few distant escapers must not stretch the grid over the whole system */
+  int stride = (N + SAMPLES - 1) / SAMPLES;
+  int samples = 0;
+
+  for(int i = 0; i < N; i += stride)
+  {
+    double r2 = 0.0;
+
+    for(int k = 0; k < 3; ++k)
+    {
+      r2 += (creal(pos[i * DIM + k]) - center[k]) * (creal(pos[i * DIM + k]) - center[k]);
+    }
+
+    radii[samples++] = sqrt(r2);
+  }
+
+  qsort(radii, samples, sizeof(double), compare);
+
+  double radius = radii[(int) (QUANTILE * (samples - 1))];
+
+  if(radius <= 0.0)
+  {
+    radius = 1.0;
+  }
+
+  /* grid is only moved if the sphere left it or the grid became too coarse */
+  int valid = (h > 0) && (2.5 * radius / (ng - 8) > 0.5 * h);
+
+  for(int k = 0; k < 3 && valid; ++k)
+  {
+    valid = ((center[k] - radius - origin[k]) / h >= 2) && ((center[k] + radius - origin[k]) / h <= ng - 4);
+  }
+
+  if(!valid)
+  {
+    setup_box(center, radius);
+  }
+
+  /* mass and center of mass of all particles on the grid */
+  double grid[4];
+  mass_moments(N, DIM, mass, pos, 1, grid);
+
+  double gx = grid[0], gy = grid[1], gz = grid[2], gm = grid[3];
+
+  /* cloud-in-cell assignment of the local particles, every thread owns a range of
+     x planes and adds to them in the order of the particles, so every node sums
+     its masses in the same order for any amount of threads */
+  memset(mesh, 0, (size_t) ng * ng * ng * sizeof(double));
+
+  #pragma omp parallel
+  {
+    int x_first = ng * thread_id() / thread_count();
+    int x_last = ng * (thread_id() + 1) / thread_count();
+
+    for(int i = first; i < last; ++i)
+    {
+      int c[3];
+      double f[3];
+
+      if(!on_mesh(pos + i * DIM))
+      {
+        continue;
+      }
+
+      c[0] = (int) ((creal(pos[i * DIM]) - origin[0]) / h);
+
+      if(c[0] + 1 < x_first || c[0] >= x_last)
+      {
+        continue;
+      }
+
+      for(int k = 0; k < 3; ++k)
+      {
+        double g = (creal(pos[i * DIM + k]) - origin[k]) / h;
+        c[k] = (int) g;
+        f[k] = g - c[k];
+      }
+
+      for(int a = 0; a < 2; ++a)
+      {
+        if(c[0] + a < x_first || c[0] + a >= x_last)
+        {
+          continue;
+        }
+
+        for(int b = 0; b < 2; ++b)
+        {
+          for(int d = 0; d < 2; ++d)
+          {
+            double w = (a ? f[0] : 1 - f[0]) * (b ? f[1] : 1 - f[1]) * (d ? f[2] : 1 - f[2]);
+
+            mesh[((size_t) (c[0] + a) * ng + c[1] + b) * ng + c[2] + d] += mass[i] * w;
+          }
+        }
+      }
+    }
+  }
+
+  /* planes of the unpadded grid owned by every process */
+  for(int q = 0; q < world_size; ++q)
+  {
+    int planes = ng - q * nx_local;
+    planes = (planes < 0) ? 0 : ((planes > nx_local) ? nx_local : planes);
+
+    counts[q] = planes * ng * ng;
+    displs[q] = q * nx_local * ng * ng;
+  }
+
+#ifdef USE_MPI
+  if(world_size > 1)
+  {
+    MPI_Reduce_scatter(mesh, mesh_local, counts, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  }
+#endif
+
+  /* zero padding of the local planes */
+  #pragma omp parallel for
+  for(int a = 0; a < nx_local; ++a)
+  {
+    int x = world_rank * nx_local + a;
+
+    for(int y = 0; y < n; ++y)
+    {
+      for(int z = 0; z < n; ++z)
+      {
+        slab[((size_t) a * n + y) * n + z] = (x < ng && y < ng && z < ng) ? mesh_local[((size_t) a * ng + y) * ng + z] : 0.0;
+      }
+    }
+  }
+
+  /* convolution with the Green's function */
+  fft_forward(1);
+
+  #pragma omp parallel for
+  for(size_t i = 0; i < (size_t) ny_local * n * n; ++i)
+  {
+    trans[i] *= green[i];
+  }
+
+  fft_inverse();
+
+  /* potential of the unpadded grid for all processes */
+  #pragma omp parallel for
+  for(int a = 0; a < counts[world_rank] / (ng * ng); ++a)
+  {
+    for(int y = 0; y < ng; ++y)
+    {
+      for(int z = 0; z < ng; ++z)
+      {
+        mesh_local[((size_t) a * ng + y) * ng + z] = creal(slab[((size_t) a * n + y) * n + z]);
+      }
+    }
+  }
+
+#ifdef USE_MPI
+  if(world_size > 1)
+  {
+    MPI_Allgatherv(mesh_local, counts[world_rank], MPI_DOUBLE, mesh, counts, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+  }
+#endif
+
+  /* interpolate the fourth order finite difference gradient of the potential */
+  #pragma omp parallel for
+  for(int i = first; i < last; ++i)
+  {
+    int c[3];
+    double f[3];
+    double a_k[3] = {0.0, 0.0, 0.0};
+
+    /* particles off the grid are attracted by the grid as a point mass */
+    if(!on_mesh(pos + i * DIM))
+    {
+      double d[3] = {creal(pos[i * DIM]) - gx / gm, creal(pos[i * DIM + 1]) - gy / gm, creal(pos[i * DIM + 2]) - gz / gm};
+      double r = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+      for(int k = 0; k < DIM; ++k)
+      {
+        acc[i * DIM + k] = (gm > 0) ? -gm * d[k] / (r * r * r) : 0.0;
+      }
+
+      continue;
+    }
+
+    for(int k = 0; k < 3; ++k)
+    {
+      double g = (creal(pos[i * DIM + k]) - origin[k]) / h;
+      c[k] = (int) g;
+      f[k] = g - c[k];
+    }
+
+    for(int a = 0; a < 2; ++a)
+    {
+      for(int b = 0; b < 2; ++b)
+      {
+        for(int d = 0; d < 2; ++d)
+        {
+          double w = (a ? f[0] : 1 - f[0]) * (b ? f[1] : 1 - f[1]) * (d ? f[2] : 1 - f[2]);
+          int node[3] = {c[0] + a, c[1] + b, c[2] + d};
+
+          for(int k = 0; k < 3; ++k)
+          {
+            size_t stride = (k == 0) ? (size_t) ng * ng : ((k == 1) ? (size_t) ng : 1);
+            size_t idx = ((size_t) node[0] * ng + node[1]) * ng + node[2];
+            double grad = (8 * (mesh[idx + stride] - mesh[idx - stride])
+                           - (mesh[idx + 2 * stride] - mesh[idx - 2 * stride])) / (12 * h);
+
+            a_k[k] -= w * grad;
+          }
+        }
+      }
+    }
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      acc[i * DIM + k] = a_k[k];
+    }
+  }
+
+  if(short_range)
+  {
+    short_range_forces(N, DIM, mass, pos, acc, first, last);
+  }
+
+#ifdef USE_MPI
+  if(world_size > 1)
+  {
+    for(int q = 0; q < world_size; ++q)
+    {
+      counts[q] = ((int) ((long) N * (q + 1) / world_size) - (int) ((long) N * q / world_size)) * DIM;
+      displs[q] = (int) ((long) N * q / world_size) * DIM;
+    }
+
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, acc, counts, displs, MPI_C_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+  }
+#endif
+}
+
+/*
+ * Function:  acc_pm
+ * ====================
+ *  Calculates the acceleration for all particles with the mesh only.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_pm(int N, int DIM, double *mass, double complex *pos, double complex *acc)
+{
+  mesh_forces(N, DIM, mass, pos, acc, 0);
+}
+
+/*
+ * Function:  acc_p3m
+ * ====================
+ *  Calculates the acceleration for all particles with the mesh
+ *  and adds short-range forces within the cutoff directly.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  mass: masses of all particles
+ *  pos: positions of all particles
+ *  acc: acceleration for all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void acc_p3m(int N, int DIM, double *mass, double complex *pos, double complex *acc)
+{
+  mesh_forces(N, DIM, mass, pos, acc, 1);
+}
@@ -0,0 +1,18 @@
+#ifndef PM_H_
+#define PM_H_
+
+#include <stddef.h>
+
+size_t pm_bytes(int N, int grid);
+
+void initPM(int N, int DIM, int grid);
+
+void initP3M(int N, int DIM, int grid);
+
+void acc_pm(int N, int DIM, double *mass, double complex *pos, double complex *acc);
+
+void acc_p3m(int N, int DIM, double *mass, double complex *pos, double complex *acc);
+
+void freePM(void);
+
+#endif // PM_H_
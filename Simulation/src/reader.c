@@ -0,0 +1,779 @@
+/*
+    The following source code provides a reader of the binary snapshots
+    written by snapshot.c, for the visualization and for analysis tools.
+    Trajectory and frame index are mapped into memory, so any frame is
+    found through the index without reading the frames before it and the
+    values of raw frames are used where they lie in the mapping, without
+    being copied or parsed. Compressed frames are restored into buffers of
+    the reader, starting at the keyframe before them, consecutive frames
+    are restored one after another from the frames before.
+
+    The files are little-endian and are only read on machines of the same
+    byte order. Files of a run which is still writing can be read, frames
+    beyond the end of the mapping are rejected.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "snapshot.h"
+#include "reader.h"
+
+#define FIELDS 5 /* amount of fields a frame can hold */
+#define V1_HEADER 72 /* size of the frame header of version 1, which is never compressed */
+#define V2_HEADER 88 /* size of the frame header of version 2, which is never quantized */
+
+/* file mapped into memory for reading */
+struct mapping
+{
+  const unsigned char *data; /* NULL if the file is empty */
+  uint64_t size;
+#ifdef _WIN32
+  HANDLE file, map;
+#endif
+};
+
+struct trajectory
+{
+  struct mapping frames; /* trajectory.nbs */
+  struct mapping index; /* trajectory.idx */
+  uint32_t header_bytes; /* size of the header of the index */
+  uint32_t entry_bytes; /* size of every entry of the index */
+  int64_t count; /* amount of frames */
+
+  /* restored values of compressed frames, the latest first, one more than the prediction needs */
+  void *history[FIELDS][XOR_ORDER + 1];
+  size_t history_bytes; /* size of every buffer */
+  int64_t decoded; /* frame held by the history, -1 if none */
+  void *masses; /* masses of the first frame if it is compressed */
+};
+
+/* fields in the order they are stored */
+static const int field_bits[FIELDS] = {SNAPSHOT_POSITION, SNAPSHOT_MASS, SNAPSHOT_VELOCITY,
+                                       SNAPSHOT_ACCELERATION, SNAPSHOT_JERK};
+
+/*
+ * Function:  map_file
+ * ====================
+ *  Maps a whole file into memory for reading.
+ *
+ *  name: name of the file
+ *  m: mapping
+ *
+ *  returns: zero on success
+ * --------------------
+ */
+static int map_file(const char *name, struct mapping *m)
+{
+  m->data = NULL;
+  m->size = 0;
+
+#ifdef _WIN32
+  m->map = NULL;
+  m->file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+
+  LARGE_INTEGER size;
+
+  if(m->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m->file, &size))
+  {
+    return 1;
+  }
+
+  m->size = (uint64_t) size.QuadPart;
+
+  if(m->size > 0)
+  {
+    m->map = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    m->data = (m->map != NULL) ? MapViewOfFile(m->map, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if(m->data == NULL)
+    {
+      return 1;
+    }
+  }
+#else
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+
+  if(fd < 0 || fstat(fd, &st) != 0)
+  {
+    if(fd >= 0)
+    {
+      close(fd);
+    }
+
+    return 1;
+  }
+
+  m->size = (uint64_t) st.st_size;
+
+  if(m->size > 0)
+  {
+    void *data = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+    m->data = (data != MAP_FAILED) ? data : NULL;
+  }
+
+  close(fd); /* the mapping stays valid */
+
+  if(m->size > 0 && m->data == NULL)
+  {
+    return 1;
+  }
+#endif
+
+  return 0;
+}
+
+/*
+ * Function:  unmap_file
+ * ====================
+ *  Releases a mapping created by map_file, also after it failed.
+ *
+ *  m: mapping
+ *
+ *  returns: void
+ * --------------------
+ */
+static void unmap_file(struct mapping *m)
+{
+#ifdef _WIN32
+  if(m->data != NULL)
+  {
+    UnmapViewOfFile(m->data);
+  }
+
+  if(m->map != NULL)
+  {
+    CloseHandle(m->map);
+  }
+
+  if(m->file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m->file);
+  }
+#else
+  if(m->data != NULL)
+  {
+    munmap((void *) m->data, m->size);
+  }
+#endif
+
+  m->data = NULL;
+  m->size = 0;
+}
+
+/*
+ * Function:  openTrajectory
+ * ====================
+ *  Maps trajectory and frame index of a run written with binary
+ *  snapshots and checks the header of the index.
+ *
+ *  folder: folder of the run
+ *
+ *  returns: trajectory or NULL if the run has no readable trajectory
+ * --------------------
+ */
+struct trajectory *openTrajectory(const char *folder)
+{
+  char name[256];
+  struct trajectory *t = calloc(1, sizeof(struct trajectory));
+
+  if(t == NULL)
+  {
+    return NULL;
+  }
+
+  t->decoded = -1;
+
+  snprintf(name, sizeof(name), "%s/trajectory.nbs", folder);
+  int failed = map_file(name, &t->frames);
+
+  snprintf(name, sizeof(name), "%s/trajectory.idx", folder);
+  failed = map_file(name, &t->index) || failed;
+
+  struct snapshot_index_header header;
+
+  if(failed || t->index.size < sizeof(header))
+  {
+    closeTrajectory(t);
+    return NULL;
+  }
+
+  memcpy(&header, t->index.data, sizeof(header));
+
+  /* the index of version 1 has no keyframes, entries are at least offset, iteration and time */
+  if(memcmp(header.magic, SNAPSHOT_INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version > SNAPSHOT_VERSION ||
+     header.endian != SNAPSHOT_ENDIAN || header.header_bytes < sizeof(header) || header.entry_bytes < 24)
+  {
+    closeTrajectory(t);
+    return NULL;
+  }
+
+  t->header_bytes = header.header_bytes;
+  t->entry_bytes = header.entry_bytes;
+  t->count = (t->index.size > header.header_bytes) ? (int64_t) ((t->index.size - header.header_bytes) / header.entry_bytes) : 0;
+
+  return t;
+}
+
+/*
+ * Function:  trajectory_frames
+ * ====================
+ *  t: trajectory
+ *
+ *  returns: amount of frames in the index when the trajectory was opened
+ * --------------------
+ */
+int64_t trajectory_frames(const struct trajectory *t)
+{
+  return t->count;
+}
+
+/*
+ * Function:  index_entry
+ * ====================
+ *  Reads an entry of the frame index, the keyframe of an index of
+ *  version 1 is the frame itself.
+ *
+ *  t: trajectory
+ *  frame: number of the frame
+ *  entry: entry of the frame
+ *
+ *  returns: void
+ * --------------------
+ */
+static void index_entry(const struct trajectory *t, int64_t frame, struct snapshot_index_entry *entry)
+{
+  const unsigned char *data = t->index.data + t->header_bytes + (uint64_t) frame * t->entry_bytes;
+
+  entry->keyframe = frame;
+  memcpy(entry, data, (t->entry_bytes < sizeof(*entry)) ? t->entry_bytes : sizeof(*entry));
+}
+
+/*
+ * Function:  find_iteration
+ * ====================
+ *  Looks up the frame of an iteration by bisection, the iterations of
+ *  the frames increase.
+ *
+ *  t: trajectory
+ *  iteration: iteration of the frame
+ *
+ *  returns: number of the frame, -1 if the iteration has not been written
+ * --------------------
+ */
+int64_t find_iteration(const struct trajectory *t, int64_t iteration)
+{
+  int64_t low = 0, high = t->count;
+
+  while(low < high)
+  {
+    int64_t middle = low + (high - low) / 2;
+    struct snapshot_index_entry entry;
+
+    index_entry(t, middle, &entry);
+
+    if(entry.iteration < iteration)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  struct snapshot_index_entry entry;
+
+  if(low < t->count)
+  {
+    index_entry(t, low, &entry);
+  }
+
+  return (low < t->count && entry.iteration == iteration) ? low : -1;
+}
+
+/*
+ * Function:  frame_header
+ * ====================
+ *  Checks the header of a frame and its extent within the mapping.
+ *
+ *  t: trajectory
+ *  offset: position of the frame
+ *  header: header of the frame, members of later versions are zero for frames of earlier ones
+ *  bytes: set to the size of the fields
+ *
+ *  returns: zero if the frame is complete
+ * --------------------
+ */
+static int frame_header(const struct trajectory *t, uint64_t offset, struct snapshot_header *header, uint64_t *bytes)
+{
+  memset(header, 0, sizeof(*header));
+
+  if(offset > t->frames.size || t->frames.size - offset < V1_HEADER)
+  {
+    return 1;
+  }
+
+  memcpy(header, t->frames.data + offset, V1_HEADER);
+
+  if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->endian != SNAPSHOT_ENDIAN ||
+     header->header_bytes < V1_HEADER || (header->precision != 8 && header->precision != 4) ||
+     header->dim < 1 || header->n < 0 || t->frames.size - offset < header->header_bytes)
+  {
+    return 1;
+  }
+
+  size_t known = (header->header_bytes < sizeof(*header)) ? header->header_bytes : sizeof(*header);
+  memcpy(header, t->frames.data + offset, known);
+
+  /* fields of raw frames are not preceded by their size in version 1 */
+  if(header->header_bytes < V2_HEADER)
+  {
+    header->encoding = SNAPSHOT_RAW;
+    header->bytes = 0;
+
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      header->bytes += (header->fields & field_bits[f]) ?
+                       (uint64_t) header->n * ((field_bits[f] == SNAPSHOT_MASS) ? 1 : header->dim) * header->precision : 0;
+    }
+  }
+
+  *bytes = header->bytes;
+
+  return header->encoding > SNAPSHOT_QUANT || (header->encoding == SNAPSHOT_QUANT && !(header->quantum > 0.0)) ||
+         t->frames.size - offset - header->header_bytes < header->bytes;
+}
+
+/*
+ * Function:  mass_encoding
+ * ====================
+ *  header: header of a compressed frame
+ *
+ *  returns: encoding of the masses of the frame, which are never quantized
+ * --------------------
+ */
+static int mass_encoding(const struct snapshot_header *header)
+{
+  if(header->encoding != SNAPSHOT_QUANT)
+  {
+    return header->encoding;
+  }
+
+  return (header->precision == 4) ? SNAPSHOT_SHUFFLE : SNAPSHOT_XOR;
+}
+
+/*
+ * Function:  restore_field
+ * ====================
+ *  Restores a compressed field block by block.
+ *
+ *  in: sizes of the blocks, followed by the blocks
+ *  end: end of the fields of the frame
+ *  encoding: SNAPSHOT_XOR, SNAPSHOT_SHUFFLE or SNAPSHOT_QUANT
+ *  step: quantum of the frame, used by SNAPSHOT_QUANT
+ *  history: same field of the previous frames, the latest first
+ *  n: amount of particles
+ *  stride: values per particle
+ *  precision: bytes per value
+ *  order: previous frames the values are predicted from
+ *  values: restored values
+ *
+ *  returns: end of the field, NULL if the field is damaged
+ * --------------------
+ */
+static const unsigned char *restore_field(const unsigned char *in, const unsigned char *end, int encoding, double step,
+                                          void *const *history, int64_t n, int stride, int precision, int order, void *values)
+{
+  int64_t blocks = (n + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK;
+  const unsigned char *block = in + blocks * sizeof(uint32_t);
+
+  if(end - in < blocks * (int64_t) sizeof(uint32_t))
+  {
+    return NULL;
+  }
+
+  for(int64_t b = 0; b < blocks; ++b)
+  {
+    uint32_t bytes;
+    int64_t particles = (n - b * SNAPSHOT_BLOCK < SNAPSHOT_BLOCK) ? n - b * SNAPSHOT_BLOCK : SNAPSHOT_BLOCK;
+    size_t start = (size_t) b * SNAPSHOT_BLOCK * stride * precision; /* first byte of the block */
+    const void *recent[XOR_ORDER];
+
+    memcpy(&bytes, in + b * sizeof(uint32_t), sizeof(bytes));
+
+    /* the nibbles of all values are needed before the first residual, the form of every plane before the plane */
+    if(end - block < bytes || bytes < ((encoding != SNAPSHOT_XOR) ? precision : (particles * stride + 1) / 2))
+    {
+      return NULL;
+    }
+
+    for(int h = 0; h < order; ++h)
+    {
+      recent[h] = (char *) history[h] + start;
+    }
+
+    size_t length = (size_t) particles * stride;
+    size_t read;
+
+    if(encoding == SNAPSHOT_QUANT)
+    {
+      read = quant_decode(block, recent, length, stride, precision, order, step, (char *) values + start); /* provided by compress.h */
+    }
+    else if(encoding == SNAPSHOT_SHUFFLE)
+    {
+      read = shuffle_decode(block, recent, length, stride, precision, order, (char *) values + start);
+    }
+    else
+    {
+      read = xor_decode(block, recent, length, stride, precision, order, (char *) values + start);
+    }
+
+    if(read != bytes)
+    {
+      return NULL;
+    }
+
+    block += bytes;
+  }
+
+  return block;
+}
+
+/*
+ * Function:  restore_frame
+ * ====================
+ *  Restores a compressed frame into the history, from the frames
+ *  before it which the history already holds. The buffers of the
+ *  history are allocated for the first compressed frame.
+ *
+ *  t: trajectory
+ *  frame: number of the frame
+ *
+ *  returns: zero on success
+ * --------------------
+ */
+static int restore_frame(struct trajectory *t, int64_t frame)
+{
+  struct snapshot_index_entry entry;
+  struct snapshot_header header;
+  uint64_t bytes;
+
+  index_entry(t, frame, &entry);
+
+  if(frame_header(t, entry.offset, &header, &bytes) != 0 || header.encoding == SNAPSHOT_RAW || header.order > XOR_ORDER)
+  {
+    return 1;
+  }
+
+  size_t needed = (size_t) header.n * header.dim * header.precision;
+
+  if(t->history_bytes != needed)
+  {
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      for(int h = 0; h <= XOR_ORDER; ++h)
+      {
+        free(t->history[f][h]);
+        t->history[f][h] = (field_bits[f] != SNAPSHOT_MASS) ? malloc(needed + 1) : NULL;
+
+        if(field_bits[f] != SNAPSHOT_MASS && t->history[f][h] == NULL)
+        {
+          t->history_bytes = 0;
+          return 1;
+        }
+      }
+    }
+
+    t->history_bytes = needed;
+  }
+
+  const unsigned char *in = t->frames.data + entry.offset + header.header_bytes;
+  const unsigned char *end = in + bytes;
+
+  for(int f = 0; f < FIELDS && in != NULL; ++f)
+  {
+    if(!(header.fields & field_bits[f]))
+    {
+      continue;
+    }
+
+    /* masses are only stored in the first frame, which is a keyframe */
+    if(field_bits[f] == SNAPSHOT_MASS)
+    {
+      if(t->masses == NULL)
+      {
+        t->masses = malloc((size_t) header.n * header.precision + 1);
+      }
+
+      in = (t->masses != NULL && header.order == 0) ?
+           restore_field(in, end, mass_encoding(&header), 0.0, NULL, header.n, 1, header.precision, 0, t->masses) : NULL;
+      continue;
+    }
+
+    /* the oldest buffer becomes the latest frame */
+    void *latest = t->history[f][XOR_ORDER];
+
+    in = restore_field(in, end, header.encoding, header.quantum, t->history[f], header.n, header.dim, header.precision, 
+                       header.order, latest);
+
+    memmove(&t->history[f][1], &t->history[f][0], XOR_ORDER * sizeof(void *));
+    t->history[f][0] = latest;
+  }
+
+  return in == NULL;
+}
+
+/*
+ * Function:  first_masses
+ * ====================
+ *  Views the masses of the first frame, which are the only ones
+ *  stored. Compressed masses are restored once and kept, without
+ *  touching the history.
+ *
+ *  t: trajectory
+ *  out: frame without masses
+ *
+ *  returns: void
+ * --------------------
+ */
+static void first_masses(struct trajectory *t, struct snapshot_frame *out)
+{
+  struct snapshot_index_entry entry;
+  struct snapshot_header header;
+  uint64_t bytes;
+
+  index_entry(t, 0, &entry);
+
+  if(frame_header(t, entry.offset, &header, &bytes) != 0 || !(header.fields & SNAPSHOT_MASS) || header.n != out->n)
+  {
+    return;
+  }
+
+  const unsigned char *in = t->frames.data + entry.offset + header.header_bytes;
+  const unsigned char *end = in + bytes;
+
+  if(header.encoding == SNAPSHOT_RAW)
+  {
+    out->mass.values = in + ((header.fields & SNAPSHOT_POSITION) ? header.n * header.dim * header.precision : 0);
+  }
+  else
+  {
+    if(t->masses == NULL && header.order == 0)
+    {
+      int64_t blocks = (header.n + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK;
+
+      /* skip the compressed positions before the masses */
+      if((header.fields & SNAPSHOT_POSITION) && end - in >= blocks * (int64_t) sizeof(uint32_t))
+      {
+        const unsigned char *block = in + blocks * sizeof(uint32_t);
+
+        for(int64_t b = 0; b < blocks && block != NULL; ++b)
+        {
+          uint32_t size;
+
+          memcpy(&size, in + b * sizeof(uint32_t), sizeof(size));
+          block = (end - block >= size) ? block + size : NULL;
+        }
+
+        in = block;
+      }
+
+      t->masses = (in != NULL) ? malloc((size_t) header.n * header.precision + 1) : NULL;
+
+      if(t->masses != NULL && 
+         restore_field(in, end, mass_encoding(&header), 0.0, NULL, header.n, 1, header.precision, 0, t->masses) == NULL)
+      {
+        free(t->masses);
+        t->masses = NULL;
+      }
+    }
+
+    out->mass.values = t->masses;
+  }
+
+  if(out->mass.values != NULL)
+  {
+    out->mass.count = header.n;
+    out->mass.precision = (int) header.precision;
+    out->fields |= SNAPSHOT_MASS;
+  }
+}
+
+/*
+ * Function:  read_frame
+ * ====================
+ *  Provides views of all fields of a frame. Raw frames are viewed
+ *  where they lie in the mapping, compressed frames are restored
+ *  starting at their keyframe or at the last frame read if it lies
+ *  in between. Masses are only stored in the first frame and taken
+ *  from there.
+ *
+ *  t: trajectory
+ *  frame: number of the frame, 0 to trajectory_frames - 1
+ *  out: frame
+ *
+ *  returns: zero on success
+ * --------------------
+ */
+int read_frame(struct trajectory *t, int64_t frame, struct snapshot_frame *out)
+{
+  struct snapshot_index_entry entry;
+  struct snapshot_header header;
+  uint64_t bytes;
+  struct snapshot_view *views[FIELDS] = {&out->pos, &out->mass, &out->vel, &out->acc, &out->jerk};
+
+  memset(out, 0, sizeof(*out));
+
+  if(frame < 0 || frame >= t->count)
+  {
+    return 1;
+  }
+
+  index_entry(t, frame, &entry);
+
+  if(frame_header(t, entry.offset, &header, &bytes) != 0)
+  {
+    return 1;
+  }
+
+  out->iteration = header.iteration;
+  out->time = header.time;
+  out->n = header.n;
+  out->dim = (int) header.dim;
+  out->fields = (int) header.fields;
+  out->seed = header.seed;
+  out->dt = header.dt;
+
+  if(header.encoding != SNAPSHOT_RAW)
+  {
+    int64_t first = (t->decoded >= entry.keyframe && t->decoded <= frame) ? t->decoded + 1 : entry.keyframe;
+
+    for(int64_t k = first; k <= frame; ++k)
+    {
+      if(restore_frame(t, k) != 0)
+      {
+        t->decoded = -1;
+        return 1;
+      }
+
+      t->decoded = k;
+    }
+  }
+
+  const unsigned char *values = t->frames.data + entry.offset + header.header_bytes;
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(!(header.fields & field_bits[f]))
+    {
+      continue;
+    }
+
+    views[f]->count = header.n * ((field_bits[f] == SNAPSHOT_MASS) ? 1 : header.dim);
+    views[f]->precision = (int) header.precision;
+
+    if(header.encoding == SNAPSHOT_RAW)
+    {
+      views[f]->values = values;
+      values += views[f]->count * header.precision;
+    }
+    else
+    {
+      views[f]->values = (field_bits[f] == SNAPSHOT_MASS) ? t->masses : t->history[f][0];
+    }
+  }
+
+  /* masses of the first frame */
+  if(!(header.fields & SNAPSHOT_MASS) && frame > 0)
+  {
+    first_masses(t, out);
+  }
+
+  return 0;
+}
+
+/*
+ * Function:  view_doubles
+ * ====================
+ *  view: field of a frame
+ *
+ *  returns: values as doubles, NULL if they are floats or not stored
+ * --------------------
+ */
+const double *view_doubles(const struct snapshot_view *view)
+{
+  return (view->precision == 8) ? view->values : NULL;
+}
+
+/*
+ * Function:  view_floats
+ * ====================
+ *  view: field of a frame
+ *
+ *  returns: values as floats, NULL if they are doubles or not stored
+ * --------------------
+ */
+const float *view_floats(const struct snapshot_view *view)
+{
+  return (view->precision == 4) ? view->values : NULL;
+}
+
+/*
+ * Function:  closeTrajectory
+ * ====================
+ *  Unmaps the files and frees the buffers of a trajectory.
+ *
+ *  t: trajectory, may be NULL
+ *
+ *  returns: void
+ * --------------------
+ */
+void closeTrajectory(struct trajectory *t)
+{
+  if(t == NULL)
+  {
+    return;
+  }
+
+  unmap_file(&t->frames);
+  unmap_file(&t->index);
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    for(int h = 0; h <= XOR_ORDER; ++h)
+    {
+      free(t->history[f][h]);
+    }
+  }
+
+  free(t->masses);
+  free(t);
+}
@@ -0,0 +1,54 @@
+#ifndef READER_H_
+#define READER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* values of one field of a frame, either within the mapped trajectory or, for compressed
+   frames, within a buffer of the reader. They stay valid until the next frame is read */
+struct snapshot_view
+{
+  const void *values; /* particle by particle in the order of the particle IDs, NULL if not stored */
+  int64_t count; /* amount of values, particles times dimensions or particles for masses */
+  int precision; /* bytes per value, 8 for doubles and 4 for floats */
+};
+
+/* one frame of the trajectory */
+struct snapshot_frame
+{
+  int64_t iteration; /* iteration of the frame */
+  double time; /* time of the frame */
+  int64_t n; /* amount of particles */
+  int dim; /* dimensions of space */
+  int fields; /* fields with values, SNAPSHOT_POSITION to SNAPSHOT_JERK combined */
+  uint64_t seed; /* seed of the initial conditions */
+  double dt; /* timestep */
+  struct snapshot_view pos, mass, vel, acc, jerk; /* masses are taken from the first frame */
+};
+
+/* mapped trajectory and frame index of a run, see reader.c */
+struct trajectory;
+
+struct trajectory *openTrajectory(const char *folder);
+
+int64_t trajectory_frames(const struct trajectory *t);
+
+int64_t find_iteration(const struct trajectory *t, int64_t iteration);
+
+int read_frame(struct trajectory *t, int64_t frame, struct snapshot_frame *out);
+
+const double *view_doubles(const struct snapshot_view *view);
+
+const float *view_floats(const struct snapshot_view *view);
+
+void closeTrajectory(struct trajectory *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // READER_H_
@@ -0,0 +1,67 @@
+/*
+    The following source-code provides reproducible reductions. Sums are
+    split into blocks whose size only depends on the amount of elements,
+    every block is summed sequentially by whichever thread or process owns
+    it and the partial sums are combined by a pairwise tree of fixed shape.
+    The result is therefore bit-identical for every amount of threads and
+    processes.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "reduce.h"
+
+/*
+ * Function:  reduce_blocks
+ * ====================
+ *  n: amount of elements
+ *
+ *  returns: amount of blocks of REDUCE_BLOCK elements covering them
+ * --------------------
+ */
+int reduce_blocks(int n)
+{
+  return (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+}
+
+/*
+ * Function:  reduce_tree
+ * ====================
+ *  Sums partial sums pairwise, the first half and the second half
+ *  are summed separately and added, recursively. Partial sums of
+ *  blocks owned by other processes are combined beforehand by 
+ *  MPI_SUM, which is exact as all but one of the summands are zero.
+ *
+ *  partials: partial sums in the order of their blocks
+ *  n: amount of partial sums
+ *
+ *  returns: sum of all partial sums
+ * --------------------
+ */
+double reduce_tree(const double *partials, int n)
+{
+  if(n <= 0)
+  {
+    return 0.0;
+  }
+
+  if(n == 1)
+  {
+    return partials[0];
+  }
+
+  return reduce_tree(partials, n / 2) + reduce_tree(partials + n / 2, n - n / 2);
+}
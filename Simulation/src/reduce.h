@@ -0,0 +1,10 @@
+#ifndef REDUCE_H_
+#define REDUCE_H_
+
+#define REDUCE_BLOCK 1024 /* elements summed sequentially into one partial sum */
+
+int reduce_blocks(int n);
+
+double reduce_tree(const double *partials, int n);
+
+#endif // REDUCE_H_
@@ -0,0 +1,460 @@
+/*
+    The following source-code sorts the particles along a space-filling
+    curve, either the Morton (Z-order) or the Hilbert curve, so particles
+    which are close in space are close in memory as well. Every particle
+    carries a stable ID, which allows to write the output in the original
+    order. Keys are sorted with a parallel least significant digit radix sort.
+    This helps the mesh engines and gives every MPI process a compact part of
+    the cluster. The changed summation order perturbs the results by a few
+    units in the last place after the first reordering, which then grows
+    like any perturbation of an N-body system.
+    Based on Skilling J., 2004, Programming the Hilbert curve, AIP Conf. Proc. 707.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#include "ks.h"
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "checkpoint.h"
+#include "reorder.h"
+#include "workspace.h"
+
+#define BITS 21 /* bits per coordinate, three coordinates fill a 63 bit key */
+#define RADIX 256 /* buckets per pass of the radix sort */
+#define PASSES 8 /* passes of eight bits covering the key, even so the result ends in the original buffer */
+
+int *reorder_slot = NULL;
+
+static int curve;
+static int threads = 1;
+static uint64_t *keys, *keys_tmp; /* curve index of every particle */
+static int *order, *order_tmp; /* former index of the particle now at every index */
+static int *ids, *ids_tmp; /* stable ID of the particle at every index */
+static int *histogram; /* buckets of every thread */
+static double *mass_tmp;
+static double complex *scratch;
+
+static const char *curve_names[] = {"morton", "hilbert"};
+
+/*
+ * Function:  reorder_bytes
+ * ====================
+ *  Calculates the space needed within the workspace, the scratch arrays
+ *  are exchanged with the arrays of the particles and must not be
+ *  taken from the heap.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *
+ *  returns: size of all arrays allocated by initReorder
+ * --------------------
+ */
+size_t reorder_bytes(int N, int DIM)
+{
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  return 2 * workspace_bytes(N, sizeof(uint64_t)) + 5 * workspace_bytes(N, sizeof(int)) /* provided by workspace.h */
+         + workspace_bytes((size_t) threads * RADIX, sizeof(int)) + workspace_bytes(N, sizeof(double))
+         + workspace_bytes((size_t) N * DIM, sizeof(double complex));
+}
+
+/*
+ * Function:  initReorder
+ * ====================
+ *  Enables reordering, every particle keeps its initial index as ID.
+ *  The IDs and indices are registered for checkpoints.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  kind: REORDER_MORTON or REORDER_HILBERT
+ *
+ *  returns: void
+ * --------------------
+ */
+void initReorder(int N, int DIM, int kind)
+{
+  if(DIM != 3)
+  {
+    fprintf(stderr, "Reordering is only implemented for three dimensions!\n");
+    exit(0);
+  }
+
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  curve = kind;
+
+  keys = workspace_alloc(N, sizeof(uint64_t)); /* provided by workspace.h */
+  keys_tmp = workspace_alloc(N, sizeof(uint64_t));
+  order = workspace_alloc(N, sizeof(int));
+  order_tmp = workspace_alloc(N, sizeof(int));
+  ids = workspace_alloc(N, sizeof(int));
+  ids_tmp = workspace_alloc(N, sizeof(int));
+  reorder_slot = workspace_alloc(N, sizeof(int));
+  histogram = workspace_alloc((size_t) threads * RADIX, sizeof(int));
+  mass_tmp = workspace_alloc(N, sizeof(double));
+  scratch = workspace_alloc((size_t) N * DIM, sizeof(double complex));
+
+  for(int i = 0; i < N; ++i)
+  {
+    ids[i] = reorder_slot[i] = i;
+  }
+
+  checkpoint_array("ids", (void **) &ids, N * sizeof(int)); /* provided by checkpoint.h */
+  checkpoint_value("reorder_slot", reorder_slot, N * sizeof(int));
+}
+
+/*
+ * Function:  curveName
+ * ====================
+ *  returns: name of the curve
+ * --------------------
+ */
+const char *curveName(int kind)
+{
+  return curve_names[kind];
+}
+
+/*
+ * Function:  spread
+ * ====================
+ *  Inserts two zero bits after every bit of a coordinate.
+ *
+ *  x: coordinate of BITS bits
+ *
+ *  returns: spread coordinate
+ * --------------------
+ */
+static uint64_t spread(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+
+  return x;
+}
+
+/*
+ * Function:  hilbert
+ * ====================
+ *  Transforms coordinates into the transposed Hilbert index
+ *  (Skilling, 2004), interleaving its bits yields the index.
+ *
+ *  X: coordinates, replaced by the transposed index
+ *
+ *  returns: void
+ * --------------------
+ */
+static void hilbert(uint32_t X[3])
+{
+  uint32_t t;
+
+  /* inverse undo of the rotations and reflections */
+  for(uint32_t Q = 1U << (BITS - 1); Q > 1; Q >>= 1)
+  {
+    uint32_t P = Q - 1;
+
+    for(int i = 0; i < 3; ++i)
+    {
+      if(X[i] & Q)
+      {
+        X[0] ^= P;
+      }
+      else
+      {
+        t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+
+  /* Gray encode */
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+
+  t = 0;
+
+  for(uint32_t Q = 1U << (BITS - 1); Q > 1; Q >>= 1)
+  {
+    if(X[2] & Q)
+    {
+      t ^= Q - 1;
+    }
+  }
+
+  for(int i = 0; i < 3; ++i)
+  {
+    X[i] ^= t;
+  }
+}
+
+/*
+ * Function:  curve_keys
+ * ====================
+ *  Calculates the index along the curve for all particles within
+ *  the bounding box of the cluster.
+ *
+ *  N: amount of particles
+ *  pos: positions of all particles
+ *
+ *  returns: void
+ * --------------------
+ */
+static void curve_keys(int N, double complex *pos)
+{
+  double lx = INFINITY, ly = INFINITY, lz = INFINITY;
+  double ux = -INFINITY, uy = -INFINITY, uz = -INFINITY;
+
+  #pragma omp parallel for reduction(min:lx,ly,lz) reduction(max:ux,uy,uz)
+  for(int mi = 0; mi < N; ++mi)
+  {
+    double x = creal(pos[3 * mi]), y = creal(pos[3 * mi + 1]), z = creal(pos[3 * mi + 2]);
+
+    lx = fmin(lx, x); ly = fmin(ly, y); lz = fmin(lz, z);
+    ux = fmax(ux, x); uy = fmax(uy, y); uz = fmax(uz, z);
+  }
+
+  double extent = fmax(ux - lx, fmax(uy - ly, uz - lz));
+  double scale = (extent > 0) ? ((1 << BITS) - 1) / extent : 0.0; /* cubic cells keep the curve isotropic */
+
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
+  {
+    uint32_t X[3] =
+    {
+      (uint32_t) ((creal(pos[3 * mi]) - lx) * scale),
+      (uint32_t) ((creal(pos[3 * mi + 1]) - ly) * scale),
+      (uint32_t) ((creal(pos[3 * mi + 2]) - lz) * scale)
+    };
+
+    if(curve == REORDER_HILBERT)
+    {
+      hilbert(X);
+    }
+
+    keys[mi] = spread(X[0]) << 2 | spread(X[1]) << 1 | spread(X[2]);
+    order[mi] = mi;
+  }
+}
+
+/*
+ * Function:  radix_sort
+ * ====================
+ *  Sorts the keys together with the order, stable. Every thread counts
+ *  the digits of its contiguous part, the buckets are laid out digit
+ *  by digit and thread by thread, so every thread scatters its part
+ *  to its own offsets.
+ *
+ *  N: amount of particles
+ *
+ *  returns: void
+ * --------------------
+ */
+static void radix_sort(int N)
+{
+  uint64_t *src = keys, *dst = keys_tmp;
+  int *src_order = order, *dst_order = order_tmp;
+
+  #pragma omp parallel num_threads(threads)
+  {
+    int t = 0, T = 1;
+
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+    T = omp_get_num_threads();
+#endif
+
+    int begin = (int) ((long) N * t / T);
+    int end = (int) ((long) N * (t + 1) / T);
+    int *count = histogram + t * RADIX;
+
+    for(int pass = 0; pass < PASSES; ++pass)
+    {
+      int shift = 8 * pass;
+
+      for(int d = 0; d < RADIX; ++d)
+      {
+        count[d] = 0;
+      }
+
+      for(int i = begin; i < end; ++i)
+      {
+        ++count[(src[i] >> shift) & (RADIX - 1)];
+      }
+
+      #pragma omp barrier
+      #pragma omp single
+      {
+        int offset = 0;
+
+        for(int d = 0; d < RADIX; ++d)
+        {
+          for(int q = 0; q < T; ++q)
+          {
+            int c = histogram[q * RADIX + d];
+
+            histogram[q * RADIX + d] = offset;
+            offset += c;
+          }
+        }
+      }
+
+      for(int i = begin; i < end; ++i)
+      {
+        int target = count[(src[i] >> shift) & (RADIX - 1)]++;
+
+        dst[target] = src[i];
+        dst_order[target] = src_order[i];
+      }
+
+      #pragma omp barrier
+      #pragma omp single
+      {
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+
+        int *swap_order = src_order;
+        src_order = dst_order;
+        dst_order = swap_order;
+      }
+    }
+  }
+}
+
+/*
+ * Function:  reorder_array
+ * ====================
+ *  Moves the values of all particles to their new index within
+ *  the scratch array and exchanges both arrays, applies the last
+ *  reordering to arrays kept outside of the particles.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  values: array of N * DIM values
+ *
+ *  returns: void
+ * --------------------
+ */
+void reorder_array(int N, int DIM, double complex **values)
+{
+  double complex *from = *values;
+
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
+  {
+    for(int k = 0; k < DIM; ++k)
+    {
+      scratch[mi * DIM + k] = from[order[mi] * DIM + k];
+    }
+  }
+
+  *values = scratch;
+  scratch = from;
+}
+
+/*
+ * Function:  reorder
+ * ====================
+ *  Sorts the particles along the curve. Masses, positions, velocities,
+ *  acceleration and jerk are moved, derivatives kept by the integrator
+ *  itself are moved by its reorder hook. Regularized pairs follow
+ *  their particles.
+ *
+ *  s: particles
+ *
+ *  returns: void
+ * --------------------
+ */
+void reorder(struct state *s)
+{
+  int N = s->n, DIM = s->dim;
+
+  curve_keys(N, s->pos);
+  radix_sort(N);
+
+  reorder_array(N, DIM, &s->pos);
+  reorder_array(N, DIM, &s->vel);
+  reorder_array(N, DIM, &s->acc);
+  reorder_array(N, DIM, &s->jerk);
+
+  /* order_tmp holds the new index of every former index */
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
+  {
+    mass_tmp[mi] = s->mass[order[mi]];
+    ids_tmp[mi] = ids[order[mi]];
+    order_tmp[order[mi]] = mi;
+  }
+
+  double *swap_mass = s->mass;
+  s->mass = mass_tmp;
+  mass_tmp = swap_mass;
+
+  int *swap_ids = ids;
+  ids = ids_tmp;
+  ids_tmp = swap_ids;
+
+  #pragma omp parallel for
+  for(int mi = 0; mi < N; ++mi)
+  {
+    reorder_slot[ids[mi]] = mi;
+  }
+
+  if(ks_partner != NULL)
+  {
+    ks_reorder(N, order_tmp, ids_tmp); /* provided by ks.h */
+  }
+}
+
+/*
+ * Function:  freeReorder
+ * ====================
+ *  Frees all memory allocated by initReorder and disables reordering.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeReorder()
+{
+  workspace_free(keys);
+  workspace_free(keys_tmp);
+  workspace_free(order);
+  workspace_free(order_tmp);
+  workspace_free(ids);
+  workspace_free(ids_tmp);
+  workspace_free(reorder_slot);
+  workspace_free(histogram);
+  workspace_free(mass_tmp);
+  workspace_free(scratch);
+
+  reorder_slot = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef REORDER_H_
+#define REORDER_H_
+
+#define REORDER_MORTON 0 /* Z-order curve */
+#define REORDER_HILBERT 1 /* Hilbert curve, neighbouring keys are always neighbouring cells */
+
+/* index of the particle with every ID, NULL if reordering is disabled */
+extern int *reorder_slot;
+
+size_t reorder_bytes(int N, int DIM);
+
+void initReorder(int N, int DIM, int kind);
+
+const char *curveName(int kind);
+
+void reorder(struct state *s);
+
+void reorder_array(int N, int DIM, double complex **values);
+
+void freeReorder(void);
+
+#endif // REORDER_H_
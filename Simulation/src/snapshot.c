@@ -0,0 +1,1317 @@
+/*
+    The following source code provides methods for writing snapshots of the
+    particles in a versioned binary format. All snapshots are appended as
+    frames to a single trajectory file, every frame starts with a header
+    describing the run and the fields, followed by the raw values of every
+    field in little-endian byte order. A separate index holds offset,
+    iteration and time of every frame in entries of fixed size, so readers
+    find any frame and the amount of frames without scanning the
+    trajectory. Binary snapshots keep the full precision, need no formatting
+    and are smaller than *.csv files, which can be written instead. Snapshots
+    are written every few steps or every interval of time, with a selection
+    of fields. Masses never change and are only stored in the first frame.
+
+    The time loop only converts the particles into a free slot of a bounded
+    queue and carries on, a background thread writes the slots. Producer
+    and writer share the queue without locks, the time loop only waits if
+    all slots are still waiting to be written. Waiting sides block on a
+    condition variable, which the other side signals after moving its end
+    of the queue, so an idle writer sleeps until the next slot is filled.
+
+    In the MPI version every process converts and writes only the slice
+    of particle IDs it owns, at the offsets of the slice within the frame,
+    with collective MPI-IO writes into the shared trajectory. Text
+    snapshots are still written by the first process alone.
+
+    Binary snapshots may be compressed losslessly by the writer, every
+    field is split into blocks of particles which are compressed in
+    parallel, see compress.c. Compressed frames are deltas against the
+    previous frames, every few frames a keyframe is compressed on its own,
+    so any frame can be restored starting from the keyframe before it.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "output.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "snapshot.h"
+#include <time.h>
+#include <unistd.h>
+#include "workspace.h"
+
+#define QUEUE 2 /* slots of the queue, double buffering */
+#define FIELDS 5 /* amount of fields a snapshot can hold */
+
+/* snapshot waiting to be written, values are in the order of the particle IDs
+   and in the precision of the file */
+struct slot
+{
+  int iteration;
+  double time;
+  int fields; /* fields stored in this snapshot */
+  void *values[FIELDS]; /* values of every field, NULL if never selected */
+};
+
+/* fields in the order they are stored, with their names for --fields */
+static const int field_bits[FIELDS] = {SNAPSHOT_POSITION, SNAPSHOT_MASS, SNAPSHOT_VELOCITY, 
+                                       SNAPSHOT_ACCELERATION, SNAPSHOT_JERK};
+static const char *field_names[FIELDS] = {"pos", "mass", "vel", "acc", "jerk"};
+
+static int snapshot_kind = SNAPSHOT_BINARY; /* SNAPSHOT_BINARY or SNAPSHOT_CSV */
+static int snapshot_precision = 8; /* bytes per value */
+static int snapshot_encoding = SNAPSHOT_RAW; /* SNAPSHOT_RAW to SNAPSHOT_QUANT */
+static double snapshot_bound = 0.0; /* largest error of values of SNAPSHOT_QUANT */
+static int snapshot_keyframes = 1; /* frames between keyframes */
+static int snapshot_N, snapshot_DIM;
+static int snapshot_selected; /* fields selected for every snapshot, masses included */
+static int snapshot_every = 1; /* steps between snapshots */
+static double snapshot_interval = 0.0; /* time between snapshots, zero selects snapshot_every */
+static double snapshot_next; /* time of the next snapshot if selected by time */
+static char description[256]; /* format, fields and cadence for the log file */
+static unsigned long snapshot_seed;
+static double snapshot_dt;
+static FILE *frame_index = NULL; /* offset, iteration and time of every frame, open during the run, first process only */
+static uint64_t trajectory_bytes = 0; /* size of the trajectory, the next frame starts here */
+static int snapshot_active = 0; /* nonzero if this process writes snapshots */
+static int snapshot_first, snapshot_last; /* particle IDs converted and written by this process */
+static int threaded = 1; /* nonzero if the frames are written by the background thread */
+
+/* buffers of the compression, for the particles of this process */
+static void *history[FIELDS][XOR_ORDER]; /* values of the previous frames, the latest first */
+static int history_frames = 0; /* frames the history holds, since the last keyframe */
+static int64_t written = 0; /* frames written to the trajectory */
+static int64_t keyframe = 0; /* frame restoring the current frame starts at */
+static unsigned char *packed[FIELDS]; /* compressed blocks of the current frame */
+static uint32_t *block_bytes[FIELDS]; /* size of every compressed block */
+
+#ifdef USE_MPI
+static MPI_Comm snapshot_comm; /* communicator of the writers */
+static MPI_File shared_trajectory; /* trajectory shared by all processes */
+static MPI_Datatype value_type; /* one value in the precision of the file */
+#else
+static FILE *trajectory = NULL; /* all frames, open during the run */
+#endif
+
+static struct slot queue[QUEUE];
+static atomic_uint queue_head; /* slots filled by the time loop */
+static atomic_uint queue_tail; /* slots written by the writer */
+static atomic_int finished; /* no more snapshots will follow */
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* only guards waiting, not the queue */
+static pthread_cond_t moved = PTHREAD_COND_INITIALIZER; /* head or tail of the queue moved */
+
+/* metrics of the queue, reported by freeSnapshots */
+static int frames = 0; /* snapshots handed to the writer */
+static unsigned int max_depth = 0; /* most slots waiting at once */
+static int stalls = 0; /* snapshots that had to wait for a free slot */
+static double stall_time = 0.0; /* seconds the time loop waited */
+static double write_time = 0.0; /* seconds the writer spent writing */
+static uint64_t raw_bytes = 0; /* size of all fields written without compression */
+static uint64_t stored_bytes = 0; /* size of all fields in the trajectory */
+
+/*
+ * Function:  seconds
+ * ====================
+ *  Reads the monotonic clock.
+ *
+ *  returns: current time in seconds
+ * --------------------
+ */
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/*
+ * Function:  signal_moved
+ * ====================
+ *  Wakes the other side of the queue after head, tail or finished
+ *  changed. Taking the lock orders the change before the check of a
+ *  side about to wait, so no wakeup is lost.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void signal_moved()
+{
+  pthread_mutex_lock(&lock);
+  pthread_cond_broadcast(&moved);
+  pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Function:  wait_until_written
+ * ====================
+ *  Blocks until the writer has written all but the given amount of
+ *  slots.
+ *
+ *  head: slots filled by the time loop
+ *  waiting: slots which may still wait to be written
+ *
+ *  returns: void
+ * --------------------
+ */
+static void wait_until_written(unsigned int head, unsigned int waiting)
+{
+  pthread_mutex_lock(&lock);
+
+  while(head - atomic_load_explicit(&queue_tail, memory_order_acquire) > waiting)
+  {
+    pthread_cond_wait(&moved, &lock);
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Function:  big_endian
+ * ====================
+ *  Checks the byte order of the machine.
+ *
+ *  returns: nonzero if the most significant byte comes first
+ * --------------------
+ */
+static int big_endian()
+{
+  const uint16_t probe = 1;
+
+  return *(const unsigned char *) &probe == 0;
+}
+
+/*
+ * Function:  swap_bytes
+ * ====================
+ *  Reverses the bytes of every value.
+ *
+ *  data: values
+ *  count: amount of values
+ *  size: bytes per value
+ *
+ *  returns: void
+ * --------------------
+ */
+static void swap_bytes(void *data, size_t count, size_t size)
+{
+  unsigned char *bytes = data;
+
+  for(size_t v = 0; v < count; ++v, bytes += size)
+  {
+    for(size_t b = 0; b < size / 2; ++b)
+    {
+      unsigned char c = bytes[b];
+      bytes[b] = bytes[size - 1 - b];
+      bytes[size - 1 - b] = c;
+    }
+  }
+}
+
+/*
+ * Function:  write_values
+ * ====================
+ *  Writes values of a slot in little-endian byte order. In the MPI
+ *  version all processes write their slice of the field at once.
+ *
+ *  offset: position of the values within the trajectory
+ *  values: values in the precision of the file
+ *  count: amount of values
+ *
+ *  returns: void
+ * --------------------
+ */
+static void write_values(uint64_t offset, void *values, size_t count)
+{
+  if(big_endian())
+  {
+    swap_bytes(values, count, snapshot_precision);
+  }
+
+#ifdef USE_MPI
+  MPI_File_write_at_all(shared_trajectory, (MPI_Offset) offset, values, (int) count, value_type, MPI_STATUS_IGNORE);
+#else
+  (void) offset; /* frames are appended in order */
+  fwrite(values, snapshot_precision, count, trajectory);
+#endif
+}
+
+/*
+ * Function:  write_bytes
+ * ====================
+ *  Writes bytes into the trajectory. In the MPI version all processes
+ *  write their part at once.
+ *
+ *  offset: position of the bytes within the trajectory
+ *  data: bytes
+ *  count: amount of bytes
+ *
+ *  returns: void
+ * --------------------
+ */
+static void write_bytes(uint64_t offset, const void *data, size_t count)
+{
+#ifdef USE_MPI
+  MPI_File_write_at_all(shared_trajectory, (MPI_Offset) offset, data, (int) count, MPI_BYTE, MPI_STATUS_IGNORE);
+#else
+  (void) offset; /* frames are appended in order */
+  fwrite(data, 1, count, trajectory);
+#endif
+}
+
+/*
+ * Function:  packed_bound
+ * ====================
+ *  encoding: SNAPSHOT_XOR, SNAPSHOT_SHUFFLE or SNAPSHOT_QUANT
+ *  stride: values per particle
+ *  precision: bytes per value
+ *
+ *  returns: most bytes a compressed block of SNAPSHOT_BLOCK particles needs
+ * --------------------
+ */
+static size_t packed_bound(int encoding, int stride, int precision)
+{
+  size_t count = (size_t) SNAPSHOT_BLOCK * stride;
+
+  /* quantized frames compress their masses like SNAPSHOT_SHUFFLE or SNAPSHOT_XOR, which need less */
+  return (encoding == SNAPSHOT_QUANT) ? quant_bound(count, precision) : /* provided by compress.h */
+         (encoding == SNAPSHOT_SHUFFLE) ? shuffle_bound(count, precision) : xor_bound(count, precision);
+}
+
+/*
+ * Function:  stored_encoding
+ * ====================
+ *  Selects the encoding written for the requested one. Compressed floats
+ *  are shuffled into byte planes, since the amount of significant bytes
+ *  kept by xor_encode for every value weighs heavily next to their few
+ *  bytes.
+ *
+ *  format: SNAPSHOT_BINARY or SNAPSHOT_CSV
+ *  precision: bytes per value of binary snapshots, 8 or 4
+ *  encoding: SNAPSHOT_RAW, SNAPSHOT_XOR or SNAPSHOT_QUANT
+ *
+ *  returns: encoding of the frames
+ * --------------------
+ */
+static int stored_encoding(int format, int precision, int encoding)
+{
+  if(format == SNAPSHOT_CSV)
+  {
+    return SNAPSHOT_RAW;
+  }
+
+  return (encoding == SNAPSHOT_XOR && precision == 4) ? SNAPSHOT_SHUFFLE : encoding;
+}
+
+/*
+ * Function:  compress_field
+ * ====================
+ *  Compresses the particles of this process of one field of a slot in
+ *  blocks of SNAPSHOT_BLOCK particles, in parallel. The blocks are moved
+ *  together in their order afterwards.
+ *
+ *  s: slot to be written
+ *  f: field
+ *  order: previous frames the values are predicted from
+ *
+ *  returns: bytes of all blocks
+ * --------------------
+ */
+static uint64_t compress_field(struct slot *s, int f, int order)
+{
+  int stride = (field_bits[f] == SNAPSHOT_MASS) ? 1 : snapshot_DIM; /* values per particle */
+  int count = snapshot_last - snapshot_first;
+  int encoding = snapshot_encoding;
+  int blocks = (count + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK;
+  size_t bound = packed_bound(snapshot_encoding, stride, snapshot_precision);
+  size_t block = (size_t) SNAPSHOT_BLOCK * stride * snapshot_precision; /* bytes of a full block */
+
+  /* masses are never quantized */
+  if(encoding == SNAPSHOT_QUANT && field_bits[f] == SNAPSHOT_MASS)
+  {
+    encoding = stored_encoding(SNAPSHOT_BINARY, snapshot_precision, SNAPSHOT_XOR);
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for(int b = 0; b < blocks; ++b)
+  {
+    int particles = (count - b * SNAPSHOT_BLOCK < SNAPSHOT_BLOCK) ? count - b * SNAPSHOT_BLOCK : SNAPSHOT_BLOCK;
+    const void *recent[XOR_ORDER]; /* block within the previous frames */
+
+    for(int h = 0; h < order; ++h)
+    {
+      recent[h] = (char *) history[f][h] + b * block;
+    }
+
+    void *values = (char *) s->values[f] + b * block;
+    size_t length = (size_t) particles * stride;
+
+    /* quantized values are replaced by the restored ones, which become the history */
+    if(encoding == SNAPSHOT_QUANT)
+    {
+      block_bytes[f][b] = quant_encode(values, recent, length, stride, snapshot_precision, order, snapshot_bound, 
+                                       packed[f] + b * bound); /* provided by compress.h */
+    }
+    else if(encoding == SNAPSHOT_SHUFFLE)
+    {
+      block_bytes[f][b] = shuffle_encode(values, recent, length, stride, snapshot_precision, order, packed[f] + b * bound);
+    }
+    else
+    {
+      block_bytes[f][b] = xor_encode(values, recent, length, stride, snapshot_precision, order, packed[f] + b * bound);
+    }
+  }
+
+  uint64_t length = 0;
+
+  for(int b = 0; b < blocks; ++b)
+  {
+    memmove(packed[f] + length, packed[f] + b * bound, block_bytes[f][b]);
+    length += block_bytes[f][b];
+  }
+
+  return length;
+}
+
+/*
+ * Function:  write_frame
+ * ====================
+ *  Appends a slot as a frame to the trajectory and its entry to the
+ *  frame index, or creates a *.csv file for it. The index entry follows
+ *  the complete frame, so readers never see a partial frame. In the MPI
+ *  version every process writes its slice of every field and the first
+ *  process the header and the index entry. Compressed frames keep the
+ *  fields of the last XOR_ORDER frames since the keyframe to predict the
+ *  next one.
+ *
+ *  s: slot to be written
+ *
+ *  returns: void
+ * --------------------
+ */
+static void write_frame(struct slot *s)
+{
+  int N = snapshot_N, DIM = snapshot_DIM;
+
+  if(snapshot_kind == SNAPSHOT_CSV)
+  {
+    printIteration(N, DIM, s->iteration, s->values[1], s->values[0], s->values[2]); /* provided by output.h */
+    return;
+  }
+
+  /* keyframes do not depend on previous frames, the first frame after a restart has none */
+  if(written % snapshot_keyframes == 0 || history_frames == 0)
+  {
+    history_frames = 0;
+    keyframe = written;
+  }
+
+  struct snapshot_index_entry entry = {trajectory_bytes, s->iteration, s->time, keyframe};
+  int order = (snapshot_encoding != SNAPSHOT_RAW) ? ((history_frames < XOR_ORDER) ? history_frames : XOR_ORDER) : 0;
+  int blocks = (N + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK; /* compressed blocks of every field */
+  uint64_t local[FIELDS] = {0}; /* compressed bytes of this process */
+  uint64_t preceding[FIELDS] = {0}; /* compressed bytes of the processes before */
+  uint64_t total[FIELDS] = {0}; /* bytes of every field */
+  uint64_t bytes = 0; /* bytes of all fields */
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(s->fields & field_bits[f])
+    {
+      total[f] = (uint64_t) N * ((field_bits[f] == SNAPSHOT_MASS) ? 1 : DIM) * snapshot_precision;
+      raw_bytes += total[f];
+
+      if(snapshot_encoding != SNAPSHOT_RAW)
+      {
+        local[f] = compress_field(s, f, order);
+      }
+    }
+  }
+
+  if(snapshot_encoding != SNAPSHOT_RAW)
+  {
+#ifdef USE_MPI
+    MPI_Exscan(local, preceding, FIELDS, MPI_UINT64_T, MPI_SUM, snapshot_comm);
+    MPI_Allreduce(local, total, FIELDS, MPI_UINT64_T, MPI_SUM, snapshot_comm);
+
+    if(world_rank == 0)
+    {
+      memset(preceding, 0, sizeof(preceding)); /* undefined on the first process */
+    }
+#else
+    memcpy(total, local, sizeof(total));
+#endif
+
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      total[f] += (s->fields & field_bits[f]) ? blocks * sizeof(uint32_t) : 0; /* sizes of the blocks */
+    }
+  }
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    bytes += total[f];
+  }
+
+  stored_bytes += bytes;
+
+  struct snapshot_header header;
+  memset(&header, 0, sizeof(header));
+
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.endian = SNAPSHOT_ENDIAN;
+  header.header_bytes = sizeof(header);
+  header.fields = s->fields;
+  header.precision = snapshot_precision;
+  header.dim = DIM;
+  header.n = N;
+  header.iteration = s->iteration;
+  header.seed = snapshot_seed;
+  header.time = s->time;
+  header.dt = snapshot_dt;
+  header.encoding = snapshot_encoding;
+  header.order = order;
+  header.bytes = bytes;
+  header.quantum = (snapshot_encoding == SNAPSHOT_QUANT) ? quant_step(snapshot_bound) : 0.0;
+
+  /* every member after the magic has four or eight bytes */
+  if(big_endian())
+  {
+    swap_bytes(&header.version, 6, sizeof(uint32_t));
+    swap_bytes(&header.n, 5, sizeof(int64_t));
+    swap_bytes(&header.encoding, 2, sizeof(uint32_t));
+    swap_bytes(&header.bytes, 1, sizeof(uint64_t));
+    swap_bytes(&header.quantum, 1, sizeof(double));
+  }
+
+#ifdef USE_MPI
+  if(world_rank == 0)
+  {
+    MPI_File_write_at(shared_trajectory, (MPI_Offset) trajectory_bytes, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+#else
+  fwrite(&header, sizeof(header), 1, trajectory);
+#endif
+
+  uint64_t offset = trajectory_bytes + sizeof(header); /* start of the next field */
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(!(s->fields & field_bits[f]))
+    {
+      continue;
+    }
+
+    if(snapshot_encoding != SNAPSHOT_RAW)
+    {
+      int count = (snapshot_last - snapshot_first + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK; /* blocks of this process */
+
+      if(big_endian())
+      {
+        swap_bytes(block_bytes[f], count, sizeof(uint32_t));
+      }
+
+      write_bytes(offset + (snapshot_first / SNAPSHOT_BLOCK) * sizeof(uint32_t), block_bytes[f], count * sizeof(uint32_t));
+      write_bytes(offset + blocks * sizeof(uint32_t) + preceding[f], packed[f], local[f]);
+    }
+    else
+    {
+      size_t width = (size_t) snapshot_precision * ((field_bits[f] == SNAPSHOT_MASS) ? 1 : DIM); /* bytes per particle */
+
+      write_values(offset + snapshot_first * width, s->values[f], 
+                   (size_t) (snapshot_last - snapshot_first) * width / snapshot_precision);
+    }
+
+    offset += total[f];
+  }
+
+  trajectory_bytes = offset;
+
+  /* the current frame becomes the previous one */
+  if(snapshot_encoding != SNAPSHOT_RAW)
+  {
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      if(history[f][0] != NULL && (s->fields & field_bits[f]))
+      {
+        void *oldest = history[f][XOR_ORDER - 1];
+        memmove(&history[f][1], &history[f][0], (XOR_ORDER - 1) * sizeof(void *));
+        history[f][0] = oldest;
+
+        memcpy(oldest, s->values[f], (size_t) (snapshot_last - snapshot_first) * DIM * snapshot_precision);
+      }
+    }
+
+    ++history_frames;
+  }
+
+  ++written;
+
+#ifdef USE_MPI
+  /* every slice has to be complete before the frame is indexed */
+  MPI_File_sync(shared_trajectory);
+  MPI_Barrier(snapshot_comm);
+#else
+  fflush(trajectory);
+#endif
+
+  if(world_rank == 0)
+  {
+    if(big_endian())
+    {
+      swap_bytes(&entry, 4, sizeof(uint64_t));
+    }
+
+    fwrite(&entry, sizeof(entry), 1, frame_index);
+    fflush(frame_index);
+  }
+}
+
+/*
+ * Function:  snapshot_writer
+ * ====================
+ *  Background thread, writes the slots in the order they were filled
+ *  until freeSnapshots is called and the queue is empty.
+ *
+ *  arg: unused
+ *
+ *  returns: NULL
+ * --------------------
+ */
+static void *snapshot_writer(void *arg)
+{
+  (void) arg;
+
+  while(1)
+  {
+    unsigned int tail = atomic_load_explicit(&queue_tail, memory_order_relaxed);
+
+    /* the slot is complete once the time loop has published it */
+    if(atomic_load_explicit(&queue_head, memory_order_acquire) == tail)
+    {
+      pthread_mutex_lock(&lock);
+
+      while(atomic_load_explicit(&queue_head, memory_order_acquire) == tail &&
+            !atomic_load_explicit(&finished, memory_order_acquire))
+      {
+        pthread_cond_wait(&moved, &lock);
+      }
+
+      pthread_mutex_unlock(&lock);
+
+      /* snapshots published before finishing are written first */
+      if(atomic_load_explicit(&queue_head, memory_order_acquire) == tail)
+      {
+        break;
+      }
+    }
+
+    double start = seconds();
+    write_frame(&queue[tail % QUEUE]);
+    write_time += seconds() - start;
+
+    atomic_store_explicit(&queue_tail, tail + 1, memory_order_release);
+    signal_moved();
+  }
+
+  return NULL;
+}
+
+/*
+ * Function:  snapshot_fields
+ * ====================
+ *  Parses a list of fields separated by commas, positions are always
+ *  stored and masses in the first snapshot.
+ *
+ *  names: list of pos, vel, acc and jerk
+ *
+ *  returns: selected fields or zero if a name is unknown
+ * --------------------
+ */
+int snapshot_fields(const char *names)
+{
+  int fields = SNAPSHOT_POSITION | SNAPSHOT_MASS;
+
+  while(*names != '\0')
+  {
+    size_t length = strcspn(names, ",");
+    int f = 0;
+
+    while(f < FIELDS && (strlen(field_names[f]) != length || strncmp(names, field_names[f], length) != 0))
+    {
+      ++f;
+    }
+
+    if(f == FIELDS)
+    {
+      return 0;
+    }
+
+    fields |= field_bits[f];
+    names += length + (names[length] == ',');
+  }
+
+  return fields;
+}
+
+/*
+ * Function:  save_snapshots
+ * ====================
+ *  Checkpoint hook, waits until the writer has written all slots.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void save_snapshots()
+{
+  if(!snapshot_active)
+  {
+    return;
+  }
+
+  wait_until_written(atomic_load_explicit(&queue_head, memory_order_relaxed), 0);
+}
+
+/*
+ * Function:  resume_snapshots
+ * ====================
+ *  Checkpoint hook, removes the frames written after the checkpoint
+ *  from trajectory and frame index, the next frame is appended. 
+ *  Called by every process.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void resume_snapshots()
+{
+  if(!snapshot_active || snapshot_kind != SNAPSHOT_BINARY)
+  {
+    return;
+  }
+
+#ifdef USE_MPI
+  MPI_File_set_size(shared_trajectory, (MPI_Offset) trajectory_bytes);
+#else
+  if(ftruncate(fileno(trajectory), (off_t) trajectory_bytes) != 0 || fseek(trajectory, (long) trajectory_bytes, SEEK_SET) != 0)
+  {
+    fprintf(stderr, "Unable to continue the trajectory!\n");
+    exit(0);
+  }
+#endif
+
+  if(frame_index != NULL)
+  {
+    long entries = (long) (sizeof(struct snapshot_index_header) + written * sizeof(struct snapshot_index_entry));
+
+    if(ftruncate(fileno(frame_index), (off_t) entries) != 0 || fseek(frame_index, entries, SEEK_SET) != 0)
+    {
+      fprintf(stderr, "Unable to continue the trajectory!\n");
+      exit(0);
+    }
+  }
+}
+
+/*
+ * Function:  snapshot_slice
+ * ====================
+ *  Finds the contiguous slice of the particle IDs this process converts
+ *  and writes, made of whole blocks, all of them for text snapshots.
+ *
+ *  N: amount of particles
+ *  format: SNAPSHOT_BINARY or SNAPSHOT_CSV
+ *  first: first particle ID of the slice
+ *  last: particle ID after the slice
+ *
+ *  returns: void
+ * --------------------
+ */
+static void snapshot_slice(int N, int format, int *first, int *last)
+{
+  int blocks = (N + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK;
+  long begin = (long) SNAPSHOT_BLOCK * (blocks * (long) world_rank / world_size);
+  long end = (long) SNAPSHOT_BLOCK * (blocks * (long) (world_rank + 1) / world_size);
+
+  *first = (format == SNAPSHOT_BINARY) ? (int) ((begin < N) ? begin : N) : 0;
+  *last = (format == SNAPSHOT_BINARY) ? (int) ((end < N) ? end : N) : N;
+}
+
+/*
+ * Function:  snapshot_bytes
+ * ====================
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  format: SNAPSHOT_BINARY or SNAPSHOT_CSV
+ *  precision: bytes per value of binary snapshots, 8 or 4
+ *  fields: fields of every snapshot, see snapshot_fields
+ *  encoding: SNAPSHOT_RAW, SNAPSHOT_XOR or SNAPSHOT_QUANT for binary snapshots
+ *
+ *  returns: size of all arrays initSnapshots takes from the workspace of this process
+ * --------------------
+ */
+size_t snapshot_bytes(int N, int DIM, int format, int precision, int fields, int encoding)
+{
+  int first, last;
+  size_t bytes = 0;
+
+  if(world_rank != 0 && format != SNAPSHOT_BINARY)
+  {
+    return 0;
+  }
+
+  precision = (format == SNAPSHOT_CSV) ? 8 : precision;
+  fields = (format == SNAPSHOT_CSV) ? SNAPSHOT_POSITION | SNAPSHOT_MASS | SNAPSHOT_VELOCITY : fields;
+  encoding = stored_encoding(format, precision, encoding);
+
+  snapshot_slice(N, format, &first, &last);
+
+  int count = (last - first + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK; /* blocks of this process */
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    int stride = (field_bits[f] == SNAPSHOT_MASS) ? 1 : DIM;
+
+    if(!(fields & field_bits[f]))
+    {
+      continue;
+    }
+
+    bytes += QUEUE * workspace_bytes((size_t) (last - first) * stride, precision); /* provided by workspace.h */
+
+    if(encoding != SNAPSHOT_RAW)
+    {
+      bytes += workspace_bytes(count * packed_bound(encoding, stride, precision), 1)
+               + workspace_bytes(count, sizeof(uint32_t));
+
+      if(field_bits[f] != SNAPSHOT_MASS)
+      {
+        bytes += XOR_ORDER * workspace_bytes((size_t) (last - first) * DIM, precision);
+      }
+    }
+  }
+
+  return bytes;
+}
+
+/*
+ * Function:  initSnapshots
+ * ====================
+ *  Sets format, fields and cadence of all snapshots, takes the slots of
+ *  the queue from the workspace, creates trajectory and frame index and
+ *  starts the writer. Called by every process, in the MPI version all
+ *  processes write binary snapshots together and only the first process
+ *  writes text snapshots. Text snapshots always hold positions, masses
+ *  and velocities. A run continued from a checkpoint appends to the
+ *  trajectory of the run it continues.
+ *
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *  format: SNAPSHOT_BINARY or SNAPSHOT_CSV
+ *  precision: bytes per value of binary snapshots, 8 or 4
+ *  fields: fields of every snapshot, see snapshot_fields
+ *  encoding: SNAPSHOT_RAW, SNAPSHOT_XOR or SNAPSHOT_QUANT for binary snapshots
+ *  bound: largest error of a value of SNAPSHOT_QUANT
+ *  keyframes: frames between keyframes of compressed snapshots
+ *  every: steps between snapshots
+ *  interval: time between snapshots, zero uses every instead
+ *  seed: seed of the initial conditions
+ *  dt: timestep
+ *
+ *  returns: void
+ * --------------------
+ */
+void initSnapshots(int N, int DIM, int format, int precision, int fields, int encoding, double bound, int keyframes, int every, 
+                   double interval, unsigned long seed, double dt)
+{
+  snapshot_kind = format;
+  snapshot_precision = (format == SNAPSHOT_CSV) ? 8 : precision; /* text is formatted from doubles */
+  snapshot_selected = (format == SNAPSHOT_CSV) ? SNAPSHOT_POSITION | SNAPSHOT_MASS | SNAPSHOT_VELOCITY : fields;
+  snapshot_encoding = stored_encoding(format, precision, encoding);
+  snapshot_bound = bound;
+  snapshot_keyframes = (snapshot_encoding != SNAPSHOT_RAW) ? keyframes : 1; /* raw frames stand alone */
+  snapshot_every = every;
+  snapshot_interval = snapshot_next = interval;
+  snapshot_N = N;
+  snapshot_DIM = DIM;
+  snapshot_seed = seed;
+  snapshot_dt = dt;
+  snapshot_active = (world_rank == 0 || format == SNAPSHOT_BINARY);
+
+  snapshot_slice(N, format, &snapshot_first, &snapshot_last);
+
+  /* registered by every process, so all of them restore the same items */
+  checkpoint_value("snap_next", &snapshot_next, sizeof(snapshot_next)); /* provided by checkpoint.h */
+  checkpoint_value("snap_frames", &frames, sizeof(frames));
+  checkpoint_value("snap_written", &written, sizeof(written));
+  checkpoint_value("snap_bytes", &trajectory_bytes, sizeof(trajectory_bytes));
+  checkpoint_hooks(save_snapshots, resume_snapshots);
+
+  if(!snapshot_active)
+  {
+    return;
+  }
+
+  int resuming = (checkpoint_resumed() != NULL); /* files are truncated to the checkpoint by resume_snapshots */
+
+  for(int q = 0; q < QUEUE; ++q)
+  {
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      queue[q].values[f] = (snapshot_selected & field_bits[f]) ? 
+        workspace_alloc((size_t) (snapshot_last - snapshot_first) * ((field_bits[f] == SNAPSHOT_MASS) ? 1 : DIM), 
+                        snapshot_precision) : NULL; /* provided by workspace.h */
+    }
+  }
+
+  if(snapshot_encoding != SNAPSHOT_RAW)
+  {
+    int count = (snapshot_last - snapshot_first + SNAPSHOT_BLOCK - 1) / SNAPSHOT_BLOCK; /* blocks of this process */
+
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      if(snapshot_selected & field_bits[f])
+      {
+        int stride = (field_bits[f] == SNAPSHOT_MASS) ? 1 : DIM;
+
+        packed[f] = workspace_alloc(count * packed_bound(snapshot_encoding, stride, snapshot_precision), 1);
+        block_bytes[f] = workspace_alloc(count, sizeof(uint32_t));
+      }
+
+      /* masses are only stored once and never predicted from previous frames */
+      if((snapshot_selected & field_bits[f]) && field_bits[f] != SNAPSHOT_MASS)
+      {
+        for(int h = 0; h < XOR_ORDER; ++h)
+        {
+          history[f][h] = workspace_alloc((size_t) (snapshot_last - snapshot_first) * DIM, snapshot_precision);
+        }
+      }
+    }
+  }
+
+  /* description for the log file */
+  int length = snprintf(description, sizeof(description), "%s", (format == SNAPSHOT_CSV) ? "csv" : 
+                        (precision == 4) ? "binary, single precision" : "binary, double precision");
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(snapshot_selected & field_bits[f])
+    {
+      length += snprintf(description + length, sizeof(description) - length, 
+                         (field_bits[f] == SNAPSHOT_MASS && format != SNAPSHOT_CSV) ? ", %s once" : ", %s", field_names[f]);
+    }
+  }
+
+  if(snapshot_encoding == SNAPSHOT_QUANT)
+  {
+    length += snprintf(description + length, sizeof(description) - length, 
+                       ", quantized to errors of at most %g, keyframe every %d frames", bound, keyframes);
+  }
+  else if(snapshot_encoding != SNAPSHOT_RAW)
+  {
+    length += snprintf(description + length, sizeof(description) - length, ", xor compressed%s, keyframe every %d frames", 
+                       (snapshot_encoding == SNAPSHOT_SHUFFLE) ? " in byte planes" : "", keyframes);
+  }
+
+  if(interval > 0)
+  {
+    snprintf(description + length, sizeof(description) - length, ", every %f time units", interval);
+  }
+  else
+  {
+    snprintf(description + length, sizeof(description) - length, ", every %d steps", every);
+  }
+
+  if(format == SNAPSHOT_BINARY)
+  {
+    char buffer[80];
+
+    snprintf(buffer, sizeof(buffer), "./%s/trajectory.nbs", foldername);
+
+#ifdef USE_MPI
+    MPI_Comm_dup(MPI_COMM_WORLD, &snapshot_comm);
+    MPI_Type_contiguous(snapshot_precision, MPI_BYTE, &value_type);
+    MPI_Type_commit(&value_type);
+
+    if(MPI_File_open(snapshot_comm, buffer, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, 
+                     &shared_trajectory) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Unable to create the trajectory!\n");
+      exit(0);
+    }
+
+    if(!resuming)
+    {
+      MPI_File_set_size(shared_trajectory, 0);
+    }
+
+    /* the writer may only communicate alongside the time loop if MPI allows it */
+    int provided;
+    MPI_Query_thread(&provided);
+    threaded = (provided == MPI_THREAD_MULTIPLE);
+#else
+    trajectory = fopen(buffer, resuming ? "r+b" : "wb");
+
+    if(trajectory == NULL)
+    {
+      fprintf(stderr, "Unable to create the trajectory!\n");
+      exit(0);
+    }
+#endif
+  }
+
+  if(format == SNAPSHOT_BINARY && world_rank == 0)
+  {
+    char buffer[80];
+
+    snprintf(buffer, sizeof(buffer), "./%s/trajectory.idx", foldername);
+    frame_index = fopen(buffer, resuming ? "r+b" : "wb");
+
+    if(frame_index == NULL)
+    {
+      fprintf(stderr, "Unable to create the trajectory!\n");
+      exit(0);
+    }
+
+    struct snapshot_index_header header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, SNAPSHOT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian = SNAPSHOT_ENDIAN;
+    header.header_bytes = sizeof(header);
+    header.entry_bytes = sizeof(struct snapshot_index_entry);
+
+    if(big_endian())
+    {
+      swap_bytes(&header.version, 4, sizeof(uint32_t));
+    }
+
+    if(!resuming)
+    {
+      fwrite(&header, sizeof(header), 1, frame_index);
+    }
+  }
+
+  atomic_init(&queue_head, 0);
+  atomic_init(&queue_tail, 0);
+  atomic_init(&finished, 0);
+
+  if(threaded && pthread_create(&writer, NULL, snapshot_writer, NULL) != 0)
+  {
+    fprintf(stderr, "Unable to start snapshot writer!\n");
+    exit(0);
+  }
+}
+
+/*
+ * Function:  freeSnapshots
+ * ====================
+ *  Waits until the writer has written all slots, stops it, prints the
+ *  metrics of the queue, closes trajectory and frame index and frees
+ *  the slots. Called by every process.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeSnapshots()
+{
+  if(!snapshot_active)
+  {
+    return;
+  }
+
+  if(threaded)
+  {
+    atomic_store_explicit(&finished, 1, memory_order_release);
+    signal_moved();
+    pthread_join(writer, NULL);
+  }
+
+  if(world_rank == 0)
+  {
+    printf("Snapshots written: %d, at most %u of %d slots waiting, time loop waited %d times for %f seconds, "
+           "writer busy for %f seconds\n", frames, max_depth, QUEUE, stalls, stall_time, write_time);
+
+    if(snapshot_encoding != SNAPSHOT_RAW && raw_bytes > 0)
+    {
+      printf("Snapshots compressed to %f of %llu bytes\n", (double) stored_bytes / raw_bytes, 
+             (unsigned long long) raw_bytes);
+    }
+  }
+
+  if(snapshot_kind == SNAPSHOT_BINARY)
+  {
+#ifdef USE_MPI
+    MPI_File_close(&shared_trajectory);
+    MPI_Type_free(&value_type);
+    MPI_Comm_free(&snapshot_comm);
+#else
+    fclose(trajectory);
+    trajectory = NULL;
+#endif
+  }
+
+  if(frame_index != NULL)
+  {
+    fclose(frame_index);
+    frame_index = NULL;
+  }
+
+  for(int q = 0; q < QUEUE; ++q)
+  {
+    for(int f = 0; f < FIELDS; ++f)
+    {
+      if(queue[q].values[f] != NULL)
+      {
+        workspace_free(queue[q].values[f]);
+        queue[q].values[f] = NULL;
+      }
+    }
+  }
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(packed[f] != NULL)
+    {
+      workspace_free(packed[f]);
+      workspace_free(block_bytes[f]);
+      packed[f] = NULL;
+      block_bytes[f] = NULL;
+    }
+
+    for(int h = 0; h < XOR_ORDER; ++h)
+    {
+      if(history[f][h] != NULL)
+      {
+        workspace_free(history[f][h]);
+        history[f][h] = NULL;
+      }
+    }
+  }
+}
+
+/*
+ * Function:  snapshot_format
+ * ====================
+ *  Describes format, fields and cadence of the snapshots for the log 
+ *  file, set by initSnapshots.
+ *
+ *  returns: description
+ * --------------------
+ */
+const char *snapshot_format()
+{
+  return description;
+}
+
+/*
+ * Function:  snapshot_due
+ * ====================
+ *  Decides whether the current iteration is written, every snapshot_every 
+ *  steps or at the first step reaching the next multiple of the interval.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  dt: timestep
+ *
+ *  returns: nonzero if a snapshot is due
+ * --------------------
+ */
+int snapshot_due(int iteration, double time, double dt)
+{
+  if(snapshot_interval <= 0)
+  {
+    return iteration % snapshot_every == 0;
+  }
+
+  if(time < snapshot_next - 0.5 * dt)
+  {
+    return 0;
+  }
+
+  /* next multiple of the interval after the current time */
+  while(time >= snapshot_next - 0.5 * dt)
+  {
+    snapshot_next += snapshot_interval;
+  }
+
+  return 1;
+}
+
+/*
+ * Function:  stage_vectors
+ * ====================
+ *  Converts a vector of the particles of this process into a slot, in
+ *  the order of the particle IDs.
+ *
+ *  DIM: dimensions of space
+ *  staged: values of the slot
+ *  values: vectors of all particles
+ *  slot: index of the particle with every ID, NULL if unordered
+ *
+ *  returns: void
+ * --------------------
+ */
+static void stage_vectors(int DIM, void *staged, const double complex *values, const int *slot)
+{
+  #pragma omp parallel for
+  for(int id = snapshot_first; id < snapshot_last; ++id)
+  {
+    int mi = (slot != NULL) ? slot[id] : id;
+    size_t si = (size_t) (id - snapshot_first) * DIM; /* position within the slot */
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      if(snapshot_precision == 4)
+      {
+        ((float *) staged)[si + k] = (float) creal(values[mi * DIM + k]);
+      }
+      else
+      {
+        ((double *) staged)[si + k] = creal(values[mi * DIM + k]);
+      }
+    }
+  }
+}
+
+/*
+ * Function:  stage_scalars
+ * ====================
+ *  Converts a value of the particles of this process into a slot, in
+ *  the order of the particle IDs.
+ *
+ *  staged: values of the slot
+ *  values: values of all particles
+ *  slot: index of the particle with every ID, NULL if unordered
+ *
+ *  returns: void
+ * --------------------
+ */
+static void stage_scalars(void *staged, const double *values, const int *slot)
+{
+  #pragma omp parallel for
+  for(int id = snapshot_first; id < snapshot_last; ++id)
+  {
+    int mi = (slot != NULL) ? slot[id] : id;
+
+    if(snapshot_precision == 4)
+    {
+      ((float *) staged)[id - snapshot_first] = (float) values[mi];
+    }
+    else
+    {
+      ((double *) staged)[id - snapshot_first] = values[mi];
+    }
+  }
+}
+
+/*
+ * Function:  write_snapshot
+ * ====================
+ *  Converts the selected fields of all particles into the next free slot
+ *  and hands it to the writer, waits only while all slots are still
+ *  waiting to be written. Binary snapshots only hold masses the first 
+ *  time. Called by every process, writes the frame right away if MPI
+ *  does not allow the writer to communicate.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  s: particles
+ *  slot: index of the particle with every ID, NULL if unordered
+ *
+ *  returns: void
+ * --------------------
+ */
+void write_snapshot(int iteration, double time, const struct state *s, const int *slot)
+{
+  int DIM = s->dim;
+  const double complex *vectors[FIELDS] = {s->pos, NULL, s->vel, s->acc, s->jerk};
+
+  if(!snapshot_active)
+  {
+    return;
+  }
+
+  unsigned int head = atomic_load_explicit(&queue_head, memory_order_relaxed);
+
+  /* back-pressure, the oldest slot has to be written first */
+  if(head - atomic_load_explicit(&queue_tail, memory_order_acquire) == QUEUE)
+  {
+    double start = seconds();
+    wait_until_written(head, QUEUE - 1);
+
+    ++stalls;
+    stall_time += seconds() - start;
+  }
+
+  struct slot *next = &queue[head % QUEUE];
+
+  next->iteration = iteration;
+  next->time = time;
+  next->fields = snapshot_selected;
+
+  if(snapshot_kind == SNAPSHOT_BINARY && frames > 0)
+  {
+    next->fields &= ~SNAPSHOT_MASS;
+  }
+
+  for(int f = 0; f < FIELDS; ++f)
+  {
+    if(next->fields & field_bits[f])
+    {
+      if(field_bits[f] == SNAPSHOT_MASS)
+      {
+        stage_scalars(next->values[f], s->mass, slot);
+      }
+      else
+      {
+        stage_vectors(DIM, next->values[f], vectors[f], slot);
+      }
+    }
+  }
+
+  if(!threaded)
+  {
+    double start = seconds();
+    write_frame(next);
+    write_time += seconds() - start;
+
+    atomic_store_explicit(&queue_tail, head + 1, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&queue_head, head + 1, memory_order_release);
+
+  if(threaded)
+  {
+    signal_moved();
+  }
+
+  unsigned int depth = head + 1 - atomic_load_explicit(&queue_tail, memory_order_acquire);
+  max_depth = (depth > max_depth) ? depth : max_depth;
+  ++frames;
+}
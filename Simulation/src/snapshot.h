@@ -0,0 +1,99 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SNAPSHOT_BINARY 0 /* versioned binary snapshots, the default */
+#define SNAPSHOT_CSV 1 /* one line of text per particle */
+
+#define SNAPSHOT_MAGIC "NBODYSNP" /* first bytes of every binary snapshot */
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_ENDIAN 0x01020304u /* reads as 0x04030201 if the byte order is swapped */
+#define SNAPSHOT_INDEX_MAGIC "NBODYIDX" /* first bytes of the frame index */
+
+/* fields of a snapshot, stored in this order if present */
+#define SNAPSHOT_POSITION 1 /* N * DIM values, particle by particle */
+#define SNAPSHOT_MASS 2 /* N values, only stored in the first frame since masses do not change */
+#define SNAPSHOT_VELOCITY 4 /* N * DIM values, particle by particle */
+#define SNAPSHOT_ACCELERATION 8 /* N * DIM values, particle by particle */
+#define SNAPSHOT_JERK 16 /* N * DIM values, particle by particle */
+
+/* encodings of the fields of a frame */
+#define SNAPSHOT_RAW 0 /* raw values */
+#define SNAPSHOT_XOR 1 /* values predicted from previous frames and compressed by xor_encode in blocks */
+#define SNAPSHOT_SHUFFLE 2 /* values predicted like SNAPSHOT_XOR and compressed by shuffle_encode in blocks */
+#define SNAPSHOT_QUANT 3 /* values within an error bound compressed by quant_encode in blocks, masses like
+                            SNAPSHOT_SHUFFLE if they are floats and like SNAPSHOT_XOR otherwise */
+#define SNAPSHOT_BLOCK 1024 /* particles per compressed block */
+
+/* header at the start of every frame of the trajectory, all values are little-endian
+   and followed by the fields as values of the given precision in the order of the
+   particle IDs. Compressed fields start with the sizes of their blocks as 32 bit
+   integers, followed by the blocks, each holding SNAPSHOT_BLOCK particles */
+struct snapshot_header
+{
+  char magic[8]; /* SNAPSHOT_MAGIC without terminating zero */
+  uint32_t version; /* SNAPSHOT_VERSION */
+  uint32_t endian; /* SNAPSHOT_ENDIAN */
+  uint32_t header_bytes; /* size of this header, the first field starts here */
+  uint32_t fields; /* fields stored in this frame, SNAPSHOT_POSITION to SNAPSHOT_JERK combined */
+  uint32_t precision; /* bytes per value, 8 for doubles and 4 for floats */
+  uint32_t dim; /* dimensions of space */
+  int64_t n; /* amount of particles */
+  int64_t iteration; /* iteration of the snapshot */
+  uint64_t seed; /* seed of the initial conditions */
+  double time; /* time of the snapshot */
+  double dt; /* timestep */
+  uint32_t encoding; /* SNAPSHOT_RAW to SNAPSHOT_QUANT */
+  uint32_t order; /* previous frames compressed values are predicted from, 0 to 3, zero for keyframes */
+  uint64_t bytes; /* size of the fields, the next frame follows */
+  double quantum; /* step of SNAPSHOT_QUANT, see quant_step, zero for other encodings, not part of version 2 */
+};
+
+/* header of the frame index, followed by one entry per frame */
+struct snapshot_index_header
+{
+  char magic[8]; /* SNAPSHOT_INDEX_MAGIC without terminating zero */
+  uint32_t version; /* SNAPSHOT_VERSION */
+  uint32_t endian; /* SNAPSHOT_ENDIAN */
+  uint32_t header_bytes; /* size of this header, the first entry starts here */
+  uint32_t entry_bytes; /* size of every entry, frame k starts at header_bytes + k * entry_bytes */
+};
+
+/* entry of the frame index, little-endian like the trajectory */
+struct snapshot_index_entry
+{
+  uint64_t offset; /* position of the frame header within the trajectory */
+  int64_t iteration; /* iteration of the frame */
+  double time; /* time of the frame */
+  int64_t keyframe; /* number of the keyframe before this frame, restoring the frame starts there */
+};
+
+struct state; /* particles, see engine.h, only needed by the simulation */
+
+int snapshot_fields(const char *names);
+
+size_t snapshot_bytes(int N, int DIM, int format, int precision, int fields, int encoding);
+
+void initSnapshots(int N, int DIM, int format, int precision, int fields, int encoding, double bound, int keyframes, int every, 
+                   double interval, unsigned long seed, double dt);
+
+const char *snapshot_format(void);
+
+int snapshot_due(int iteration, double time, double dt);
+
+void write_snapshot(int iteration, double time, const struct state *s, const int *slot);
+
+void freeSnapshots(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SNAPSHOT_H_
@@ -0,0 +1,557 @@
+/*
+    The following source code provides methods for streaming the positions
+    of the particles to viewers on the same machine while the simulation
+    runs, so a run can be watched and aborted early. Frames are sent over
+    a UNIX domain socket which viewers connect to, or over a named pipe if
+    the given path already is one, every few steps.
+
+    The time loop only converts the positions into a free slot and carries
+    on, a background thread sends the newest slot to every viewer without
+    blocking. Viewers still busy with an older frame skip the frames in
+    between, so a slow viewer only misses frames itself and never slows
+    down the time loop or the other viewers. Every viewer may hold one
+    slot, if all slots are taken the frame is dropped. Viewers see the
+    gaps in the sequence numbers of the frames. Positions are only
+    converted while a viewer is connected.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include "engine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "workspace.h"
+
+#define SLOTS (STREAM_VIEWERS + 2) /* one per viewer, one waiting to be sent and one for the time loop */
+#define IDLE 1000000 /* nanoseconds the sender sleeps while there is nothing to send */
+#define PATIENCE 100 /* milliseconds the sender waits for viewers at the end of the run */
+
+/* states of the slots, only the time loop fills free slots and only the sender frees them */
+#define SLOT_FREE 0
+#define SLOT_FILLED 1 /* published by the time loop */
+#define SLOT_SENDING 2 /* held by the sender for at least one viewer */
+
+/* connection of a viewer, only used by the sender */
+struct viewer
+{
+  int fd; /* socket or named pipe, -1 if not connected */
+  int slot; /* slot being sent, -1 if idle */
+  size_t sent; /* bytes of the slot sent so far */
+  uint64_t next; /* sequence number the next frame starts at */
+};
+
+static int stream_active = 0; /* nonzero if this process streams, the first process only */
+static int stream_every = 1; /* steps between frames */
+static int stream_N, stream_DIM;
+static int stream_fifo = 0; /* nonzero for a named pipe, zero for a socket */
+static char stream_path[108]; /* socket or named pipe */
+static int listener = -1; /* listening socket */
+static struct viewer viewers[STREAM_VIEWERS]; /* the named pipe only uses the first */
+static size_t frame_bytes; /* header and positions */
+
+static unsigned char *slots[SLOTS]; /* frames handed to the sender */
+static atomic_int states[SLOTS]; /* SLOT_FREE, SLOT_FILLED or SLOT_SENDING */
+static atomic_int connected; /* viewers connected */
+static atomic_int finished; /* no more frames will follow */
+static pthread_t sender;
+
+/* metrics, reported by freeStream */
+static uint64_t sequence = 0; /* frames due */
+static long streamed = 0; /* frames handed to the sender */
+static long dropped = 0; /* frames dropped while all slots were taken */
+static long connections = 0; /* viewers connected during the run */
+
+/*
+ * Function:  pause_for
+ * ====================
+ *  Sleeps for a short while.
+ *
+ *  nanoseconds: duration
+ *
+ *  returns: void
+ * --------------------
+ */
+static void pause_for(long nanoseconds)
+{
+  struct timespec duration = {0, nanoseconds};
+  nanosleep(&duration, NULL);
+}
+
+/*
+ * Function:  accept_viewers
+ * ====================
+ *  Takes viewers which connected to the socket since the last frame,
+ *  or opens the named pipe once a viewer opened it for reading. Viewers
+ *  are written to without blocking.
+ *
+ *  returns: void
+ * --------------------
+ */
+static void accept_viewers()
+{
+  int fd;
+
+  if(stream_fifo)
+  {
+    /* fails until a viewer has opened the pipe for reading */
+    if(viewers[0].fd < 0 && (viewers[0].fd = open(stream_path, O_WRONLY | O_NONBLOCK)) >= 0)
+    {
+      ++connections;
+      atomic_fetch_add_explicit(&connected, 1, memory_order_relaxed);
+    }
+
+    return;
+  }
+
+  while((fd = accept(listener, NULL, NULL)) >= 0)
+  {
+    int v = 0;
+
+    while(v < STREAM_VIEWERS && viewers[v].fd >= 0)
+    {
+      ++v;
+    }
+
+    if(v == STREAM_VIEWERS || fcntl(fd, F_SETFL, O_NONBLOCK) != 0)
+    {
+      close(fd);
+      continue;
+    }
+
+    viewers[v].fd = fd;
+    ++connections;
+    atomic_fetch_add_explicit(&connected, 1, memory_order_relaxed);
+  }
+}
+
+/*
+ * Function:  release_slot
+ * ====================
+ *  Ends sending a slot to a viewer and frees the slot once no viewer
+ *  needs it anymore.
+ *
+ *  v: viewer
+ *  users: viewers sending every slot
+ *  gone: nonzero if the viewer is disconnected
+ *
+ *  returns: void
+ * --------------------
+ */
+static void release_slot(struct viewer *v, int *users, int gone)
+{
+  if(v->slot >= 0 && --users[v->slot] == 0)
+  {
+    atomic_store_explicit(&states[v->slot], SLOT_FREE, memory_order_release);
+  }
+
+  v->slot = -1;
+
+  if(gone)
+  {
+    close(v->fd);
+    v->fd = -1;
+    atomic_fetch_sub_explicit(&connected, 1, memory_order_relaxed);
+  }
+}
+
+/*
+ * Function:  stream_sender
+ * ====================
+ *  Background thread, takes new viewers, starts idle viewers on the
+ *  newest frame and writes to every viewer as much as it takes without
+ *  blocking, until freeStream is called and all frames are sent. Frames
+ *  superseded before any viewer took them are freed. Viewers which do
+ *  not read at the end of the run are given up.
+ *
+ *  arg: unused
+ *
+ *  returns: NULL
+ * --------------------
+ */
+static void *stream_sender(void *arg)
+{
+  int users[SLOTS] = {0}; /* viewers sending every slot */
+
+  (void) arg;
+
+  while(1)
+  {
+    accept_viewers();
+
+    int newest = -1;
+    uint64_t newest_sequence = 0;
+
+    for(int q = 0; q < SLOTS; ++q)
+    {
+      uint64_t number;
+
+      if(atomic_load_explicit(&states[q], memory_order_acquire) != SLOT_FILLED)
+      {
+        continue;
+      }
+
+      memcpy(&number, slots[q] + offsetof(struct stream_header, sequence), sizeof(number));
+
+      if(newest >= 0 && number < newest_sequence)
+      {
+        atomic_store_explicit(&states[q], SLOT_FREE, memory_order_release);
+        continue;
+      }
+
+      if(newest >= 0)
+      {
+        atomic_store_explicit(&states[newest], SLOT_FREE, memory_order_release);
+      }
+
+      newest = q;
+      newest_sequence = number;
+    }
+
+    struct pollfd ready[STREAM_VIEWERS];
+    int waiting[STREAM_VIEWERS]; /* viewer of every entry of ready */
+    int busy = 0;
+
+    for(int v = 0; v < STREAM_VIEWERS; ++v)
+    {
+      if(viewers[v].fd >= 0 && viewers[v].slot < 0 && newest >= 0 && newest_sequence >= viewers[v].next)
+      {
+        viewers[v].slot = newest;
+        viewers[v].sent = 0;
+        viewers[v].next = newest_sequence + 1;
+        ++users[newest];
+      }
+
+      if(viewers[v].fd >= 0 && viewers[v].slot >= 0)
+      {
+        ready[busy] = (struct pollfd) {viewers[v].fd, POLLOUT, 0};
+        waiting[busy++] = v;
+      }
+    }
+
+    /* kept for the next idle viewer, or freed if nobody watches */
+    if(newest >= 0 && users[newest] > 0)
+    {
+      atomic_store_explicit(&states[newest], SLOT_SENDING, memory_order_relaxed);
+    }
+    else if(newest >= 0 && atomic_load_explicit(&connected, memory_order_relaxed) == 0)
+    {
+      atomic_store_explicit(&states[newest], SLOT_FREE, memory_order_release);
+      newest = -1;
+    }
+
+    if(busy == 0)
+    {
+      /* frames published before finishing are sent first */
+      if(atomic_load_explicit(&finished, memory_order_acquire) && newest < 0)
+      {
+        int q = 0;
+
+        while(q < SLOTS && atomic_load_explicit(&states[q], memory_order_acquire) != SLOT_FILLED)
+        {
+          ++q;
+        }
+
+        if(q == SLOTS)
+        {
+          break;
+        }
+      }
+
+      pause_for(IDLE);
+      continue;
+    }
+
+    int done = atomic_load_explicit(&finished, memory_order_acquire);
+
+    if(poll(ready, busy, done ? PATIENCE : 1) == 0 && done)
+    {
+      for(int b = 0; b < busy; ++b)
+      {
+        release_slot(&viewers[waiting[b]], users, 1);
+      }
+
+      continue;
+    }
+
+    for(int b = 0; b < busy; ++b)
+    {
+      struct viewer *v = &viewers[waiting[b]];
+
+      if(ready[b].revents == 0)
+      {
+        continue;
+      }
+
+      ssize_t sent = write(v->fd, slots[v->slot] + v->sent, frame_bytes - v->sent);
+
+      if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        release_slot(v, users, 1);
+      }
+      else if(sent > 0 && (v->sent += (size_t) sent) == frame_bytes)
+      {
+        release_slot(v, users, 0);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Function:  stream_bytes
+ * ====================
+ *  path: socket or named pipe, NULL if streaming is disabled
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *
+ *  returns: size of all slots initStream takes from the workspace of this process
+ * --------------------
+ */
+size_t stream_bytes(const char *path, int N, int DIM)
+{
+  if(path == NULL || world_rank != 0)
+  {
+    return 0;
+  }
+
+  return SLOTS * workspace_bytes(sizeof(struct stream_header) + (size_t) N * DIM * sizeof(float), 1); /* provided by workspace.h */
+}
+
+/*
+ * Function:  initStream
+ * ====================
+ *  Creates the socket viewers connect to, or uses the named pipe if the
+ *  path is one, takes the slots from the workspace and starts the
+ *  sender. A socket left behind by an earlier run is replaced. Called
+ *  by every process, only the first process streams.
+ *
+ *  path: socket or named pipe, NULL disables streaming
+ *  every: steps between frames
+ *  N: amount of particles
+ *  DIM: dimensions of space
+ *
+ *  returns: void
+ * --------------------
+ */
+void initStream(const char *path, int every, int N, int DIM)
+{
+  struct stat existing;
+  struct sockaddr_un address;
+
+  stream_every = every;
+  stream_N = N;
+  stream_DIM = DIM;
+  stream_active = (path != NULL && world_rank == 0);
+
+  if(!stream_active)
+  {
+    return;
+  }
+
+  if(strlen(path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Path of the stream is too long!\n");
+    exit(0);
+  }
+
+  snprintf(stream_path, sizeof(stream_path), "%s", path);
+
+  for(int v = 0; v < STREAM_VIEWERS; ++v)
+  {
+    viewers[v] = (struct viewer) {-1, -1, 0, 0};
+  }
+
+  int exists = (stat(path, &existing) == 0);
+  stream_fifo = exists && S_ISFIFO(existing.st_mode);
+
+  if(!stream_fifo)
+  {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path));
+
+    if(exists && S_ISSOCK(existing.st_mode))
+    {
+      unlink(path);
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+       listen(listener, STREAM_VIEWERS) != 0 || fcntl(listener, F_SETFL, O_NONBLOCK) != 0)
+    {
+      fprintf(stderr, "Unable to create the stream!\n");
+      exit(0);
+    }
+  }
+
+  /* a viewer closing its end only ends its own connection */
+  signal(SIGPIPE, SIG_IGN);
+
+  frame_bytes = sizeof(struct stream_header) + (size_t) N * DIM * sizeof(float);
+
+  for(int q = 0; q < SLOTS; ++q)
+  {
+    slots[q] = workspace_alloc(frame_bytes, 1); /* provided by workspace.h */
+    atomic_init(&states[q], SLOT_FREE);
+  }
+
+  atomic_init(&connected, 0);
+  atomic_init(&finished, 0);
+
+  if(pthread_create(&sender, NULL, stream_sender, NULL) != 0)
+  {
+    fprintf(stderr, "Unable to start stream sender!\n");
+    exit(0);
+  }
+
+  printf("Streaming every %d steps to %s %s\n", every, stream_fifo ? "named pipe" : "socket", path);
+}
+
+/*
+ * Function:  freeStream
+ * ====================
+ *  Sends the frames still waiting, stops the sender, prints the metrics
+ *  of the stream, disconnects all viewers, removes the socket and frees
+ *  the slots. Called by every process.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeStream()
+{
+  if(!stream_active)
+  {
+    return;
+  }
+
+  atomic_store_explicit(&finished, 1, memory_order_release);
+  pthread_join(sender, NULL);
+
+  printf("Frames streamed: %ld of %llu, %ld dropped while all slots were taken, %ld viewers connected\n", streamed,
+         (unsigned long long) sequence, dropped, connections);
+
+  for(int v = 0; v < STREAM_VIEWERS; ++v)
+  {
+    if(viewers[v].fd >= 0)
+    {
+      close(viewers[v].fd);
+      viewers[v].fd = -1;
+    }
+  }
+
+  if(listener >= 0)
+  {
+    close(listener);
+    unlink(stream_path);
+    listener = -1;
+  }
+
+  for(int q = 0; q < SLOTS; ++q)
+  {
+    workspace_free(slots[q]);
+    slots[q] = NULL;
+  }
+
+  stream_active = 0;
+}
+
+/*
+ * Function:  stream_due
+ * ====================
+ *  iteration: current iteration
+ *
+ *  returns: nonzero if this process streams the current iteration
+ * --------------------
+ */
+int stream_due(int iteration)
+{
+  return stream_active && iteration % stream_every == 0;
+}
+
+/*
+ * Function:  stream_frame
+ * ====================
+ *  Converts the positions of all particles into a free slot and hands
+ *  it to the sender. Never waits, the frame is dropped if all slots are
+ *  taken and skipped while no viewer is connected.
+ *
+ *  iteration: current iteration
+ *  time: current time
+ *  s: particles
+ *  slot: index of the particle with every ID, NULL if unordered
+ *
+ *  returns: void
+ * --------------------
+ */
+void stream_frame(int iteration, double time, const struct state *s, const int *slot)
+{
+  int N = stream_N, DIM = stream_DIM;
+  struct stream_header header = {STREAM_MAGIC, STREAM_ENDIAN, sizeof(header), DIM, N, iteration, time, sequence++};
+
+  if(atomic_load_explicit(&connected, memory_order_relaxed) == 0)
+  {
+    return;
+  }
+
+  int q = 0;
+
+  while(q < SLOTS && atomic_load_explicit(&states[q], memory_order_acquire) != SLOT_FREE)
+  {
+    ++q;
+  }
+
+  if(q == SLOTS)
+  {
+    ++dropped;
+    return;
+  }
+
+  float *positions = (float *) (slots[q] + sizeof(header));
+
+  memcpy(slots[q], &header, sizeof(header));
+
+  #pragma omp parallel for
+  for(int id = 0; id < N; ++id)
+  {
+    int mi = (slot != NULL) ? slot[id] : id;
+
+    for(int k = 0; k < DIM; ++k)
+    {
+      positions[id * DIM + k] = (float) creal(s->pos[mi * DIM + k]);
+    }
+  }
+
+  atomic_store_explicit(&states[q], SLOT_FILLED, memory_order_release);
+  ++streamed;
+}
@@ -0,0 +1,37 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_MAGIC "NBLV" /* first bytes of every streamed frame */
+#define STREAM_ENDIAN 0x01020304u /* reads as 0x04030201 if the byte order is swapped */
+#define STREAM_VIEWERS 8 /* most viewers connected to the socket at once */
+
+/* header of every frame sent to the viewers, in the byte order of the machine, followed
+   by the positions of all particles as floats in the order of the particle IDs */
+struct stream_header
+{
+  char magic[4]; /* STREAM_MAGIC without terminating zero */
+  uint32_t endian; /* STREAM_ENDIAN */
+  uint32_t header_bytes; /* size of this header, the positions start here */
+  uint32_t dim; /* dimensions of space */
+  int64_t n; /* amount of particles */
+  int64_t iteration; /* iteration of the frame */
+  double time; /* time of the frame */
+  uint64_t sequence; /* number of the frame among all frames due, gaps are dropped frames */
+};
+
+struct state; /* particles, see engine.h, only needed by the simulation */
+
+size_t stream_bytes(const char *path, int N, int DIM);
+
+void initStream(const char *path, int every, int N, int DIM);
+
+int stream_due(int iteration);
+
+void stream_frame(int iteration, double time, const struct state *s, const int *slot);
+
+void freeStream(void);
+
+#endif // STREAM_H_
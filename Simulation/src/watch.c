@@ -0,0 +1,214 @@
+/*
+    The following source code provides a small viewer on the command line
+    for frames streamed by a running simulation, see stream.c. It connects
+    to the socket or opens the named pipe, checks every frame and prints
+    iteration, time, center and extent of the particles. Frames dropped
+    for slow viewers are counted from the gaps in the sequence numbers, a
+    delay after every frame imitates a slow viewer.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Function:  read_all
+ * ====================
+ *  Reads exactly the given amount of bytes.
+ *
+ *  fd: stream
+ *  data: bytes read
+ *  bytes: amount of bytes
+ *
+ *  returns: zero on success, nonzero at the end of the stream
+ * --------------------
+ */
+static int read_all(int fd, void *data, size_t bytes)
+{
+  unsigned char *next = data;
+
+  while(bytes > 0)
+  {
+    ssize_t got = read(fd, next, bytes);
+
+    if(got <= 0)
+    {
+      return 1;
+    }
+
+    next += got;
+    bytes -= (size_t) got;
+  }
+
+  return 0;
+}
+
+/*
+ * Function:  main
+ * ====================
+ *  Connects to the stream and prints every frame until the simulation
+ *  ends.
+ *
+ *  argc: amount of command line arguments
+ *  argv: path of the stream and optionally milliseconds to wait after every frame
+ *
+ *  returns: zero if every frame was complete
+ * --------------------
+ */
+int main(int argc, char *argv[])
+{
+  struct stat existing;
+  struct sockaddr_un address;
+  struct stream_header header;
+  int fd;
+
+  if(argc < 2 || argc > 3 || strlen(argv[1]) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Usage: ./watch <path> [<delay in milliseconds>]\n");
+    exit(0);
+  }
+
+  long delay = (argc == 3) ? atol(argv[2]) : 0;
+
+  if(stat(argv[1], &existing) == 0 && S_ISFIFO(existing.st_mode))
+  {
+    fd = open(argv[1], O_RDONLY);
+  }
+  else
+  {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, argv[1], strlen(argv[1]));
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(fd >= 0 && connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  if(fd < 0)
+  {
+    fprintf(stderr, "Unable to connect to the stream!\n");
+    exit(0);
+  }
+
+  long received = 0, dropped = 0;
+  uint64_t expected = 0;
+  float *positions = NULL;
+  size_t capacity = 0;
+  int damaged = 0;
+
+  while(read_all(fd, &header, sizeof(header)) == 0)
+  {
+    if(memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0 || header.endian != STREAM_ENDIAN ||
+       header.header_bytes < sizeof(header) || header.n < 0 || header.dim < 1)
+    {
+      fprintf(stderr, "Damaged frame after %ld frames!\n", received);
+      damaged = 1;
+      break;
+    }
+
+    /* later versions may extend the header */
+    for(uint32_t skip = header.header_bytes - sizeof(header); skip > 0; --skip)
+    {
+      char c;
+      damaged |= read_all(fd, &c, 1);
+    }
+
+    size_t count = (size_t) header.n * header.dim;
+
+    if(count > capacity)
+    {
+      free(positions);
+      positions = malloc(count * sizeof(float));
+      capacity = (positions != NULL) ? count : 0;
+
+      if(positions == NULL)
+      {
+        fprintf(stderr, "Unable to allocate the frame!\n");
+        exit(0);
+      }
+    }
+
+    if(damaged || read_all(fd, positions, count * sizeof(float)) != 0)
+    {
+      fprintf(stderr, "Incomplete frame after %ld frames!\n", received);
+      damaged = 1;
+      break;
+    }
+
+    dropped += (received > 0 && header.sequence > expected) ? (long) (header.sequence - expected) : 0;
+    expected = header.sequence + 1;
+    ++received;
+
+    /* center of the particles and the largest distance from it */
+    double center[3] = {0.0, 0.0, 0.0};
+    double extent = 0.0;
+    int dims = (header.dim < 3) ? (int) header.dim : 3;
+
+    for(int64_t i = 0; i < header.n; ++i)
+    {
+      for(int k = 0; k < dims; ++k)
+      {
+        center[k] += positions[i * header.dim + k] / (double) header.n;
+      }
+    }
+
+    for(int64_t i = 0; i < header.n; ++i)
+    {
+      double r = 0.0;
+
+      for(int k = 0; k < dims; ++k)
+      {
+        r += (positions[i * header.dim + k] - center[k]) * (positions[i * header.dim + k] - center[k]);
+      }
+
+      extent = (r > extent * extent) ? sqrt(r) : extent;
+    }
+
+    printf("Frame %llu: iteration %lld, time %f, %lld particles, center %f %f %f, extent %f\n",
+           (unsigned long long) header.sequence, (long long) header.iteration, header.time, (long long) header.n,
+           center[0], center[1], center[2], extent);
+    fflush(stdout);
+
+    if(delay > 0)
+    {
+      struct timespec duration = {delay / 1000, (delay % 1000) * 1000000};
+      nanosleep(&duration, NULL);
+    }
+  }
+
+  printf("Frames received: %ld, dropped: %ld\n", received, dropped);
+
+  free(positions);
+  close(fd);
+
+  return damaged;
+}
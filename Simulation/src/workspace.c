@@ -0,0 +1,286 @@
+/*
+    The following source-code provides the workspace, one block of memory
+    allocated before the simulation starts, from which all arrays of the
+    simulation are carved. Requests which do not fit fall back to the heap,
+    where arrays of at least a huge page also get transparent huge pages.
+    Every request is counted, which allows to verify that the time loop
+    does not allocate memory. The block is mapped without touching it and
+    optionally backed by huge pages. With the mesh engines, whose particle
+    loops are statically partitioned among the threads, every array is first
+    touched in that partition, so its pages are placed on the memory node of
+    the thread working on them, as long as OMP_PROC_BIND keeps the threads
+    in place. The direct kernels and the integrators run on one thread,
+    their arrays are touched by that thread.
+
+    Copyright (C) 2017  Nicholas Lee Hickson-Brown, Michael Eidus
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "workspace.h"
+
+#define HUGE_PAGE (2UL << 20) /* size of a huge page on x86-64 and aarch64 */
+
+static char *arena = NULL; /* block of memory holding the workspace */
+static size_t arena_size = 0, arena_used = 0; /* size of block and bytes handed out */
+static void *mapping = NULL; /* mapping containing the block, larger to allow alignment */
+static size_t mapping_size = 0;
+static int arena_pages = WORKSPACE_PAGES_DEFAULT; /* pages actually backing the block */
+static long allocations = 0; /* amount of requests, including those served by the heap */
+static long overflow = 0; /* requests served by the heap because the workspace was full */
+static size_t overflow_bytes = 0;
+static int spread = 0; /* nonzero if arrays are first touched by all threads */
+
+static const char *page_names[] = {"default", "transparent", "explicit"};
+
+/*
+ * Function:  workspace_bytes
+ * ====================
+ *  Calculates the space an array occupies within the workspace.
+ *
+ *  count: amount of elements
+ *  size: size of one element
+ *
+ *  returns: size of array rounded up to the alignment
+ * --------------------
+ */
+size_t workspace_bytes(size_t count, size_t size)
+{
+  return (count * size + WORKSPACE_ALIGN - 1) / WORKSPACE_ALIGN * WORKSPACE_ALIGN;
+}
+
+/*
+ * Function:  first_touch
+ * ====================
+ *  Initializes an array to zero. If the force loops are statically
+ *  partitioned, every thread writes the part of the array belonging to
+ *  the particles it handles, which maps the pages on the memory node of
+ *  that thread, otherwise the calling thread writes all of it.
+ *
+ *  ptr: pointer to array
+ *  count: amount of elements
+ *  size: size of one element
+ *
+ *  returns: void
+ * --------------------
+ */
+static void first_touch(char *ptr, size_t count, size_t size)
+{
+  #pragma omp parallel for schedule(static) if(spread)
+  for(long i = 0; i < (long) count; ++i)
+  {
+    memset(ptr + i * size, 0, size);
+  }
+}
+
+/*
+ * Function:  initWorkspace
+ * ====================
+ *  Maps the workspace, the pages are placed on first touch by
+ *  workspace_alloc. Explicit huge pages fall back to transparent
+ *  ones if the system provides none.
+ *
+ *  bytes: size of workspace, sum of workspace_bytes of all arrays
+ *  pages: WORKSPACE_PAGES_DEFAULT, _TRANSPARENT or _EXPLICIT
+ *  threaded: nonzero if the force loops are statically partitioned among the threads
+ *
+ *  returns: void
+ * --------------------
+ */
+void initWorkspace(size_t bytes, int pages, int threaded)
+{
+  arena_size = workspace_bytes(bytes, 1);
+  arena_used = 0;
+  arena_pages = pages;
+  spread = threaded;
+  mapping = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if(pages == WORKSPACE_PAGES_EXPLICIT)
+  {
+    mapping_size = (arena_size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE + HUGE_PAGE;
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+
+  if(mapping == MAP_FAILED)
+  {
+    if(pages == WORKSPACE_PAGES_EXPLICIT)
+    {
+      fprintf(stderr, "No explicit huge pages available, using transparent huge pages!\n");
+      arena_pages = WORKSPACE_PAGES_TRANSPARENT;
+    }
+
+    /* one additional huge page allows to align the block to a huge page boundary */
+    mapping_size = arena_size + ((arena_pages == WORKSPACE_PAGES_DEFAULT) ? WORKSPACE_ALIGN : HUGE_PAGE);
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  /* allocation guard */
+  if(mapping == MAP_FAILED)
+  {
+    fprintf(stderr, "Out of memory!\n");
+    exit(0);
+  }
+
+  size_t boundary = (arena_pages == WORKSPACE_PAGES_DEFAULT) ? WORKSPACE_ALIGN : HUGE_PAGE;
+  arena = (char *) (((size_t) mapping + boundary - 1) / boundary * boundary);
+
+#ifdef MADV_HUGEPAGE
+  if(arena_pages == WORKSPACE_PAGES_TRANSPARENT)
+  {
+    madvise(arena, (arena_size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+/*
+ * Function:  workspace_alloc
+ * ====================
+ *  Hands out an aligned array initialized to zero, from the workspace
+ *  if it fits and from the heap otherwise. The array is first touched
+ *  as described in first_touch, before which large heap arrays are
+ *  advised to use huge pages if the workspace does.
+ *
+ *  count: amount of elements
+ *  size: size of one element
+ *
+ *  returns: pointer to array
+ * --------------------
+ */
+void *workspace_alloc(size_t count, size_t size)
+{
+  size_t bytes = workspace_bytes(count, size);
+  char *ptr;
+
+  ++allocations;
+
+  if(arena != NULL && arena_used + bytes <= arena_size)
+  {
+    ptr = arena + arena_used;
+    arena_used += bytes;
+  }
+  else
+  {
+    /* arrays of at least a huge page are aligned to one, so huge pages back them as well */
+    size_t align = (arena_pages != WORKSPACE_PAGES_DEFAULT && bytes >= HUGE_PAGE) ? HUGE_PAGE : WORKSPACE_ALIGN;
+    size_t length = (bytes + align - 1) / align * align;
+
+    ++overflow;
+    overflow_bytes += bytes;
+
+    ptr = aligned_alloc(align, length > 0 ? length : WORKSPACE_ALIGN);
+
+    /* allocation guard */
+    if(ptr == NULL)
+    {
+      fprintf(stderr, "Out of memory!\n");
+      exit(0);
+    }
+
+#ifdef MADV_HUGEPAGE
+    /* the hugetlbfs pool is only available to the block, the heap gets transparent huge pages */
+    if(align == HUGE_PAGE)
+    {
+      madvise(ptr, length, MADV_HUGEPAGE);
+    }
+#endif
+
+    memset(ptr + count * size, 0, bytes - count * size);
+  }
+
+  first_touch(ptr, count, size);
+
+  return ptr;
+}
+
+/*
+ * Function:  workspace_free
+ * ====================
+ *  Frees an array handed out by workspace_alloc, arrays within the
+ *  workspace are released together with it.
+ *
+ *  ptr: pointer to array
+ *
+ *  returns: void
+ * --------------------
+ */
+void workspace_free(void *ptr)
+{
+  /* empty arrays handed out by a full workspace point to its end */
+  if(arena == NULL || (char *) ptr < arena || (char *) ptr > arena + arena_size)
+  {
+    free(ptr);
+  }
+}
+
+/*
+ * Function:  workspace_allocations
+ * ====================
+ *  returns: amount of requests to workspace_alloc so far
+ * --------------------
+ */
+long workspace_allocations()
+{
+  return allocations;
+}
+
+/*
+ * Function:  workspace_overflow
+ * ====================
+ *  bytes: set to the size of the arrays served by the heap
+ *
+ *  returns: amount of requests to workspace_alloc served by the heap so far
+ * --------------------
+ */
+long workspace_overflow(size_t *bytes)
+{
+  *bytes = overflow_bytes;
+
+  return overflow;
+}
+
+/*
+ * Function:  workspace_pages
+ * ====================
+ *  returns: name of the pages backing the workspace
+ * --------------------
+ */
+const char *workspace_pages()
+{
+  return page_names[arena_pages];
+}
+
+/*
+ * Function:  freeWorkspace
+ * ====================
+ *  Unmaps the workspace and all arrays within it.
+ *
+ *  returns: void
+ * --------------------
+ */
+void freeWorkspace()
+{
+  if(arena != NULL)
+  {
+    munmap(mapping, mapping_size);
+  }
+
+  arena = NULL;
+  arena_size = arena_used = 0;
+}
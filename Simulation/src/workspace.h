@@ -0,0 +1,26 @@
+#ifndef WORKSPACE_H_
+#define WORKSPACE_H_
+
+#define WORKSPACE_ALIGN 64 /* alignment of all arrays, size of a cache line */
+
+#define WORKSPACE_PAGES_DEFAULT 0 /* pages of the operating system */
+#define WORKSPACE_PAGES_TRANSPARENT 1 /* huge pages requested with madvise */
+#define WORKSPACE_PAGES_EXPLICIT 2 /* huge pages from the hugetlbfs pool */
+
+size_t workspace_bytes(size_t count, size_t size);
+
+void initWorkspace(size_t bytes, int pages, int threaded);
+
+void *workspace_alloc(size_t count, size_t size);
+
+void workspace_free(void *ptr);
+
+long workspace_allocations(void);
+
+long workspace_overflow(size_t *bytes);
+
+const char *workspace_pages(void);
+
+void freeWorkspace(void);
+
+#endif // WORKSPACE_H_
@@ -10,6 +10,8 @@ void drawParticles(Shader &shader); // Draw instanced particles
 void drawCircle(Shader &shader, float radius, glm::vec3 scaleColor);
 void readEnergyData(glm::vec3 *energy);
 int countParticle();
-int countIterations();
+struct trajectory *openSnapshots();
+int readSnapshot(int frameNumber, glm::vec3 *translations);
+int countFrames();
 
 #endif // HEADER_H_
\ No newline at end of file
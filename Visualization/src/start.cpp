@@ -5,6 +5,8 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <windows.h>
 #include <math.h>
 #include <io.h>      /* Count files(iterations) MS-DOS , #include <unistd.h> for UNIX/LINUX */
@@ -27,6 +29,9 @@
 // Shader class
 #include <opengl/shader.h>
 
+// Snapshot reader of the simulation, reader.c and compress.c are compiled with the project
+#include "../../Simulation/src/reader.h"
+
 // Function Prototypes
 #include "header.h" 
 //---Includes---END
@@ -43,10 +48,13 @@ glm::vec3 scaleDistanceOutsideColor = glm::vec3(1, 0, 0);
 // Data settings
 char dataFolder[128] = "run"; // Default folder for data
 const int NUM_PARTICLE = countParticle(); // Set number of particles 
-const int numOfIterations = countIterations(); // Set number of iterations
+std::vector<int> csvIterations; // Iterations of the iteration_X.csv files, in ascending order
+int lastIteration = 0; // Iteration of the last frame
+const int numOfFrames = countFrames(); // Set number of frames, written every few iterations
 int particlesWithscaleDistanceToCenter = 0;
 int particlesWithscaleDistanceOutside = 0;
-int iterationCounter = 1; // Current iteration
+int frameCounter = 0; // Current frame, 0 shows the initial conditions
+int currentIteration = 0; // Iteration of the current frame
 int indexStar = 0; // Every iteration a new star
 const float sparklingTime = 0.5;
 int sparklingStar = 0;
@@ -59,7 +67,7 @@ int error = 0;
 int simpleStars = 1;
 
 int numberOfPoints = 93; // Number of points for star shape (number of vertices)
-glm::vec3 *energy = (glm::vec3 *)malloc((numOfIterations+1) * sizeof(glm::vec3)); // Generate a new list of numOfIterations particles for energy data
+glm::vec3 *energy = (glm::vec3 *)malloc((lastIteration+1) * sizeof(glm::vec3)); // Generate a new list of energy data for every iteration up to the last frame
 
 //Hotkey customizable settings
 int fullScreen = 0;
@@ -323,7 +331,7 @@ int main()
 					RenderText(shaderText, "Marked: " + std::to_string(numberOfMarkedParticles), 5.0f, 65.0f, 0.2f, textColor);
 				}
 
-				RenderText(shaderText, "Iterations: " + std::to_string(numOfIterations), 5.0f, 55.0f, 0.2f, textColor);
+				RenderText(shaderText, "Frames: " + std::to_string(numOfFrames), 5.0f, 55.0f, 0.2f, textColor);
 				RenderText(shaderText, "Particles:   " + std::to_string(NUM_PARTICLE), 5.0f, 45.0f, 0.2f, textColor);
 			}		
 
@@ -331,8 +339,8 @@ int main()
 			RenderText(shaderText, "Distance < " + std::to_string(scaleDistanceToCenter).substr(0, 4) + ": " + std::to_string(particlesWithscaleDistanceToCenter), 20.0f, 35.0f, 0.2f, textColor);
 			RenderText(shaderText, "==>", 5.0f, 25.0f, 0.2f, scaleDistanceOutsideColor);
 			RenderText(shaderText, "Distance > " + std::to_string(scaleDistanceOutside).substr(0, 4) + ": " + std::to_string(particlesWithscaleDistanceOutside), 20.0f, 25.0f, 0.2f, textColor);
-			RenderText(shaderText, "Energy: " + std::to_string((double)energy[iterationCounter].x) + " , " + std::to_string((double)energy[iterationCounter].y) + " , " + std::to_string((double)energy[iterationCounter].z), 5.0f, 15.0f, 0.2f, textColor);
-			RenderText(shaderText, "Iteration: " + std::to_string(iterationCounter), 5.0f, 5.0f, 0.2f, textColor);
+			RenderText(shaderText, "Energy: " + std::to_string((double)energy[currentIteration].x) + " , " + std::to_string((double)energy[currentIteration].y) + " , " + std::to_string((double)energy[currentIteration].z), 5.0f, 15.0f, 0.2f, textColor);
+			RenderText(shaderText, "Iteration: " + std::to_string(currentIteration), 5.0f, 5.0f, 0.2f, textColor);
 		}
 
 		if (error == 1) // If last iteration
@@ -363,19 +371,19 @@ int main()
 		glfwPollEvents();
 
 		// If end of data is reached
-		if (iterationCounter >= numOfIterations)
+		if (frameCounter >= numOfFrames)
 		{
 			error = 1; // Print END OF DATA
 		}
-		else if(active == 1) // Else next iteration and slowmotion check
+		else if(active == 1) // Else next frame and slowmotion check
 		{
 			if (slowMotion == 0)
 			{
-				iterationCounter++;
+				frameCounter++;
 			}
 			else if (slowMotion == 1)
 			{
-				iterationCounter++;
+				frameCounter++;
 				slowMotion = 2;
 			}
 			else if (slowMotion == 2)
@@ -419,28 +427,40 @@ void drawParticles(Shader &shader)
 
 	char file[128];
 
-	if (iterationCounter == 1) // Initial conditions
+	if (frameCounter == 0) // Initial conditions
 	{
 		// Read locations from initial_conditions.csv
 		snprintf(file, sizeof(char) * 128, "%s\\initial_conditions.csv", dataFolder);
+		currentIteration = 0;
 	}
-	else // Iterations
+	else // Frames
 	{
-		// Read locations from iteration.csv
-		snprintf(file, sizeof(char) * 128, "%s\\iteration_%i.csv", dataFolder, iterationCounter);
+		// Read locations from trajectory.nbs, or from iteration.csv if the simulation wrote text
+		snprintf(file, sizeof(char) * 128, "%s\\trajectory.nbs", dataFolder);
+
+		if (_access(file, 00) == -1)
+		{
+			currentIteration = csvIterations[frameCounter - 1];
+			snprintf(file, sizeof(char) * 128, "%s\\iteration_%i.csv", dataFolder, currentIteration);
+		}
 	}
 	FILE *CSV;
 	int index = 0; // Curent particle
+	int binary = (strstr(file, ".nbs") != NULL);
 	float x, y, z, m, vx, vy, vz;
 
-	CSV = fopen(file, "r");
-	if (CSV == NULL)
+	CSV = binary ? NULL : fopen(file, "r");
+	if (!binary && CSV == NULL)
 	{
 		printf("Unable to open %c \n", file);
 	}
 	else
 	{
-		while ((fscanf(CSV, "%f,%f,%f,%f,%f,%f,%f\n", &x, &y, &z, &m, &vx, &vy, &vz)) > 0) // Each loop reads one row of the file
+		if (binary)
+		{
+			index = readSnapshot(frameCounter - 1, translations);
+		}
+		while (!binary && (fscanf(CSV, "%f,%f,%f,%f,%f,%f,%f\n", &x, &y, &z, &m, &vx, &vy, &vz)) > 0) // Each loop reads one row of the file
 		{
 			// Set position offsets for instance
 			glm::vec3 translation;
@@ -469,7 +489,10 @@ void drawParticles(Shader &shader)
 		{
 			printf("ERROR - %c: row %i - Press W to resume \n", file, index + 1); // Input-Data Error			
 		}
-		fclose(CSV);
+		if (!binary)
+		{
+			fclose(CSV);
+		}
 	}
 
 	// Store instance data in an array buffer
@@ -675,8 +698,10 @@ void readEnergyData(glm::vec3 *energy)
 	snprintf(file, sizeof(char) * 128, "%s\\energy_diagnostics.csv", dataFolder);
 
 	FILE *CSV1;
-	int index1 = 0;
-	float x1, y1, z1;
+	int index1 = -1; // Last iteration read
+	int iteration;
+	float time, x1, y1, z1;
+	glm::vec3 translation(0.0f, 0.0f, 0.0f);
 
 	CSV1 = fopen(file, "r");
 	if (CSV1 == NULL)
@@ -685,20 +710,29 @@ void readEnergyData(glm::vec3 *energy)
 	}
 	else
 	{
-		while ((fscanf(CSV1, "%f,%f,%f\n", &x1, &y1, &z1)) > 0) // Each loop reads one row of the file
+		// Each loop reads one row of the file: iteration, time, kinetic, potential and total energy, method and error of the potential energy are skipped
+		while ((fscanf(CSV1, "%d,%f,%f,%f,%f%*[^\n]\n", &iteration, &time, &x1, &y1, &z1)) == 5 && iteration <= lastIteration)
 		{
-			glm::vec3 translation;
+			// Iterations without diagnostics keep the values of the last diagnostics
+			while (index1 < iteration - 1)
+			{
+				energy[++index1] = translation;
+			}
+
 			translation.x = x1;
 			translation.y = y1;
 			translation.z = z1;
-			energy[index1] = translation;
+			energy[++index1] = translation;
+		}
 
-			index1++;
+		if (index1 < 0) // If no row could be read => Error
+		{
+			printf("ERROR - %s\\energy_diagnostics.csv: row 1\n", dataFolder); // Input-Data Error			
 		}
 
-		if (index1 < numOfIterations) // If not all rows in file were counted => Error
+		while (index1 < lastIteration)
 		{
-			printf("ERROR - %s\\energy_diagnostics.csv: row %i\n", dataFolder, index1 + 1); // Input-Data Error			
+			energy[++index1] = translation;
 		}
 		fclose(CSV1);
 	}
@@ -739,21 +773,88 @@ int countParticle()
 	return rows;
 }
 
-// Count iterations 
-int countIterations()
+// Map the trajectory with the snapshot reader of the simulation, it stays open until the data folder changes
+struct trajectory *openSnapshots()
 {
-	int iterationCounter = 1;
+	static struct trajectory *snapshots = NULL;
+	static char folder[128] = "";
+
+	if (snapshots == NULL || strcmp(folder, dataFolder) != 0)
+	{
+		closeTrajectory(snapshots);
+		snprintf(folder, sizeof(char) * 128, "%s", dataFolder);
+		snapshots = openTrajectory(folder);
+	}
+	return snapshots;
+}
+
+// Read positions of one frame of the trajectory, the frames start with 0 and hold the iteration they were written at
+int readSnapshot(int frameNumber, glm::vec3 *translations)
+{
+	struct snapshot_frame frame;
+	struct trajectory *snapshots = openSnapshots();
+	int index = 0; // Curent particle
+
+	if (snapshots == NULL || read_frame(snapshots, frameNumber, &frame) != 0 || frame.pos.values == NULL || frame.dim != 3)
+	{
+		return 0;
+	}
+	currentIteration = (int)frame.iteration;
+
+	// Raw positions are used where they lie in the mapped file, compressed ones are restored by the reader
+	const double *p = view_doubles(&frame.pos);
+	const float *f = view_floats(&frame.pos);
+
+	for (index = 0; index < frame.n && index < NUM_PARTICLE; index++)
+	{
+		translations[index] = (p != NULL) ? glm::vec3(p[3 * index], p[3 * index + 1], p[3 * index + 2]) : glm::vec3(f[3 * index], f[3 * index + 1], f[3 * index + 2]);
+	}
+	return index;
+}
+
+// Count frames and find the iteration of the last one, frames are written every few iterations or every interval of time
+int countFrames()
+{
+	int frames = 0;
 	char buffer[128];
+	struct trajectory *snapshots = openSnapshots();
 
-	snprintf(buffer, sizeof(char) * 128, "%s\\iteration_%i.csv", dataFolder, iterationCounter);
+	if (snapshots != NULL) // Every entry of the index holds one frame
+	{
+		struct snapshot_frame frame;
 
-	while (_access(buffer, 00) != -1) // While file exists
+		frames = (int)trajectory_frames(snapshots);
+		if (frames > 0 && read_frame(snapshots, frames - 1, &frame) == 0)
+		{
+			lastIteration = (int)frame.iteration;
+		}
+	}
+	else // Every iteration_X.csv file holds one frame, X is its iteration
 	{
-		iterationCounter++;
-		snprintf(buffer, sizeof(char) * 128, "%s\\iteration_%i.csv", dataFolder, iterationCounter);
+		struct _finddata_t found;
+		int iteration;
+
+		snprintf(buffer, sizeof(char) * 128, "%s\\iteration_*.csv", dataFolder);
+		intptr_t handle = _findfirst(buffer, &found);
+
+		if (handle != -1)
+		{
+			do
+			{
+				if (sscanf(found.name, "iteration_%d.csv", &iteration) == 1)
+				{
+					csvIterations.push_back(iteration);
+				}
+			} while (_findnext(handle, &found) == 0);
+			_findclose(handle);
+		}
+		std::sort(csvIterations.begin(), csvIterations.end());
+
+		frames = (int)csvIterations.size();
+		lastIteration = (frames > 0) ? csvIterations.back() : 0;
 	}
-	printf("Iterations: %d\n", iterationCounter - 1);
-	return iterationCounter - 1;
+	printf("Frames: %d, last iteration: %d\n", frames, lastIteration);
+	return frames;
 }
 
 // Get datafolder and check arguments
@@ -913,7 +1014,7 @@ void processInput(GLFWwindow *window)
 
 	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) // Reset
 	{
-		iterationCounter = 1;
+		frameCounter = 0;
 		if (error = 1)
 		{
 			error = 0;